@@ -86,13 +86,15 @@ function loadFns() {
   else if (fns.status == 'overflow') {loadImgs();}
   else { writeFn(document.getElementById('newImg'), fns);}}); 
 }
-function loadImgs() {
- fetch('nextImage')
+function loadImgs(session) {
+ fetch('nextImage?' + new URLSearchParams({ session: session === undefined ? 'new' : session }))
  .then(response => response.json())
  .then(image => {
-  if (image.status == 'wait') {setTimeout(loadImgs, 50);}
+  if (image.session !== undefined) {imgs = []; loadImgs(image.session);}
+  else if (image.status == 'wait') {setTimeout(() => loadImgs(session), 50);}
+  else if (image.status == 'expired') {loadImgs();}
   else if (image.status == 'done') { loadImages(document.getElementById('newImg'));}
-  else {imgs.push(image); loadImgs();}});
+  else {imgs.push(image); loadImgs(session);}});
 }
  function writeFn(ni, fns) {
   for (let fn of fns.filenames) {
@@ -20,6 +20,8 @@
  **/
 
 #include "ZuluControlI2CClient.h"
+#include "log.h"
+#include "trace.h"
 
 namespace zuluide::i2c::client {
 
@@ -28,6 +30,64 @@ static queue_t outputQueue;
 static queue_t inputQueue;
 static queue_t availInputQueue;
 
+/**
+   Tracked request that has been sent, passed from the I2C interrupt to
+   ProcessMessages.
+ */
+typedef struct {
+   uint32_t trackId;
+   uint32_t sentUs;
+} SentRequest;
+
+static queue_t sentQueue;
+
+// Counted in the I2C interrupt, apart from the output queue marks.
+static volatile uint32_t framesSent = 0;
+static volatile uint32_t bytesSent = 0;
+static volatile uint32_t framesReceived = 0;
+static volatile uint32_t bytesReceived = 0;
+static volatile uint32_t outputQueueResets = 0;
+static volatile size_t outputQueueHighWater = 0;
+static volatile size_t inputQueueHighWater = 0;
+static volatile size_t availInputQueueLowWater = INPUT_BUFFER_COUNT;
+
+/**
+   Counts a request that has been sent and records it if it is tracked.
+ */
+static void NotifySent(Packet* sent) {
+   TRACE_INSTANT("i2c sent", sent->command);
+   framesSent++;
+   bytesSent += 3 + sent->length;
+   if (sent->trackId != 0) {
+      SentRequest record = {sent->trackId, time_us_32()};
+      queue_try_add(&sentQueue, &record);
+   }
+}
+
+/**
+   Passes a completely received message to ProcessMessages.
+ */
+static void NotifyReceived(Packet* received) {
+   TRACE_INSTANT("i2c received", received->command);
+   framesReceived++;
+   bytesReceived += 3 + received->length;
+   queue_try_add(&inputQueue, &received);
+   size_t level = queue_get_level(&inputQueue);
+   if (level > inputQueueHighWater) {
+      inputQueueHighWater = level;
+   }
+}
+
+/**
+   Raises the output queue high water mark to its current level.
+ */
+static void UpdateOutputQueueHighWater() {
+   size_t level = queue_get_level(&outputQueue);
+   if (level > outputQueueHighWater) {
+      outputQueueHighWater = level;
+   }
+}
+
 static void i2c_slave_handler(i2c_inst_t* i2c, i2c_slave_event_t event) {
    switch (event) {
       case I2C_SLAVE_RECEIVE: {
@@ -36,10 +96,14 @@ static void i2c_slave_handler(i2c_inst_t* i2c, i2c_slave_event_t event) {
             static bool input_queue_removed = true;
             if (queue_try_remove(&availInputQueue, &current)) {
                input_queue_removed = true;
+               size_t level = queue_get_level(&availInputQueue);
+               if (level < availInputQueueLowWater) {
+                  availInputQueueLowWater = level;
+               }
             }
             else if (input_queue_removed)
             {
-               printf("Unable to get a free buffer\n");
+               LOG_WARN("Unable to get a free buffer\n");
                input_queue_removed = false;
             }
          }
@@ -48,6 +112,7 @@ static void i2c_slave_handler(i2c_inst_t* i2c, i2c_slave_event_t event) {
             if (i2c_get_read_available(i2c0) > 0) {
                current->command = i2c_read_byte_raw(i2c0);
                current->state = SendState::SentCommand;
+               TRACE_INSTANT("i2c receive", current->command);
             }
          } else if (current->state == SendState::SentCommand) {
             if (current->pos == 0) {
@@ -60,7 +125,7 @@ static void i2c_slave_handler(i2c_inst_t* i2c, i2c_slave_event_t event) {
                   current->length = (current->lengthBytes[0] << 8) | current->lengthBytes[1];
                   if (current->length == 0) {
                      // We have now received the entire message.
-                     queue_try_add(&inputQueue, &current);
+                     NotifyReceived((Packet*)current);
                      current = NULL;
                   }
                } else if (i2c_get_read_available(i2c0) > 0) {
@@ -77,7 +142,7 @@ static void i2c_slave_handler(i2c_inst_t* i2c, i2c_slave_event_t event) {
 
                if (current->length == 0) {
                   // We have now received the entire message.
-                  queue_try_add(&inputQueue, &current);
+                  NotifyReceived((Packet*)current);
                   current = NULL;
                }
             }
@@ -89,7 +154,7 @@ static void i2c_slave_handler(i2c_inst_t* i2c, i2c_slave_event_t event) {
 
             if (current->pos == current->length) {
                // We have now received the entire message.
-               queue_try_add(&inputQueue, &current);
+               NotifyReceived((Packet*)current);
                current = NULL;
             }
          }
@@ -111,6 +176,7 @@ static void i2c_slave_handler(i2c_inst_t* i2c, i2c_slave_event_t event) {
          Packet* toSend;
          if (queue_try_peek(&outputQueue, &toSend)) {
             if (toSend->state == SendState::None) {
+               TRACE_INSTANT("dequeue", toSend->command);
                i2c_write_raw_blocking(i2c0, &toSend->command, 1);
                toSend->state = SendState::SentCommand;
             } else if (toSend->state == SendState::SentCommand) {
@@ -120,9 +186,10 @@ static void i2c_slave_handler(i2c_inst_t* i2c, i2c_slave_event_t event) {
                } else {
                   // Cleanup, sent a request without a string payload.
                   if (!queue_try_remove(&outputQueue, &toSend)) {
-                     printf("Unable to remove from queue.");
+                     LOG_ERROR("Unable to remove from queue.\n");
                   }
 
+                  NotifySent(toSend);
                   delete toSend;
                }
             } else if (toSend->state == SendState::SentLength) {
@@ -136,6 +203,7 @@ static void i2c_slave_handler(i2c_inst_t* i2c, i2c_slave_event_t event) {
 
                   // Cleanup.
                   queue_try_remove(&outputQueue, &toSend);
+                  NotifySent(toSend);
                   delete toSend;
                }
             }
@@ -156,14 +224,17 @@ static void i2c_slave_handler(i2c_inst_t* i2c, i2c_slave_event_t event) {
 
 bool EnqueueRequest(uint8_t request) {
    if (request == I2C_CLIENT_RESET_QUEUE) {
+      TRACE_INSTANT("queue reset", 0);
       // Clear the output queue.
       Packet* toDelete;
       while (queue_try_remove(&outputQueue, &toDelete)) {
+         ProcessRequestDropped(toDelete->command, toDelete->trackId);
          delete toDelete;
       }
       return true;
    }
 
+   TRACE_INSTANT("enqueue", request);
    Packet* p = new Packet();
    p->length = 0;
    p->command = request;
@@ -173,14 +244,39 @@ bool EnqueueRequest(uint8_t request) {
       delete p;
       return false;
    }
+   UpdateOutputQueueHighWater();
    return true;
 }
 
+size_t OutputQueueSpace() {
+   return OUTPUT_QUEUE_SIZE - queue_get_level(&outputQueue);
+}
+
+void GetStats(Stats* stats) {
+   stats->framesSent = framesSent;
+   stats->bytesSent = bytesSent;
+   stats->framesReceived = framesReceived;
+   stats->bytesReceived = bytesReceived;
+   stats->outputQueueResets = outputQueueResets;
+   stats->outputQueueLevel = queue_get_level(&outputQueue);
+   stats->outputQueueHighWater = outputQueueHighWater;
+   stats->inputQueueLevel = queue_get_level(&inputQueue);
+   stats->inputQueueHighWater = inputQueueHighWater;
+   stats->availInputQueueLevel = queue_get_level(&availInputQueue);
+   stats->availInputQueueLowWater = availInputQueueLowWater;
+}
+
 bool EnqueueRequest(uint8_t request, const char* toSend) {
+   return EnqueueTrackedRequest(request, toSend, 0);
+}
+
+bool EnqueueTrackedRequest(uint8_t request, const char* toSend, uint32_t trackId) {
    if (queue_is_full(&outputQueue))
    {
+      outputQueueResets++;
       EnqueueRequest(I2C_CLIENT_RESET_QUEUE);
    }
+   TRACE_INSTANT("enqueue", request);
    Packet* p = new Packet();
    p->command = request;
    p->length = strlen(toSend);
@@ -188,11 +284,13 @@ bool EnqueueRequest(uint8_t request, const char* toSend) {
    p->lengthBytes[1] = p->length;
    p->pos = 0;
    p->state = SendState::None;
+   p->trackId = trackId;
    memcpy(p->buffer, toSend, p->length);
    if (!queue_try_add(&outputQueue, &p)) {
       delete p;
       return false;
    }
+   UpdateOutputQueueHighWater();
    return true;
 }
 
@@ -216,9 +314,10 @@ void Init(uint sdaPin, uint sclPin, uint addr, uint baudrate) {
    i2c_slave_init(i2c0, addr, &i2c_slave_handler);
 
    // Initalize data structures for synchronizing between I2C interrupt and the main process.
-   queue_init(&outputQueue, sizeof(Packet*), 20);
+   queue_init(&outputQueue, sizeof(Packet*), OUTPUT_QUEUE_SIZE);
    queue_init(&inputQueue, sizeof(zuluide::i2c::client::Packet*), INPUT_BUFFER_COUNT);
    queue_init(&availInputQueue, sizeof(zuluide::i2c::client::Packet*), INPUT_BUFFER_COUNT);
+   queue_init(&sentQueue, sizeof(SentRequest), OUTPUT_QUEUE_SIZE);
 
    for (int i = 0; i < INPUT_BUFFER_COUNT; i++) {
       auto p = new Packet();
@@ -244,8 +343,14 @@ bool TryReceive(Packet** toRecv) {
 }
 
 void ProcessMessages() {
+   SentRequest sent;
+   while (queue_try_remove(&sentQueue, &sent)) {
+      ProcessRequestSent(sent.trackId, sent.sentUs);
+   }
+
    zuluide::i2c::client::Packet* toRecv;
    if (TryReceive(&toRecv)) {
+      TraceScope trace("dispatch", toRecv->command);
       if (Is(toRecv, I2C_SERVER_API_VERSION)) {
          ProcessServerAPIVersion(toRecv->buffer, toRecv->length);
       } else if (Is(toRecv, I2C_SERVER_WIFI_CONNECT)) {
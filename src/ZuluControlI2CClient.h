@@ -34,6 +34,7 @@
 #define FILENAMES_JSON_CACHE_SIZE 51200
 #define BUFFER_LENGTH 8
 #define INPUT_BUFFER_COUNT 20
+#define OUTPUT_QUEUE_SIZE 20
 
 #define I2C_SERVER_API_VERSION  0x1
 #define I2C_SERVER_WIFI_CONNECT 0x2
@@ -94,6 +95,8 @@ typedef struct {
    uint8_t lengthBytes[2];
    uint8_t buffer[MAX_MSG_SIZE];
    SendState state;
+   // Non-zero for requests reported to ProcessRequestSent once sent.
+   uint32_t trackId;
 } Packet;
 
 /**
@@ -106,11 +109,47 @@ bool EnqueueRequest(uint8_t request);
  */
 bool EnqueueRequest(uint8_t request, const char* toSend);
 
+/**
+   Enqueues a request like EnqueueRequest and reports trackId to
+   ProcessRequestSent after the request has been sent to the I2C server.
+ */
+bool EnqueueTrackedRequest(uint8_t request, const char* toSend, uint32_t trackId);
+
 /**
    Resets the request queue
  */
 bool EnqueueReset();
 
+/**
+   Number of requests that can be enqueued before the request queue is full.
+ */
+size_t OutputQueueSpace();
+
+/**
+   Traffic and queue statistics of the client. Frames and bytes include the
+   command and length bytes.
+ */
+typedef struct {
+   uint32_t framesSent;
+   uint32_t bytesSent;
+   uint32_t framesReceived;
+   uint32_t bytesReceived;
+   // Times the output queue was cleared because it was full.
+   uint32_t outputQueueResets;
+   size_t outputQueueLevel;
+   size_t outputQueueHighWater;
+   size_t inputQueueLevel;
+   size_t inputQueueHighWater;
+   size_t availInputQueueLevel;
+   // The free buffer queue starts out full, so its low water mark is kept.
+   size_t availInputQueueLowWater;
+} Stats;
+
+/**
+   Fills stats with the current statistics.
+ */
+void GetStats(Stats* stats);
+
 /**
    Called when the Server API version is received from the server.
 */
@@ -169,6 +208,19 @@ void ProcessStaticIP(const uint8_t* message, size_t length);
  */
 void ProcessIPAddressAck();
 
+/**
+   Called when a request enqueued with EnqueueTrackedRequest has been sent,
+   with the time it was sent in microseconds since boot.
+ */
+void ProcessRequestSent(uint32_t trackId, uint32_t sentUs);
+
+/**
+   Called for every request dropped from the request queue before it was
+   sent, with the trackId given to EnqueueTrackedRequest or 0. It is called
+   by the enqueue that reset the queue, before that returns.
+ */
+void ProcessRequestDropped(uint8_t command, uint32_t trackId);
+
 /**
    Configures the I2C communication parameters.
 */
@@ -0,0 +1,80 @@
+/**
+ * ZuluIDE™ - Copyright (c) 2023 Rabbit Hole Computing™
+ *
+ * ZuluIDE™ firmware is licensed under the GPL version 3 or any later version.
+ *
+ * https://www.gnu.org/licenses/gpl-3.0.html
+ * ----
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ **/
+
+#include "arena.h"
+
+// Keeps every allocation aligned for any record type.
+static const size_t ARENA_ALIGNMENT = sizeof(void *);
+
+Arena::Arena(size_t chunkSize) : chunkSize(chunkSize) {}
+
+Arena::~Arena() {
+   while (head) {
+      Chunk *next = head->next;
+      delete[] (char *)head;
+      head = next;
+   }
+}
+
+char *Arena::Allocate(size_t size) {
+   size_t aligned = (size + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+   if (head == nullptr || head->size - head->pos < aligned) {
+      size_t chunkBytes = (aligned > chunkSize) ? aligned : chunkSize;
+      Chunk *chunk = (Chunk *)new char[sizeof(Chunk) + chunkBytes];
+      chunk->size = chunkBytes;
+      chunk->pos = 0;
+      chunk->next = head;
+      head = chunk;
+      chunks++;
+   }
+
+   char *result = Data(head) + head->pos;
+   head->pos += aligned;
+   used += size;
+   if (used > highWater) {
+      highWater = used;
+   }
+   return result;
+}
+
+void Arena::Reset() {
+   if (head == nullptr) {
+      return;
+   }
+
+   // The oldest chunk is the last in the list, keep it and free the rest.
+   while (head->next) {
+      Chunk *next = head->next;
+      delete[] (char *)head;
+      head = next;
+      chunks--;
+   }
+
+   if (head->size != chunkSize) {
+      // A single oversized record, not worth keeping.
+      delete[] (char *)head;
+      head = nullptr;
+      chunks = 0;
+   } else {
+      head->pos = 0;
+   }
+   used = 0;
+}
@@ -0,0 +1,81 @@
+/**
+ * ZuluIDE™ - Copyright (c) 2023 Rabbit Hole Computing™
+ *
+ * ZuluIDE™ firmware is licensed under the GPL version 3 or any later version.
+ *
+ * https://www.gnu.org/licenses/gpl-3.0.html
+ * ----
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ **/
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+
+/**
+   Bump pointer allocator for records that all share the same lifetime.
+   Memory is taken from the heap in chunks and only given back when the
+   arena is reset, so many small records do not fragment the heap.
+ */
+class Arena {
+  public:
+   explicit Arena(size_t chunkSize);
+   ~Arena();
+   Arena(const Arena &) = delete;
+   Arena &operator=(const Arena &) = delete;
+
+   /**
+      Returns size bytes from the arena. Requests larger than the chunk size
+      get a chunk of their own.
+    */
+   char *Allocate(size_t size);
+
+   /**
+      Releases every allocation at once. The first chunk is kept for reuse.
+    */
+   void Reset();
+
+   /**
+      Bytes handed out since the last reset.
+    */
+   size_t Used() const { return used; }
+
+   /**
+      Largest number of bytes handed out between two resets.
+    */
+   size_t HighWater() const { return highWater; }
+
+   /**
+      Number of chunks currently taken from the heap.
+    */
+   size_t Chunks() const { return chunks; }
+
+  private:
+   struct Chunk {
+      Chunk *next;
+      size_t size;
+      size_t pos;
+   };
+
+   char *Data(Chunk *chunk) { return (char *)(chunk + 1); }
+
+   size_t chunkSize;
+   Chunk *head = nullptr;
+   size_t used = 0;
+   size_t highWater = 0;
+   size_t chunks = 0;
+};
+
+#endif
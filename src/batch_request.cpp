@@ -0,0 +1,150 @@
+/**
+ * ZuluIDE™ - Copyright (c) 2023 Rabbit Hole Computing™
+ *
+ * ZuluIDE™ firmware is licensed under the GPL version 3 or any later version.
+ *
+ * https://www.gnu.org/licenses/gpl-3.0.html
+ * ----
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ **/
+
+#include "batch_request.h"
+#include "url_decode.h"
+
+#include <cstring>
+
+BatchRequest::BatchRequest(size_t maxBody, size_t maxCommands) : maxBody(maxBody), maxCommands(maxCommands) {
+}
+
+bool BatchRequest::Begin(size_t contentLength) {
+   body.clear();
+   entries.clear();
+   this->contentLength = contentLength;
+   received = 0;
+   truncated = false;
+   error = nullptr;
+   return contentLength <= maxBody;
+}
+
+void BatchRequest::Append(const char *data, size_t length) {
+   received += length;
+   if (body.size() + length > maxBody) {
+      length = maxBody - body.size();
+      truncated = true;
+   }
+   body.append(data, length);
+}
+
+bool BatchRequest::Parse() {
+   entries.clear();
+   error = nullptr;
+   if (truncated || contentLength > maxBody) {
+      error = "request too large";
+      return false;
+   }
+
+   if (received != contentLength) {
+      error = "incomplete request";
+      return false;
+   }
+
+   bool valid = true;
+   size_t pos = 0;
+   while (pos < body.size()) {
+      size_t end = body.find_first_of("\n&", pos);
+      if (end == std::string::npos) {
+         end = body.size();
+      }
+      std::string line = body.substr(pos, end - pos);
+      pos = end + 1;
+
+      while (!line.empty() && (line.back() == '\r' || line.back() == ' ')) {
+         line.pop_back();
+      }
+      if (line.empty()) {
+         continue;
+      }
+
+      if (entries.size() == maxCommands) {
+         error = "too many commands";
+         return false;
+      }
+      valid = ParseCommand(&line[0]) && valid;
+   }
+
+   if (entries.empty()) {
+      error = "no commands";
+      return false;
+   }
+
+   if (!valid) {
+      error = "invalid command";
+   }
+   return valid;
+}
+
+bool BatchRequest::ParseCommand(char *text) {
+   Entry entry = {Command::Eject, "", "ok", nullptr, 0};
+   char *value = strchr(text, '=');
+   if (value) {
+      *value++ = 0;
+   }
+
+   if (strcmp(text, "eject") == 0 && value == nullptr) {
+      entry.command = Command::Eject;
+   } else if (strcmp(text, "image") == 0 && value != nullptr && *value != 0) {
+      urldecode(value);
+      entry.command = Command::LoadImage;
+      entry.argument = value;
+   } else {
+      entry.status = "error";
+      entry.error = (strcmp(text, "image") == 0) ? "missing image name" : "unknown command";
+   }
+
+   entries.push_back(entry);
+   return entry.error == nullptr;
+}
+
+void BatchRequest::BuildResult(const char *status, std::string &out) const {
+   out += "{\"status\":\"";
+   out += status;
+   out += "\"";
+   if (error) {
+      out += ",\"error\":\"";
+      out += error;
+      out += "\"";
+   }
+   out += ",\"results\":[";
+   for (size_t i = 0; i < entries.size(); i++) {
+      if (i > 0) {
+         out += ',';
+      }
+      out += '{';
+      if (entries[i].id != 0) {
+         out += "\"id\":";
+         out += std::to_string(entries[i].id);
+         out += ',';
+      }
+      out += "\"status\":\"";
+      out += entries[i].status;
+      out += "\"";
+      if (entries[i].error) {
+         out += ",\"error\":\"";
+         out += entries[i].error;
+         out += "\"";
+      }
+      out += '}';
+   }
+   out += "]}";
+}
@@ -0,0 +1,99 @@
+/**
+ * ZuluIDE™ - Copyright (c) 2023 Rabbit Hole Computing™
+ *
+ * ZuluIDE™ firmware is licensed under the GPL version 3 or any later version.
+ *
+ * https://www.gnu.org/licenses/gpl-3.0.html
+ * ----
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ **/
+
+#ifndef BATCH_REQUEST_H
+#define BATCH_REQUEST_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+   Body of a POST /batch request: a list of commands separated by newlines or
+   '&', each either "eject" or "image=<url encoded filename>". The body is
+   collected as it arrives and parsed once complete, so the commands can be
+   checked before any of them is sent.
+ */
+class BatchRequest {
+  public:
+   enum class Command { Eject, LoadImage };
+
+   struct Entry {
+      Command command;
+      std::string argument;
+      // Outcome reported to the client, set when the entry is parsed and
+      // updated by the caller when it is sent.
+      const char *status;
+      const char *error;
+      // Id the caller tracks the command with once it is sent, or zero.
+      uint32_t id;
+   };
+
+   BatchRequest(size_t maxBody, size_t maxCommands);
+
+   /**
+      Starts a new request with a body of contentLength bytes, dropping the
+      previous body and commands. Returns false if the body is larger than
+      maxBody, in which case Parse fails.
+    */
+   bool Begin(size_t contentLength);
+
+   /**
+      Appends part of the body. Data past maxBody is dropped and fails Parse.
+    */
+   void Append(const char *data, size_t length);
+
+   /**
+      Parses the body into Entries, returning true if every command is valid.
+      Valid entries get a status of "ok", invalid ones "error" with a reason.
+      A body that did not arrive completely, e.g. because the connection was
+      dropped, fails without any entries.
+    */
+   bool Parse();
+
+   /**
+      Reason the whole request was rejected, or nullptr.
+    */
+   const char *Error() const { return error; }
+
+   std::vector<Entry> &Entries() { return entries; }
+
+   /**
+      Appends the JSON result of the request to out, with an overall status
+      and the status of each command in the order they were given.
+    */
+   void BuildResult(const char *status, std::string &out) const;
+
+  private:
+   bool ParseCommand(char *text);
+
+   size_t maxBody;
+   size_t maxCommands;
+   std::string body;
+   size_t contentLength = 0;
+   size_t received = 0;
+   bool truncated = false;
+   const char *error = nullptr;
+   std::vector<Entry> entries;
+};
+
+#endif
@@ -0,0 +1,339 @@
+/**
+ * ZuluIDE™ - Copyright (c) 2023 Rabbit Hole Computing™
+ *
+ * ZuluIDE™ firmware is licensed under the GPL version 3 or any later version.
+ *
+ * https://www.gnu.org/licenses/gpl-3.0.html
+ * ----
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ **/
+
+#include "cbor.h"
+#include "json_scan.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+size_t CborHead(CborType type, uint64_t value, uint8_t *out) {
+   uint8_t major = (uint8_t)type << 5;
+   size_t bytes;
+   if (value < 24) {
+      out[0] = major | (uint8_t)value;
+      return 1;
+   } else if (value <= 0xff) {
+      out[0] = major | 24;
+      bytes = 1;
+   } else if (value <= 0xffff) {
+      out[0] = major | 25;
+      bytes = 2;
+   } else if (value <= 0xffffffff) {
+      out[0] = major | 26;
+      bytes = 4;
+   } else {
+      out[0] = major | 27;
+      bytes = 8;
+   }
+
+   for (size_t i = 0; i < bytes; i++) {
+      out[bytes - i] = (uint8_t)(value >> (8 * i));
+   }
+   return bytes + 1;
+}
+
+void CborAppendHead(std::string &out, CborType type, uint64_t value) {
+   uint8_t head[CBOR_HEAD_MAX_SIZE];
+   size_t length = CborHead(type, value, head);
+   out.append((const char*)head, length);
+}
+
+/**
+   Parses the four hex digits at text, returning -1 if they are not valid.
+ */
+static int32_t ParseHex4(const char *text) {
+   int32_t value = 0;
+   for (int i = 0; i < 4; i++) {
+      char c = text[i];
+      value <<= 4;
+      if (c >= '0' && c <= '9') {
+         value |= c - '0';
+      } else if (c >= 'a' && c <= 'f') {
+         value |= c - 'a' + 10;
+      } else if (c >= 'A' && c <= 'F') {
+         value |= c - 'A' + 10;
+      } else {
+         return -1;
+      }
+   }
+   return value;
+}
+
+/**
+   Stores code point c as UTF-8 at out, if out is not nullptr, and returns its
+   size.
+ */
+static size_t EncodeUtf8(uint32_t c, char *out) {
+   char bytes[4];
+   size_t length;
+   if (c < 0x80) {
+      bytes[0] = c;
+      length = 1;
+   } else if (c < 0x800) {
+      bytes[0] = 0xc0 | (c >> 6);
+      bytes[1] = 0x80 | (c & 0x3f);
+      length = 2;
+   } else if (c < 0x10000) {
+      bytes[0] = 0xe0 | (c >> 12);
+      bytes[1] = 0x80 | ((c >> 6) & 0x3f);
+      bytes[2] = 0x80 | (c & 0x3f);
+      length = 3;
+   } else {
+      bytes[0] = 0xf0 | (c >> 18);
+      bytes[1] = 0x80 | ((c >> 12) & 0x3f);
+      bytes[2] = 0x80 | ((c >> 6) & 0x3f);
+      bytes[3] = 0x80 | (c & 0x3f);
+      length = 4;
+   }
+
+   if (out) {
+      memcpy(out, bytes, length);
+   }
+   return length;
+}
+
+size_t DecodeJsonString(const char *text, size_t length, char *out) {
+   size_t size = 0;
+   size_t i = 0;
+   while (i < length) {
+      char c = text[i];
+      if (c != '\\' || i + 1 == length) {
+         if (out) {
+            out[size] = c;
+         }
+         size++;
+         i++;
+         continue;
+      }
+
+      char simple = 0;
+      switch (text[i + 1]) {
+      case '"': simple = '"'; break;
+      case '\\': simple = '\\'; break;
+      case '/': simple = '/'; break;
+      case 'b': simple = '\b'; break;
+      case 'f': simple = '\f'; break;
+      case 'n': simple = '\n'; break;
+      case 'r': simple = '\r'; break;
+      case 't': simple = '\t'; break;
+      }
+      if (simple != 0) {
+         if (out) {
+            out[size] = simple;
+         }
+         size++;
+         i += 2;
+         continue;
+      }
+
+      int32_t code = (text[i + 1] == 'u' && i + 6 <= length) ? ParseHex4(text + i + 2) : -1;
+      if (code < 0) {
+         // Not a valid escape, keep the backslash.
+         if (out) {
+            out[size] = c;
+         }
+         size++;
+         i++;
+         continue;
+      }
+      i += 6;
+
+      if (code >= 0xd800 && code < 0xdc00 && i + 6 <= length && text[i] == '\\' && text[i + 1] == 'u') {
+         int32_t low = ParseHex4(text + i + 2);
+         if (low >= 0xdc00 && low < 0xe000) {
+            code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+            i += 6;
+         }
+      }
+      size += EncodeUtf8(code, out ? out + size : nullptr);
+   }
+   return size;
+}
+
+/**
+   Counts the members of the object or array whose opening bracket is at p.
+ */
+static bool CountItems(const char *p, const char *end, uint64_t *count) {
+   char close = (*p == '{') ? '}' : ']';
+   *count = 0;
+   p = JsonSkipSpace(p + 1, end);
+   while (p < end && *p != close) {
+      p = JsonSkipValue(p, end);
+      if (p == nullptr) {
+         return false;
+      }
+      // Members of objects are a name, a colon and a value.
+      if (close == '}' && p < end && *p == ':') {
+         p = JsonSkipValue(JsonSkipSpace(p + 1, end), end);
+         if (p == nullptr) {
+            return false;
+         }
+      }
+      (*count)++;
+      p = JsonSkipSpace(p, end);
+      if (p < end && *p == ',') {
+         p = JsonSkipSpace(p + 1, end);
+      }
+   }
+   return p < end;
+}
+
+static const char *EncodeValue(const char *p, const char *end, std::string &out);
+
+/**
+   Encodes the JSON string at p and returns its end.
+ */
+static const char *EncodeString(const char *p, const char *end, std::string &out) {
+   const char *stringEnd = JsonSkipString(p, end);
+   if (stringEnd == nullptr) {
+      return nullptr;
+   }
+   size_t length = DecodeJsonString(p + 1, stringEnd - p - 2, nullptr);
+   CborAppendHead(out, CborType::Text, length);
+   size_t start = out.size();
+   out.resize(start + length);
+   DecodeJsonString(p + 1, stringEnd - p - 2, &out[start]);
+   return stringEnd;
+}
+
+/**
+   Encodes the JSON number at p and returns its end.
+ */
+static const char *EncodeNumber(const char *p, const char *end, std::string &out) {
+   char number[32];
+   size_t length = 0;
+   bool integer = true;
+   while (p + length < end && length < sizeof(number) - 1 && p[length] && strchr("+-0123456789.eE", p[length])) {
+      if (p[length] == '.' || p[length] == 'e' || p[length] == 'E') {
+         integer = false;
+      }
+      number[length] = p[length];
+      length++;
+   }
+   number[length] = 0;
+
+   char *numberEnd;
+   if (integer) {
+      bool negative = (number[0] == '-');
+      const char *digits = number + (negative ? 1 : 0);
+      if (*digits < '0' || *digits > '9') {
+         return nullptr;
+      }
+      errno = 0;
+      uint64_t value = strtoull(digits, &numberEnd, 10);
+      if (errno == ERANGE) {
+         // -2^64 is the only integer beyond strtoull that CBOR can hold.
+         if (!negative || numberEnd - digits != 20 || strncmp(digits, "18446744073709551616", 20) != 0) {
+            return nullptr;
+         }
+         CborAppendHead(out, CborType::Negative, UINT64_MAX);
+      } else if (negative && value > 0) {
+         CborAppendHead(out, CborType::Negative, value - 1);
+      } else {
+         // -0 is the same integer as 0.
+         CborAppendHead(out, CborType::Unsigned, value);
+      }
+   } else {
+      double value = strtod(number, &numberEnd);
+      if (numberEnd == number) {
+         return nullptr;
+      }
+      uint64_t bits;
+      memcpy(&bits, &value, sizeof(bits));
+      out += (char)0xfb;
+      for (int i = 7; i >= 0; i--) {
+         out += (char)(bits >> (8 * i));
+      }
+   }
+   return p + (numberEnd - number);
+}
+
+/**
+   Encodes the JSON object or array at p and returns its end.
+ */
+static const char *EncodeContainer(const char *p, const char *end, std::string &out) {
+   bool object = (*p == '{');
+   char close = object ? '}' : ']';
+   uint64_t count;
+   if (!CountItems(p, end, &count)) {
+      return nullptr;
+   }
+   CborAppendHead(out, object ? CborType::Map : CborType::Array, count);
+
+   p = JsonSkipSpace(p + 1, end);
+   while (p != nullptr && p < end && *p != close) {
+      if (object) {
+         if (*p != '"') {
+            return nullptr;
+         }
+         p = JsonSkipSpace(EncodeString(p, end, out), end);
+         if (p == nullptr || p == end || *p != ':') {
+            return nullptr;
+         }
+         p = JsonSkipSpace(p + 1, end);
+      }
+      p = EncodeValue(p, end, out);
+      if (p == nullptr) {
+         return nullptr;
+      }
+      p = JsonSkipSpace(p, end);
+      if (p < end && *p == ',') {
+         p = JsonSkipSpace(p + 1, end);
+      } else if (p < end && *p != close) {
+         return nullptr;
+      }
+   }
+   return (p != nullptr && p < end) ? p + 1 : nullptr;
+}
+
+/**
+   Encodes the JSON value at p and returns its end, or nullptr if it is not
+   valid.
+ */
+static const char *EncodeValue(const char *p, const char *end, std::string &out) {
+   if (p == nullptr || p == end) {
+      return nullptr;
+   }
+
+   if (*p == '{' || *p == '[') {
+      return EncodeContainer(p, end, out);
+   } else if (*p == '"') {
+      return EncodeString(p, end, out);
+   } else if ((size_t)(end - p) >= 4 && memcmp(p, "true", 4) == 0) {
+      out += (char)0xf5;
+      return p + 4;
+   } else if ((size_t)(end - p) >= 5 && memcmp(p, "false", 5) == 0) {
+      out += (char)0xf4;
+      return p + 5;
+   } else if ((size_t)(end - p) >= 4 && memcmp(p, "null", 4) == 0) {
+      out += (char)0xf6;
+      return p + 4;
+   }
+   return EncodeNumber(p, end, out);
+}
+
+bool JsonToCbor(const char *json, size_t length, std::string &out) {
+   const char *end = json + length;
+   const char *p = EncodeValue(JsonSkipSpace(json, end), end, out);
+   return p != nullptr && JsonSkipSpace(p, end) == end;
+}
@@ -0,0 +1,66 @@
+/**
+ * ZuluIDE™ - Copyright (c) 2023 Rabbit Hole Computing™
+ *
+ * ZuluIDE™ firmware is licensed under the GPL version 3 or any later version.
+ *
+ * https://www.gnu.org/licenses/gpl-3.0.html
+ * ----
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ **/
+
+#ifndef CBOR_H
+#define CBOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+   Major types of CBOR data items (RFC 8949).
+ */
+enum class CborType : uint8_t { Unsigned = 0, Negative = 1, Bytes = 2, Text = 3, Array = 4, Map = 5, Tag = 6, Simple = 7 };
+
+/**
+   Largest number of bytes written by CborHead.
+ */
+#define CBOR_HEAD_MAX_SIZE 9
+
+/**
+   Writes the head of a data item of the given type with argument value, i.e.
+   the length of a string, array or map, into out and returns its size.
+ */
+size_t CborHead(CborType type, uint64_t value, uint8_t *out);
+
+/**
+   Appends the head of a data item to out.
+ */
+void CborAppendHead(std::string &out, CborType type, uint64_t value);
+
+/**
+   Decodes the escapes of the length bytes of JSON string content at text,
+   without the quotes, into UTF-8 stored at out and returns the decoded size.
+   out may be nullptr to only compute the size. Invalid escapes are copied
+   as they are.
+ */
+size_t DecodeJsonString(const char *text, size_t length, char *out);
+
+/**
+   Appends the CBOR encoding of the JSON document of length bytes at json to
+   out. Arrays, maps and strings are encoded with definite lengths, integers
+   as integers and other numbers as doubles. Returns false if json is not
+   valid JSON, in which case out holds a partial encoding.
+ */
+bool JsonToCbor(const char *json, size_t length, std::string &out);
+
+#endif
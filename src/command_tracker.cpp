@@ -0,0 +1,166 @@
+/**
+ * ZuluIDE™ - Copyright (c) 2023 Rabbit Hole Computing™
+ *
+ * ZuluIDE™ firmware is licensed under the GPL version 3 or any later version.
+ *
+ * https://www.gnu.org/licenses/gpl-3.0.html
+ * ----
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ **/
+
+#include "command_tracker.h"
+
+#include <cstdio>
+
+CommandTracker::CommandTracker(size_t capacity, uint32_t timeoutUs) : commands(capacity), timeoutUs(timeoutUs) {
+   for (auto &command : commands) {
+      command.id = 0;
+   }
+}
+
+uint32_t CommandTracker::Add(Kind kind, const char *image, uint32_t nowUs) {
+   if (++lastId == 0) {
+      lastId = 1;
+   }
+
+   Command &command = commands[lastId % commands.size()];
+   command.id = lastId;
+   command.kind = kind;
+   command.state = State::Queued;
+   command.image = (kind == Kind::LoadImage && image) ? image : "";
+   command.queuedUs = nowUs;
+   command.sentUs = 0;
+   command.reflectedUs = 0;
+   return lastId;
+}
+
+void CommandTracker::Failed(uint32_t id) {
+   Command *command = Find(id);
+   if (command) {
+      command->state = State::Failed;
+   }
+}
+
+void CommandTracker::Sent(uint32_t id, uint32_t nowUs) {
+   Command *command = Find(id);
+   if (command && command->state == State::Queued) {
+      command->state = State::Sent;
+      command->sentUs = nowUs;
+      command->mountedAtSent = mounted;
+      // Without an earlier status there is nothing to compare with.
+      command->changed = !statusReceived;
+   }
+}
+
+void CommandTracker::StatusReceived(const char *image, uint32_t nowUs) {
+   mounted = image ? image : "";
+   statusReceived = true;
+
+   // An older command still waiting for its result may change the image
+   // first, so only the oldest sent command can be a no-op.
+   uint32_t oldestSent = 0;
+   for (auto &command : commands) {
+      if (command.id != 0 && command.state == State::Sent && (oldestSent == 0 || command.id < oldestSent)) {
+         oldestSent = command.id;
+      }
+   }
+
+   // Find the latest sent command the status shows the result of.
+   uint32_t reflected = 0;
+   for (auto &command : commands) {
+      if (command.id == 0 || command.state != State::Sent || (int32_t)(nowUs - command.sentUs) <= 0) {
+         continue;
+      }
+
+      if (mounted != command.mountedAtSent) {
+         command.changed = true;
+      }
+
+      bool matches = (command.kind == Kind::Eject) ? (image == nullptr) : (image != nullptr && command.image == image);
+      if (!matches) {
+         continue;
+      }
+
+      if (!command.changed) {
+         if (command.id == oldestSent) {
+            // The status shows what was already mounted when the command was sent.
+            command.state = State::NoOp;
+         }
+      } else if (command.id > reflected) {
+         reflected = command.id;
+      }
+   }
+
+   if (reflected == 0) {
+      return;
+   }
+
+   for (auto &command : commands) {
+      if (command.id == reflected) {
+         command.state = State::Reflected;
+         command.reflectedUs = nowUs;
+      } else if (command.id != 0 && command.id < reflected && command.state == State::Sent) {
+         command.state = State::Superseded;
+      }
+   }
+}
+
+void CommandTracker::Expire(uint32_t nowUs) {
+   for (auto &command : commands) {
+      if (command.id == 0) {
+         continue;
+      }
+
+      if ((command.state == State::Queued && (uint32_t)(nowUs - command.queuedUs) > timeoutUs) ||
+          (command.state == State::Sent && (uint32_t)(nowUs - command.sentUs) > timeoutUs)) {
+         command.state = State::TimedOut;
+      }
+   }
+}
+
+void CommandTracker::Describe(uint32_t id, std::string &out) const {
+   char buffer[160];
+   const Command *command = Find(id);
+   if (command == nullptr) {
+      snprintf(buffer, sizeof(buffer), "{\"id\":%lu,\"state\":\"unknown\"}", (unsigned long)id);
+      out += buffer;
+      return;
+   }
+
+   static const char *const states[] = {"queued", "sent", "reflected", "superseded", "failed", "timeout", "noop"};
+   int length = snprintf(buffer, sizeof(buffer), "{\"id\":%lu,\"command\":\"%s\",\"state\":\"%s\"",
+                         (unsigned long)id, (command->kind == Kind::Eject) ? "eject" : "image",
+                         states[(int)command->state]);
+   if (command->state == State::Sent || command->state == State::Reflected || command->state == State::Superseded ||
+       command->state == State::NoOp) {
+      length += snprintf(buffer + length, sizeof(buffer) - length, ",\"queueLatencyUs\":%lu",
+                         (unsigned long)(command->sentUs - command->queuedUs));
+   }
+   if (command->state == State::Reflected) {
+      length += snprintf(buffer + length, sizeof(buffer) - length, ",\"statusLatencyUs\":%lu,\"totalLatencyUs\":%lu",
+                         (unsigned long)(command->reflectedUs - command->sentUs),
+                         (unsigned long)(command->reflectedUs - command->queuedUs));
+   }
+   out += buffer;
+   out += '}';
+}
+
+CommandTracker::Command *CommandTracker::Find(uint32_t id) {
+   Command &command = commands[id % commands.size()];
+   return (id != 0 && command.id == id) ? &command : nullptr;
+}
+
+const CommandTracker::Command *CommandTracker::Find(uint32_t id) const {
+   return const_cast<CommandTracker*>(this)->Find(id);
+}
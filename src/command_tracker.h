@@ -0,0 +1,118 @@
+/**
+ * ZuluIDE™ - Copyright (c) 2023 Rabbit Hole Computing™
+ *
+ * ZuluIDE™ firmware is licensed under the GPL version 3 or any later version.
+ *
+ * https://www.gnu.org/licenses/gpl-3.0.html
+ * ----
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ **/
+
+#ifndef COMMAND_TRACKER_H
+#define COMMAND_TRACKER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+   Follows load image and eject commands from the request queue, over the I2C
+   bus and into the system status, recording when each stage was reached.
+   Commands are identified by ids handed out by Add; only the latest commands
+   are kept, older ids are reported as unknown.
+ */
+class CommandTracker {
+  public:
+   enum class Kind { LoadImage, Eject };
+
+   enum class State {
+      Queued,      // Waiting in the request queue.
+      Sent,        // Sent to the ZuluIDE, which has not reported it in its status yet.
+      Reflected,   // The system status changed to show the result of the command.
+      Superseded,  // A later command was reflected first.
+      Failed,      // Could not be queued or was dropped from the queue.
+      TimedOut,    // Not sent or not reflected within the timeout.
+      NoOp         // The status already showed the result when the command was sent.
+   };
+
+   /**
+      Commands queued or sent for longer than timeoutUs are given up on.
+    */
+   CommandTracker(size_t capacity, uint32_t timeoutUs);
+
+   /**
+      Starts tracking a command queued at nowUs and returns its id, which is
+      never zero. image is the image to load and ignored for ejects.
+    */
+   uint32_t Add(Kind kind, const char *image, uint32_t nowUs);
+
+   /**
+      Marks command id as not queued or dropped before it was sent.
+    */
+   void Failed(uint32_t id);
+
+   /**
+      Marks command id as sent over I2C at nowUs.
+    */
+   void Sent(uint32_t id, uint32_t nowUs);
+
+   /**
+      Checks the sent commands against a system status received at nowUs
+      that shows image as mounted, or no image if image is nullptr. Only
+      statuses received after a command was sent count for it, and it is
+      reflected once such a status shows its result after showing something
+      else than when it was sent.
+    */
+   void StatusReceived(const char *image, uint32_t nowUs);
+
+   /**
+      Marks the commands that have been queued or sent for longer than the
+      timeout at nowUs as timed out.
+    */
+   void Expire(uint32_t nowUs);
+
+   /**
+      Appends a JSON object describing command id to out, with its state and
+      the microseconds spent in each stage it has completed.
+    */
+   void Describe(uint32_t id, std::string &out) const;
+
+  private:
+   struct Command {
+      uint32_t id;
+      Kind kind;
+      State state;
+      std::string image;
+      uint32_t queuedUs;
+      uint32_t sentUs;
+      uint32_t reflectedUs;
+      // Image mounted when the command was sent, empty for none.
+      std::string mountedAtSent;
+      // A status received after sending differed from mountedAtSent.
+      bool changed;
+   };
+
+   Command *Find(uint32_t id);
+   const Command *Find(uint32_t id) const;
+
+   std::vector<Command> commands;
+   uint32_t timeoutUs;
+   uint32_t lastId = 0;
+   // Image shown by the last status, empty for none, once a status was received.
+   std::string mounted;
+   bool statusReceived = false;
+};
+
+#endif
@@ -0,0 +1,129 @@
+/**
+ * ZuluIDE™ - Copyright (c) 2023 Rabbit Hole Computing™
+ *
+ * ZuluIDE™ firmware is licensed under the GPL version 3 or any later version.
+ *
+ * https://www.gnu.org/licenses/gpl-3.0.html
+ * ----
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ **/
+
+#include "filename_index.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+static int lower(char c) {
+   return tolower((unsigned char)c);
+}
+
+void FilenameIndex::Build(const char *base, const uint32_t *offsets, const uint16_t *lengths, size_t count) {
+   this->base = base;
+   this->offsets = offsets;
+   this->lengths = lengths;
+
+   sorted.resize(count);
+   for (size_t i = 0; i < count; i++) {
+      sorted[i] = i;
+   }
+
+   std::sort(sorted.begin(), sorted.end(), [this](uint32_t a, uint32_t b) {
+      const char *nameA = this->base + this->offsets[a];
+      const char *nameB = this->base + this->offsets[b];
+      size_t length = std::min(this->lengths[a], this->lengths[b]);
+      for (size_t i = 0; i < length; i++) {
+         int diff = lower(nameA[i]) - lower(nameB[i]);
+         if (diff != 0) {
+            return diff < 0;
+         }
+      }
+      return this->lengths[a] < this->lengths[b];
+   });
+}
+
+void FilenameIndex::Clear() {
+   sorted.clear();
+   base = nullptr;
+   offsets = nullptr;
+   lengths = nullptr;
+}
+
+/**
+   Compares the start of a name with query, returning zero when the name starts with query.
+ */
+int FilenameIndex::ComparePrefix(uint32_t name, const char *query, size_t queryLength) const {
+   const char *text = base + offsets[name];
+   size_t length = std::min((size_t)lengths[name], queryLength);
+   for (size_t i = 0; i < length; i++) {
+      int diff = lower(text[i]) - lower(query[i]);
+      if (diff != 0) {
+         return diff;
+      }
+   }
+   return (lengths[name] < queryLength) ? -1 : 0;
+}
+
+bool FilenameIndex::Contains(uint32_t name, const char *query, size_t queryLength) const {
+   const char *text = base + offsets[name];
+   size_t length = lengths[name];
+   for (size_t start = 0; start + queryLength <= length; start++) {
+      size_t i = 0;
+      while (i < queryLength && lower(text[start + i]) == lower(query[i])) {
+         i++;
+      }
+      if (i == queryLength) {
+         return true;
+      }
+   }
+   return false;
+}
+
+size_t FilenameIndex::Search(const char *query, size_t limit, std::vector<uint32_t> &results) const {
+   size_t queryLength = strlen(query);
+   size_t total = 0;
+   results.clear();
+
+   // Names starting with the query are a contiguous run in the sorted order.
+   auto first = std::lower_bound(sorted.begin(), sorted.end(), query, [this, queryLength](uint32_t name, const char *q) {
+      return ComparePrefix(name, q, queryLength) < 0;
+   });
+   auto last = first;
+   while (last != sorted.end() && ComparePrefix(*last, query, queryLength) == 0) {
+      if (results.size() < limit) {
+         results.push_back(*last);
+      }
+      last++;
+      total++;
+   }
+
+   for (auto it = sorted.begin(); it != sorted.end(); it++) {
+      if (it == first) {
+         // Skip the prefix matches found above.
+         it = last;
+         if (it == sorted.end()) {
+            break;
+         }
+      }
+
+      if (Contains(*it, query, queryLength)) {
+         if (results.size() < limit) {
+            results.push_back(*it);
+         }
+         total++;
+      }
+   }
+
+   return total;
+}
@@ -0,0 +1,65 @@
+/**
+ * ZuluIDE™ - Copyright (c) 2023 Rabbit Hole Computing™
+ *
+ * ZuluIDE™ firmware is licensed under the GPL version 3 or any later version.
+ *
+ * https://www.gnu.org/licenses/gpl-3.0.html
+ * ----
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ **/
+
+#ifndef FILENAME_INDEX_H
+#define FILENAME_INDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+   Case-insensitive sorted index over filenames that are stored in an external
+   buffer. The index only keeps the order of the names, so the buffer, offsets
+   and lengths passed to Build must stay unchanged until the next Build or Clear.
+ */
+class FilenameIndex {
+  public:
+   /**
+      Rebuilds the index over count names, where name i is the lengths[i] bytes
+      stored at base + offsets[i].
+    */
+   void Build(const char *base, const uint32_t *offsets, const uint16_t *lengths, size_t count);
+
+   /**
+      Drops the index, e.g. when the underlying names are about to change.
+    */
+   void Clear();
+
+   /**
+      Finds names that contain query, ignoring case. Names starting with query
+      come first, followed by names containing it elsewhere, each group in
+      sorted order. Up to limit name numbers are stored in results and the
+      total number of matches is returned.
+    */
+   size_t Search(const char *query, size_t limit, std::vector<uint32_t> &results) const;
+
+  private:
+   int ComparePrefix(uint32_t name, const char *query, size_t queryLength) const;
+   bool Contains(uint32_t name, const char *query, size_t queryLength) const;
+
+   const char *base = nullptr;
+   const uint32_t *offsets = nullptr;
+   const uint16_t *lengths = nullptr;
+   std::vector<uint32_t> sorted;
+};
+
+#endif
@@ -22,7 +22,9 @@
 #include "fw_upgrade.h"
 #include <hardware/sync.h>
 #include <hardware/flash.h>
+#include <hardware/timer.h>
 #include <hardware/structs/scb.h>
+#include <hardware/watchdog.h>
 #include <pico/multicore.h>
 #include "lwip/apps/fs.h"
 #include "lwip/apps/httpd.h"
@@ -30,8 +32,17 @@
 #include "lwip/mem.h"
 #include "lwip/opt.h"
 #include "boot/uf2.h"
+#include "log.h"
+#include "lzss_decoder.h"
+#include "sha256.h"
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
+#if PICO_RP2350
+#include <pico/sha256.h>
+#endif
+
 #if PICO_RP2350
 #define UF2_FAMILY_ID RP2350_ARM_S_FAMILY_ID
 #else
@@ -44,26 +55,550 @@
 // Uploaded data is temporarily stored at 1 MB offset from flash start.
 // It is only flashed to main location after the whole image is successfully received.
 #define FW_UPGRADE_TEMP_OFFSET (1024 * 1024)
+// Address of the start of flash in UF2 blocks. Flash is read through XIP_BASE,
+// which is the same address on the device.
 #define FW_UPGRADE_TARGET_ADDR 0x10000000
 
 // 4kB erase blocks are large enough for all flash chips
 #define FLASH_SECTOR_ERASE_SIZE 4096u
 
+// Received data that is staged but not programmed yet is acknowledged at the
+// latest when this much of it has accumulated. A universal binary can leave a
+// sector incomplete while the blocks for the other family arrive.
+#define FW_UPGRADE_WND_HOLD (TCP_WND / 2)
+
+// The running firmware a patch applies to is hashed in step with the upload,
+// at least this much for each part of the upload received
+#define FW_UPGRADE_BASE_HASH_SLICE (16 * 1024)
+
+// Number of sectors in the temporary area
+#define FW_UPGRADE_TEMP_SECTORS (FW_UPGRADE_TEMP_OFFSET / FLASH_SECTOR_ERASE_SIZE)
+
+// The last sector of the 2 MB flash keeps the progress of an upload, so that an
+// upload interrupted by a dropped connection can be resumed instead of restarted.
+// The image must fit below it in the temporary area.
+#define FW_UPGRADE_PROGRESS_OFFSET (2 * FW_UPGRADE_TEMP_OFFSET - FLASH_SECTOR_ERASE_SIZE)
+#define FW_UPGRADE_MAX_SIZE (FW_UPGRADE_TEMP_OFFSET - FLASH_SECTOR_ERASE_SIZE)
+#define FW_UPGRADE_PROGRESS_MAGIC 0x3250465Au
+
+// The progress sector holds a header page, a bitmap of the blocks programmed to the
+// temporary area and a log of file offsets the upload can be resumed from.
+// Programmed blocks clear their bit and checkpoints are appended to the log, so
+// progress is saved without erasing the sector again.
+#define FW_UPGRADE_BITMAP_BYTES (FW_UPGRADE_TEMP_OFFSET / UF2_PAYLOAD_SIZE / 8)
+#define FW_UPGRADE_PROGRESS_BITMAP (FW_UPGRADE_PROGRESS_OFFSET + UF2_PAYLOAD_SIZE)
+#define FW_UPGRADE_PROGRESS_LOG (FW_UPGRADE_PROGRESS_BITMAP + FW_UPGRADE_BITMAP_BYTES)
+#define FW_UPGRADE_PROGRESS_LOG_ENTRIES \
+    ((FW_UPGRADE_PROGRESS_OFFSET + FLASH_SECTOR_ERASE_SIZE - FW_UPGRADE_PROGRESS_LOG) / sizeof(fwupgrade_checkpoint))
+
+// Entry of the checkpoint log: an offset the upload can be resumed from and the
+// state of the hash of the uploaded file up to it. The entry size is a power of
+// two so that no entry crosses a flash page.
+typedef struct {
+    uint32_t file_offset;
+    uint32_t hash_state[SHA256_STATE_WORDS];
+    uint32_t reserved[7];
+} fwupgrade_checkpoint;
+static_assert(UF2_PAYLOAD_SIZE % sizeof(fwupgrade_checkpoint) == 0, "Checkpoints must not cross pages");
+
+// The result of a commit is handed over the reboot in watchdog scratch registers 0 to 3.
+// Registers 4 to 7 are used by the SDK for watchdog reboots.
+#define FW_UPGRADE_COMMIT_MAGIC 0x434D5746u
+#define FW_UPGRADE_COMMIT_FULL 0x80000000u
+
+typedef struct {
+    uint32_t magic;
+    uint32_t family_id;
+    uint32_t num_blocks;
+    char fwid[FW_UPGRADE_FWID_SIZE];
+} fwupgrade_progress_header;
+
+// Uploads are UF2 files, files compressed by tools/compress_uf2.py or patches
+// made by tools/make_delta.py, recognized from their first bytes
+#define FW_UPGRADE_COMPRESSED_MAGIC "ZFW1"
+#define FW_UPGRADE_DELTA_MAGIC "ZDP1"
+#define FW_UPGRADE_MAGIC_SIZE 4
+
+typedef enum {
+    UPLOAD_UNKNOWN,
+    UPLOAD_UF2,
+    UPLOAD_COMPRESSED,
+    UPLOAD_DELTA
+} upload_format;
+
+// A patch starts with the family ID, the size and SHA-256 of the running
+// firmware it applies to and the size of the new image, followed by
+// operations that produce the new image from the start
+typedef struct __attribute__((packed)) {
+    uint32_t family_id;
+    uint32_t base_size;
+    uint8_t base_sha256[SHA256_DIGEST_SIZE];
+    uint32_t image_size;
+} fwupgrade_delta_header;
+
+// Copy a range of the running firmware, followed by its offset and length
+#define FW_UPGRADE_DELTA_COPY 1
+// Insert data, followed by its length and the data
+#define FW_UPGRADE_DELTA_INSERT 2
+
 static struct {
+    upload_format format;
+
+    // Received bytes the TCP window has not been opened for, and bytes of the
+    // request still to come
+    uint32_t unacked;
+    uint32_t content_remain;
+
+    // Magic, section header of a compressed upload or header of a patch or
+    // its operations being collected
+    uint8_t header[sizeof(fwupgrade_delta_header)];
+    size_t header_size;
+    // Compressed data left in the current section, which is decompressed
+    // only if it holds the blocks for our family
+    uint32_t section_remain;
+    bool section_ours;
+    LzssDecoder decoder;
+
+    // Patch being applied: the operation in progress, the input bytes of an
+    // insert left, and the image page being produced
+    bool delta_started;
+    uint32_t delta_base_size;
+    uint32_t delta_num_blocks;
+    uint8_t delta_op;
+    uint32_t delta_remain;
+    uint32_t delta_produced;
+    uint8_t delta_page[UF2_PAYLOAD_SIZE];
+    // Hash of the running firmware, compared to the base of the patch once
+    // delta_base_size bytes are hashed
+    Sha256 delta_base_hash;
+    uint32_t delta_base_hashed;
+    bool delta_base_verified;
+    uint8_t delta_base_sha256[SHA256_DIGEST_SIZE];
+
     size_t block_size;
     uf2_block block;
     uint32_t blocks_received;
     uint32_t num_blocks;
+
+    // Offset in the uploaded file of the next byte to process
+    uint32_t file_offset;
+
+    // Identity of the image given by the client. Progress is only saved when it is set.
+    char fwid[FW_UPGRADE_FWID_SIZE];
+    // The progress sector has a header for this upload
+    bool progress_started;
+    uint32_t progress_entries;
+    // Offsets the upload has reached are added to the log of the progress sector
+    bool log_checkpoints;
+    // A checkpoint is saved once the current block has been hashed
+    bool checkpoint_due;
+
+    // Hash of the blocks of the uploaded file, checked against the digest given
+    // as ?sha256=<hex> before the image is committed. It is not valid when the
+    // upload did not start at the beginning of the file or at a checkpoint.
+    Sha256 hash;
+#if PICO_RP2350
+    pico_sha256_state_t hw_hash;
+    bool hw_hash_active;
+#endif
+    bool hash_valid;
+    bool verify_digest;
+    uint8_t expected_digest[SHA256_DIGEST_SIZE];
+
+    // Bit for each block of the temporary area that has been programmed
+    uint32_t received[FW_UPGRADE_BITMAP_BYTES / 4];
+
+    // Bit for each sector of the temporary area that has been erased for this upload.
+    // Sectors are erased just before their first block is programmed, so that the
+    // erase time is spread over the upload instead of stalling it at the start.
+    uint32_t erased[FW_UPGRADE_TEMP_SECTORS / 32];
+
+    // Blocks of one sector of the temporary area collected before they are
+    // programmed in one operation. Bit i of stage_pages is set when page i of
+    // stage holds a block.
+    uint32_t stage_sector;
+    uint16_t stage_pages;
+    uint8_t stage[FLASH_SECTOR_ERASE_SIZE];
+
+    // Rewrite every sector holding blocks, instead of only those that differ
+    // from the running firmware
+    bool full_commit;
+
+    fwupgrade_stats stats;
 } g_fwup_state;
 
+static fwupgrade_commit_result g_fwup_commit_result;
+
+// Reason the last upload was rejected, or NULL if it was accepted or is in progress
+static const char *g_fwup_error = "no upload";
+
+const fwupgrade_stats *fwupgrade_get_stats()
+{
+    return &g_fwup_state.stats;
+}
+
+void fwupgrade_init()
+{
+    if (watchdog_hw->scratch[0] != FW_UPGRADE_COMMIT_MAGIC)
+    {
+        return;
+    }
+
+    fwupgrade_commit_result *result = &g_fwup_commit_result;
+    result->valid = true;
+    result->full = (watchdog_hw->scratch[1] & FW_UPGRADE_COMMIT_FULL) != 0;
+    result->sectors_rewritten = watchdog_hw->scratch[1] & ~FW_UPGRADE_COMMIT_FULL;
+    result->sectors_total = watchdog_hw->scratch[2];
+    result->duration_us = watchdog_hw->scratch[3];
+    watchdog_hw->scratch[0] = 0;
+
+    LOG_INFO("Firmware upgrade rewrote %lu of %lu sectors in %lu us\n",
+        result->sectors_rewritten, result->sectors_total, result->duration_us);
+}
+
+const fwupgrade_commit_result *fwupgrade_get_commit_result()
+{
+    return &g_fwup_commit_result;
+}
+
+// Record why the upload was rejected, keeping the first reason
+static void set_error(const char *error)
+{
+    if (!g_fwup_error)
+    {
+        g_fwup_error = error;
+    }
+}
+
+int fwupgrade_result_json(char *buf, size_t size)
+{
+    if (!g_fwup_error)
+    {
+        return snprintf(buf, size, "{\"status\":\"ok\"}");
+    }
+    return snprintf(buf, size, "{\"status\":\"error\",\"error\":\"%s\"}", g_fwup_error);
+}
+
+// Record the length of a window with interrupts disabled
+static void note_irq_off(uint32_t start_us)
+{
+    uint32_t duration = time_us_32() - start_us;
+    if (duration > g_fwup_state.stats.max_irq_off_us)
+    {
+        g_fwup_state.stats.max_irq_off_us = duration;
+    }
+}
+
+// The uploaded file is hashed as it arrives. The RP2350 hashes in hardware, but
+// the hash state of the hardware cannot be loaded, so a resumed upload continues
+// in software.
+static void hash_start(const uint32_t *state, uint32_t length)
+{
+#if PICO_RP2350
+    if (g_fwup_state.hw_hash_active)
+    {
+        pico_sha256_cleanup(&g_fwup_state.hw_hash);
+        g_fwup_state.hw_hash_active = false;
+    }
+
+    if (!state && pico_sha256_try_start(&g_fwup_state.hw_hash, SHA256_BIG_ENDIAN, false) == PICO_OK)
+    {
+        g_fwup_state.hw_hash_active = true;
+        return;
+    }
+#endif
+
+    if (state)
+    {
+        g_fwup_state.hash.Resume(state, length);
+    }
+    else
+    {
+        g_fwup_state.hash.Reset();
+    }
+}
+
+static void hash_update(const uint8_t *data, size_t len)
+{
+#if PICO_RP2350
+    if (g_fwup_state.hw_hash_active)
+    {
+        pico_sha256_update_blocking(&g_fwup_state.hw_hash, data, len);
+        return;
+    }
+#endif
+
+    g_fwup_state.hash.Update(data, len);
+}
+
+// Get the hash state, which can be resumed at a multiple of the SHA-256 block size
+static void hash_get_state(uint32_t *state)
+{
+#if PICO_RP2350
+    if (g_fwup_state.hw_hash_active)
+    {
+        sha256_result_t result;
+        sha256_wait_valid_blocking();
+        sha256_get_result(&result, SHA256_BIG_ENDIAN);
+        for (int i = 0; i < SHA256_STATE_WORDS; i++)
+        {
+            state[i] = __builtin_bswap32(result.words[i]);
+        }
+        return;
+    }
+#endif
+
+    memcpy(state, g_fwup_state.hash.State(), SHA256_STATE_WORDS * sizeof(uint32_t));
+}
+
+static void hash_finish(uint8_t *digest)
+{
+#if PICO_RP2350
+    if (g_fwup_state.hw_hash_active)
+    {
+        sha256_result_t result;
+        pico_sha256_finish(&g_fwup_state.hw_hash, &result);
+        g_fwup_state.hw_hash_active = false;
+        memcpy(digest, result.bytes, SHA256_DIGEST_SIZE);
+        return;
+    }
+#endif
+
+    g_fwup_state.hash.Finish(digest);
+}
+
+// Get the progress saved in flash, or NULL if there is none for this family
+static const fwupgrade_progress_header *saved_progress()
+{
+    const fwupgrade_progress_header *header =
+        (const fwupgrade_progress_header*)(XIP_NOCACHE_NOALLOC_BASE + FW_UPGRADE_PROGRESS_OFFSET);
+    if (header->magic != FW_UPGRADE_PROGRESS_MAGIC ||
+        header->family_id != UF2_FAMILY_ID ||
+        header->num_blocks == 0 ||
+        header->num_blocks > FW_UPGRADE_MAX_SIZE / UF2_PAYLOAD_SIZE ||
+        memchr(header->fwid, 0, sizeof(header->fwid)) == NULL)
+    {
+        return NULL;
+    }
+    return header;
+}
+
+// Get the checkpoint the saved upload can be resumed from, or NULL if there is none,
+// and the number of checkpoints
+static const fwupgrade_checkpoint *saved_checkpoint(uint32_t *entries)
+{
+    const fwupgrade_checkpoint *log =
+        (const fwupgrade_checkpoint*)(XIP_NOCACHE_NOALLOC_BASE + FW_UPGRADE_PROGRESS_LOG);
+    uint32_t count = 0;
+    while (count < FW_UPGRADE_PROGRESS_LOG_ENTRIES && log[count].file_offset != 0xFFFFFFFF)
+    {
+        count++;
+    }
+
+    if (entries)
+    {
+        *entries = count;
+    }
+    return (count > 0) ? &log[count - 1] : NULL;
+}
+
+int fwupgrade_status_json(char *buf, size_t size)
+{
+    const fwupgrade_progress_header *header = saved_progress();
+    if (!header)
+    {
+        return snprintf(buf, size, "{\"fwid\":\"\",\"resumeOffset\":0,\"blocksReceived\":0,\"blocks\":0}");
+    }
+
+    // Programmed blocks have their bit cleared
+    const uint32_t *bitmap = (const uint32_t*)(XIP_NOCACHE_NOALLOC_BASE + FW_UPGRADE_PROGRESS_BITMAP);
+    uint32_t received = 0;
+    for (size_t i = 0; i < FW_UPGRADE_BITMAP_BYTES / 4; i++)
+    {
+        received += __builtin_popcount(~bitmap[i]);
+    }
+
+    const fwupgrade_checkpoint *checkpoint = saved_checkpoint(NULL);
+    return snprintf(buf, size, "{\"fwid\":\"%s\",\"resumeOffset\":%lu,\"blocksReceived\":%lu,\"blocks\":%lu}",
+        header->fwid, (unsigned long)(checkpoint ? checkpoint->file_offset : 0), (unsigned long)received,
+        (unsigned long)header->num_blocks);
+}
+
+// Copy the value of a query string parameter, returns false if it is missing or too long
+static bool get_query_param(const char *uri, const char *name, char *value, size_t size)
+{
+    const char *param = strchr(uri, '?');
+    size_t name_len = strlen(name);
+    while (param)
+    {
+        param++;
+        if (strncmp(param, name, name_len) == 0 && param[name_len] == '=')
+        {
+            const char *start = param + name_len + 1;
+            size_t len = strcspn(start, "&");
+            if (len >= size)
+            {
+                return false;
+            }
+            memcpy(value, start, len);
+            value[len] = '\0';
+            return true;
+        }
+        param = strchr(param, '&');
+    }
+    return false;
+}
+
+static bool valid_fwid(const char *fwid)
+{
+    for (const char *p = fwid; *p; p++)
+    {
+        if (!((*p >= '0' && *p <= '9') || (*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z') ||
+              *p == '.' || *p == '_' || *p == '-'))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Continue the upload saved in the progress sector. Blocks that are already programmed
+// are skipped, so the upload may send any part of the file.
+static void resume_upload(const fwupgrade_progress_header *header, uint32_t offset)
+{
+    uint32_t entries;
+    const fwupgrade_checkpoint *checkpoint = saved_checkpoint(&entries);
+    uint32_t resume_offset = checkpoint ? checkpoint->file_offset : 0;
+
+    LOG_INFO("Stopping second core\n");
+    multicore_reset_core1();
+
+    const uint32_t *bitmap = (const uint32_t*)(XIP_NOCACHE_NOALLOC_BASE + FW_UPGRADE_PROGRESS_BITMAP);
+    const uint32_t blocks_per_sector = FLASH_SECTOR_ERASE_SIZE / UF2_PAYLOAD_SIZE;
+    memset(g_fwup_state.erased, 0, sizeof(g_fwup_state.erased));
+    g_fwup_state.blocks_received = 0;
+    for (size_t i = 0; i < FW_UPGRADE_BITMAP_BYTES / 4; i++)
+    {
+        uint32_t received = ~bitmap[i];
+        g_fwup_state.received[i] = received;
+        g_fwup_state.blocks_received += __builtin_popcount(received);
+
+        // Sectors holding programmed blocks have been erased
+        for (uint32_t bit = 0; bit < 32; bit += blocks_per_sector)
+        {
+            if (received & (((1u << blocks_per_sector) - 1) << bit))
+            {
+                uint32_t sector = (i * 32 + bit) / blocks_per_sector;
+                g_fwup_state.erased[sector / 32] |= 1u << (sector % 32);
+            }
+        }
+    }
+
+    g_fwup_state.num_blocks = header->num_blocks;
+    g_fwup_state.stage_pages = 0;
+    g_fwup_state.progress_started = true;
+    g_fwup_state.progress_entries = entries;
+
+    // The hash of the file continues from the checkpoint, and the checkpoints
+    // the upload reaches are logged as long as the hash is known
+    if (offset == 0)
+    {
+        hash_start(NULL, 0);
+    }
+    else if (offset == resume_offset)
+    {
+        hash_start(checkpoint->hash_state, offset);
+    }
+    else
+    {
+        g_fwup_state.hash_valid = false;
+    }
+    g_fwup_state.log_checkpoints = g_fwup_state.hash_valid;
+    LOG_INFO("Resuming firmware %s at %lu, %lu/%lu blocks done\n", header->fwid, offset,
+        g_fwup_state.blocks_received, g_fwup_state.num_blocks);
+}
+
 err_t fwupgrade_post_begin(void *connection, const char *uri, const char *http_request,
                        u16_t http_request_len, int content_len, char *response_uri,
                        u16_t response_uri_len, u8_t *post_auto_wnd)
 {
-    printf("fwupgrade_post_begin %s\n", uri);
+    LOG_INFO("fwupgrade_post_begin %s\n", uri);
+    *post_auto_wnd = 0;
+    g_fwup_error = NULL;
+    memset(&g_fwup_state.stats, 0, sizeof(g_fwup_state.stats));
+    g_fwup_state.stats.start_us = time_us_32();
+    g_fwup_state.format = UPLOAD_UNKNOWN;
+    g_fwup_state.unacked = 0;
+    g_fwup_state.content_remain = content_len;
+    g_fwup_state.header_size = 0;
+    g_fwup_state.delta_started = false;
+    g_fwup_state.delta_remain = 0;
+    g_fwup_state.delta_produced = 0;
     g_fwup_state.block_size = 0;
     g_fwup_state.blocks_received = 0;
     g_fwup_state.num_blocks = 0;
+    g_fwup_state.file_offset = 0;
+    g_fwup_state.progress_started = false;
+    g_fwup_state.log_checkpoints = true;
+    g_fwup_state.checkpoint_due = false;
+    g_fwup_state.hash_valid = true;
+
+    // ?sha256=<hex> is the digest of the whole uploaded file
+    char digest[SHA256_DIGEST_SIZE * 2 + 1];
+    g_fwup_state.verify_digest = get_query_param(uri, "sha256", digest, sizeof(digest));
+    if (g_fwup_state.verify_digest && !ParseSha256(digest, g_fwup_state.expected_digest))
+    {
+        LOG_ERROR("Invalid upload digest %s\n", digest);
+        set_error("invalid sha256");
+        snprintf(response_uri, response_uri_len, "/fw_upgrade_result.json");
+        return ERR_VAL;
+    }
+
+    // ?commit=full rewrites the whole image without comparing it to the running firmware
+    char commit[8];
+    g_fwup_state.full_commit = (get_query_param(uri, "commit", commit, sizeof(commit)) &&
+                                strcmp(commit, "full") == 0);
+
+    // Uploads with an identity given as ?fwid=<id> save their progress, and
+    // ?offset=<n> continues an interrupted upload, e.g. from the offset reported
+    // by /fw_upgrade_status.json.
+    char offset[12];
+    if (!get_query_param(uri, "fwid", g_fwup_state.fwid, sizeof(g_fwup_state.fwid)) ||
+        !valid_fwid(g_fwup_state.fwid))
+    {
+        g_fwup_state.fwid[0] = '\0';
+    }
+
+    if (get_query_param(uri, "offset", offset, sizeof(offset)))
+    {
+        char *end;
+        g_fwup_state.file_offset = strtoul(offset, &end, 10);
+        if (*end != '\0' || g_fwup_state.file_offset % sizeof(uf2_block) != 0)
+        {
+            LOG_ERROR("Invalid upload offset %s\n", offset);
+            set_error("invalid offset");
+            snprintf(response_uri, response_uri_len, "/fw_upgrade_result.json");
+            return ERR_VAL;
+        }
+    }
+
+    const fwupgrade_progress_header *header = saved_progress();
+    if (g_fwup_state.fwid[0] != '\0' && header && strcmp(header->fwid, g_fwup_state.fwid) == 0)
+    {
+        resume_upload(header, g_fwup_state.file_offset);
+    }
+    else if (g_fwup_state.file_offset != 0)
+    {
+        LOG_ERROR("No saved progress for firmware %s\n", g_fwup_state.fwid);
+        set_error("no saved progress");
+        snprintf(response_uri, response_uri_len, "/fw_upgrade_result.json");
+        return ERR_VAL;
+    }
+    else
+    {
+        hash_start(NULL, 0);
+    }
+
     return ERR_OK;
 }
 
@@ -81,15 +616,233 @@ static void erase_flash_area(uint32_t offset, uint32_t len)
     restore_interrupts(saved_irq);
 }
 
-// Program one flash block
-__attribute__((section(".time_critical.program_flash_block")))
-static bool program_flash_block(uint32_t offset, uint8_t *data)
+// Erase the temporary area sector holding offset unless it already is
+static void erase_temp_sector(uint32_t offset)
+{
+    uint32_t sector = offset / FLASH_SECTOR_ERASE_SIZE;
+    uint32_t mask = 1u << (sector % 32);
+    if (g_fwup_state.erased[sector / 32] & mask)
+    {
+        return;
+    }
+
+    LOG_DEBUG("Erasing temp sector %lu\n", sector);
+    uint32_t start = time_us_32();
+    erase_flash_area(FW_UPGRADE_TEMP_OFFSET + sector * FLASH_SECTOR_ERASE_SIZE, FLASH_SECTOR_ERASE_SIZE);
+    note_irq_off(start);
+    g_fwup_state.erased[sector / 32] |= mask;
+    g_fwup_state.stats.sectors_erased++;
+}
+
+// Program a range of whole pages
+__attribute__((section(".time_critical.program_flash_pages")))
+static void program_flash_pages(uint32_t offset, const uint8_t *data, uint32_t len)
+{
+    uint32_t start = time_us_32();
+    uint32_t saved_irq = save_and_disable_interrupts();
+    flash_range_program(offset, data, len);
+    restore_interrupts(saved_irq);
+    note_irq_off(start);
+    g_fwup_state.stats.program_operations++;
+}
+
+// Program and verify a range of whole pages
+static bool program_flash_range(uint32_t offset, const uint8_t *data, uint32_t len)
+{
+    program_flash_pages(offset, data, len);
+    bool success = (memcmp(data, (void*)(XIP_NOCACHE_NOALLOC_BASE + offset), len) == 0);
+    return success;
+}
+
+// Erase the progress sector, dropping any saved upload
+static void discard_progress()
+{
+    uint32_t start = time_us_32();
+    erase_flash_area(FW_UPGRADE_PROGRESS_OFFSET, FLASH_SECTOR_ERASE_SIZE);
+    note_irq_off(start);
+    g_fwup_state.stats.sectors_erased++;
+    g_fwup_state.progress_started = false;
+    g_fwup_state.progress_entries = 0;
+}
+
+// Start a new progress record for this upload
+static bool start_progress()
+{
+    discard_progress();
+
+    uint8_t page[UF2_PAYLOAD_SIZE];
+    memset(page, 0xFF, sizeof(page));
+    fwupgrade_progress_header *header = (fwupgrade_progress_header*)page;
+    header->magic = FW_UPGRADE_PROGRESS_MAGIC;
+    header->family_id = UF2_FAMILY_ID;
+    header->num_blocks = g_fwup_state.num_blocks;
+    strcpy(header->fwid, g_fwup_state.fwid);
+    if (!program_flash_range(FW_UPGRADE_PROGRESS_OFFSET, page, sizeof(page)))
+    {
+        LOG_ERROR("Programming upload progress header failed\n");
+        return false;
+    }
+
+    g_fwup_state.progress_started = true;
+    return true;
+}
+
+// Save the blocks programmed so far and that the upload can be resumed from file_offset,
+// which the file has been hashed up to. Called only when the staging buffer is empty,
+// so it holds the bitmap while it is programmed.
+static bool save_progress(uint32_t file_offset)
+{
+    if (!g_fwup_state.progress_started)
+    {
+        return true;
+    }
+
+    // A full log is started over in a freshly erased sector
+    if (g_fwup_state.progress_entries == FW_UPGRADE_PROGRESS_LOG_ENTRIES && !start_progress())
+    {
+        return false;
+    }
+
+    uint32_t *bitmap = (uint32_t*)g_fwup_state.stage;
+    for (size_t i = 0; i < FW_UPGRADE_BITMAP_BYTES / 4; i++)
+    {
+        bitmap[i] = ~g_fwup_state.received[i];
+    }
+
+    if (!program_flash_range(FW_UPGRADE_PROGRESS_BITMAP, g_fwup_state.stage, FW_UPGRADE_BITMAP_BYTES))
+    {
+        LOG_ERROR("Programming upload progress bitmap failed\n");
+        return false;
+    }
+
+    if (!g_fwup_state.log_checkpoints)
+    {
+        return true;
+    }
+
+    fwupgrade_checkpoint checkpoint;
+    memset(&checkpoint, 0xFF, sizeof(checkpoint));
+    checkpoint.file_offset = file_offset;
+    hash_get_state(checkpoint.hash_state);
+
+    // Program only the new entry, the rest of its page is left as it is
+    uint32_t entry = FW_UPGRADE_PROGRESS_LOG + g_fwup_state.progress_entries * sizeof(checkpoint);
+    uint32_t page_offset = entry - entry % UF2_PAYLOAD_SIZE;
+    uint8_t page[UF2_PAYLOAD_SIZE];
+    memset(page, 0xFF, sizeof(page));
+    memcpy(page + entry % UF2_PAYLOAD_SIZE, &checkpoint, sizeof(checkpoint));
+    program_flash_pages(page_offset, page, sizeof(page));
+    if (memcmp(&checkpoint, (const void*)(XIP_NOCACHE_NOALLOC_BASE + entry), sizeof(checkpoint)) != 0)
+    {
+        LOG_ERROR("Programming upload progress checkpoint failed\n");
+        return false;
+    }
+
+    g_fwup_state.progress_entries++;
+    LOG_DEBUG("Upload can be resumed at %lu\n", file_offset);
+    return true;
+}
+
+// Program the blocks collected in the staging buffer, one operation for each
+// run of consecutive pages
+static bool flush_stage()
+{
+    uint16_t pages = g_fwup_state.stage_pages;
+    if (pages == 0)
+    {
+        return true;
+    }
+
+    uint32_t sector_offset = g_fwup_state.stage_sector * FLASH_SECTOR_ERASE_SIZE;
+    erase_temp_sector(sector_offset);
+
+    const uint32_t pages_per_sector = FLASH_SECTOR_ERASE_SIZE / UF2_PAYLOAD_SIZE;
+    uint32_t page = 0;
+    while (page < pages_per_sector)
+    {
+        if (!(pages & (1u << page)))
+        {
+            page++;
+            continue;
+        }
+
+        uint32_t first = page;
+        while (page < pages_per_sector && (pages & (1u << page)))
+        {
+            page++;
+        }
+
+        uint32_t tmp_addr = FW_UPGRADE_TEMP_OFFSET + sector_offset + first * UF2_PAYLOAD_SIZE;
+        uint32_t len = (page - first) * UF2_PAYLOAD_SIZE;
+        LOG_DEBUG("Programming %lu bytes to %lu\n", len, tmp_addr);
+        if (!program_flash_range(tmp_addr, g_fwup_state.stage + first * UF2_PAYLOAD_SIZE, len))
+        {
+            LOG_ERROR("Programming temporary flash failed at addr %lu\n", tmp_addr);
+            return false;
+        }
+        g_fwup_state.stats.blocks_programmed += page - first;
+
+        uint32_t block = (sector_offset + first * UF2_PAYLOAD_SIZE) / UF2_PAYLOAD_SIZE;
+        for (uint32_t i = block; i < block + page - first; i++)
+        {
+            g_fwup_state.received[i / 32] |= 1u << (i % 32);
+        }
+    }
+
+    g_fwup_state.stage_pages = 0;
+    return true;
+}
+
+// Add a block to the staging buffer, first programming the blocks of another
+// sector that it holds. The buffer is programmed as soon as the sector is full.
+// Progress is saved after each time the buffer is programmed, once the hash of the
+// file has reached the offset to resume from.
+static bool stage_block(uint32_t block_offset, const uint8_t *data)
+{
+    uint32_t sector = block_offset / FLASH_SECTOR_ERASE_SIZE;
+    if (g_fwup_state.stage_pages != 0 && sector != g_fwup_state.stage_sector)
+    {
+        // The upload can resume from the block being staged
+        if (!flush_stage() || !save_progress(g_fwup_state.file_offset - sizeof(uf2_block)))
+        {
+            return false;
+        }
+    }
+
+    uint32_t offset_in_sector = block_offset % FLASH_SECTOR_ERASE_SIZE;
+    g_fwup_state.stage_sector = sector;
+    memcpy(g_fwup_state.stage + offset_in_sector, data, UF2_PAYLOAD_SIZE);
+    g_fwup_state.stage_pages |= 1u << (offset_in_sector / UF2_PAYLOAD_SIZE);
+
+    if (g_fwup_state.stage_pages == 0xFFFF)
+    {
+        g_fwup_state.checkpoint_due = true;
+        return flush_stage();
+    }
+    return true;
+}
+
+// Check whether a sector of the running firmware already holds what is staged for it,
+// with erased pages where no block was received
+__attribute__((section(".time_critical.staged_sector_matches")))
+static bool staged_sector_matches(uint32_t sector, uint32_t blocks)
 {
-    uint32_t saved_irq = save_and_disable_interrupts();
-    flash_range_program(offset, data, UF2_PAYLOAD_SIZE);
-    restore_interrupts(saved_irq);
-    bool success = (memcmp(data, (void*)(XIP_NOCACHE_NOALLOC_BASE + offset), UF2_PAYLOAD_SIZE) == 0);
-    return success;
+    const uint32_t words_per_page = UF2_PAYLOAD_SIZE / sizeof(uint32_t);
+    const uint32_t *current = (const uint32_t*)(XIP_BASE + sector * FLASH_SECTOR_ERASE_SIZE);
+    const uint32_t *staged = (const uint32_t*)(XIP_BASE + FW_UPGRADE_TEMP_OFFSET +
+                                               sector * FLASH_SECTOR_ERASE_SIZE);
+    for (uint32_t page = 0; page < FLASH_SECTOR_ERASE_SIZE / UF2_PAYLOAD_SIZE; page++)
+    {
+        bool received = (blocks & (1u << page)) != 0;
+        for (uint32_t i = page * words_per_page; i < (page + 1) * words_per_page; i++)
+        {
+            if (current[i] != (received ? staged[i] : 0xFFFFFFFF))
+            {
+                return false;
+            }
+        }
+    }
+    return true;
 }
 
 // Copy firmware from temporary area to final flash location.
@@ -100,49 +853,149 @@ int64_t finish_fw_upgrade(alarm_id_t id, void *user_data)
 {
     uint32_t total_fw_size = g_fwup_state.num_blocks * UF2_PAYLOAD_SIZE;
     if (total_fw_size < 16 * 1024 ||
-        total_fw_size > FW_UPGRADE_TEMP_OFFSET)
+        total_fw_size > FW_UPGRADE_MAX_SIZE ||
+        g_fwup_state.blocks_received != g_fwup_state.num_blocks)
     {
         return 0; // Just a sanity check
     }
 
     save_and_disable_interrupts();
 
-    // Copy firmware from temp area to the final offset
-    erase_flash_area(0, total_fw_size);
-    for (uint32_t block = 0; block < g_fwup_state.num_blocks; block++)
+    // Copy firmware from temp area to the final offset, a sector at a time.
+    // Blocks may be sparse, so only the sectors holding blocks are rewritten,
+    // and of those only the ones that differ from the running firmware.
+    uint32_t start = time_us_32();
+    uint32_t sectors_total = 0;
+    uint32_t sectors_rewritten = 0;
+    const uint32_t pages_per_sector = FLASH_SECTOR_ERASE_SIZE / UF2_PAYLOAD_SIZE;
+    for (uint32_t sector = 0; sector < FW_UPGRADE_MAX_SIZE / FLASH_SECTOR_ERASE_SIZE; sector++)
     {
-        // We need to copy each block to RAM and from there back to flash
-        // at the final location. But memcpy might not be in RAM, so do it manually.
-        uint8_t buf[UF2_PAYLOAD_SIZE];
-        uint32_t offset = block * UF2_PAYLOAD_SIZE;
-        uint8_t *src = (uint8_t*)(FW_UPGRADE_TARGET_ADDR + FW_UPGRADE_TEMP_OFFSET + offset);
-        for (size_t i = 0; i < UF2_PAYLOAD_SIZE; i++)
+        uint32_t first_block = sector * pages_per_sector;
+        uint32_t blocks = (g_fwup_state.received[first_block / 32] >> (first_block % 32)) &
+                          ((1u << pages_per_sector) - 1);
+        if (blocks == 0)
         {
-            buf[i] = src[i];
+            continue;
         }
 
-        flash_range_program(offset, buf, UF2_PAYLOAD_SIZE);
+        sectors_total++;
+        if (!g_fwup_state.full_commit && staged_sector_matches(sector, blocks))
+        {
+            continue;
+        }
+
+        sectors_rewritten++;
+        erase_flash_area(sector * FLASH_SECTOR_ERASE_SIZE, FLASH_SECTOR_ERASE_SIZE);
+        for (uint32_t page = 0; page < pages_per_sector; page++)
+        {
+            if (!(blocks & (1u << page)))
+            {
+                continue;
+            }
+
+            // We need to copy each block to RAM and from there back to flash
+            // at the final location. But memcpy might not be in RAM, so do it manually.
+            uint8_t buf[UF2_PAYLOAD_SIZE];
+            uint32_t offset = (first_block + page) * UF2_PAYLOAD_SIZE;
+            uint8_t *src = (uint8_t*)(XIP_BASE + FW_UPGRADE_TEMP_OFFSET + offset);
+            for (size_t i = 0; i < UF2_PAYLOAD_SIZE; i++)
+            {
+                buf[i] = src[i];
+            }
+
+            flash_range_program(offset, buf, UF2_PAYLOAD_SIZE);
+        }
     }
 
+    // Report the commit after the reboot
+    watchdog_hw->scratch[1] = sectors_rewritten | (g_fwup_state.full_commit ? FW_UPGRADE_COMMIT_FULL : 0);
+    watchdog_hw->scratch[2] = sectors_total;
+    watchdog_hw->scratch[3] = time_us_32() - start;
+    watchdog_hw->scratch[0] = FW_UPGRADE_COMMIT_MAGIC;
+
     // Reboot
     scb_hw->aircr = 0x05FA0004;
     while(1);
 }
 
+// Stage a block of the image for block_offset, skipping it if it has arrived
+// already. The first block starts the upload.
+static bool accept_block(uint32_t block_offset, const uint8_t *data, uint32_t num_blocks)
+{
+    // Blocks are accepted in any order, the first one starts the upload
+    if (g_fwup_state.num_blocks == 0)
+    {
+        if (num_blocks == 0 || num_blocks > FW_UPGRADE_MAX_SIZE / UF2_PAYLOAD_SIZE)
+        {
+            LOG_ERROR("Invalid block count %lu\n", num_blocks);
+            return false;
+        }
+
+        LOG_INFO("Got first block, total %lu blocks\n", num_blocks);
+        g_fwup_state.blocks_received = 0;
+        g_fwup_state.num_blocks = num_blocks;
+
+        LOG_INFO("Stopping second core\n");
+        multicore_reset_core1();
+
+        // Sectors of the temp area are erased as the blocks arrive
+        memset(g_fwup_state.erased, 0, sizeof(g_fwup_state.erased));
+        memset(g_fwup_state.received, 0, sizeof(g_fwup_state.received));
+        g_fwup_state.stage_pages = 0;
+
+        // Any saved progress no longer matches the temp area
+        if (g_fwup_state.fwid[0] != '\0')
+        {
+            if (!start_progress())
+            {
+                return false;
+            }
+        }
+        else if (saved_progress())
+        {
+            discard_progress();
+        }
+    }
+    else if (num_blocks != g_fwup_state.num_blocks)
+    {
+        LOG_ERROR("Block count changed from %lu to %lu\n", g_fwup_state.num_blocks, num_blocks);
+        return false;
+    }
+
+    // Skip blocks that have been programmed or staged already
+    uint32_t page = block_offset / UF2_PAYLOAD_SIZE;
+    uint32_t page_in_sector = page % (FLASH_SECTOR_ERASE_SIZE / UF2_PAYLOAD_SIZE);
+    bool staged = (g_fwup_state.stage_sector == block_offset / FLASH_SECTOR_ERASE_SIZE &&
+                   (g_fwup_state.stage_pages & (1u << page_in_sector)));
+    if (staged || (g_fwup_state.received[page / 32] & (1u << (page % 32))))
+    {
+        LOG_DEBUG("Skipping block for %lu received already\n", block_offset);
+        return true;
+    }
+
+    if (!stage_block(block_offset, data))
+    {
+        return false;
+    }
+    g_fwup_state.blocks_received++;
+
+    return true;
+}
+
 static bool handle_uf2_block(uf2_block *block)
 {
     if (block->magic_start0 != UF2_MAGIC_START0 ||
         block->magic_start1 != UF2_MAGIC_START1 ||
         block->magic_end != UF2_MAGIC_END)
     {
-        printf("UF2 magics do not match (0x%08lx 0x%08lx 0x%08lx)\n",
+        LOG_ERROR("UF2 magics do not match (0x%08lx 0x%08lx 0x%08lx)\n",
             block->magic_start0, block->magic_start1, block->magic_end);
         return false;
     }
 
     if (block->file_size != UF2_FAMILY_ID || !(block->flags & UF2_FLAG_FAMILY_ID_PRESENT))
     {
-        printf("Ignoring block for different family id (expected 0x%08x, got 0x%08lx)\n",
+        LOG_DEBUG("Ignoring block for different family id (expected 0x%08x, got 0x%08lx)\n",
             UF2_FAMILY_ID, block->file_size);
 
         // Continue upload until we get a block for us in a universal binary
@@ -151,71 +1004,47 @@ static bool handle_uf2_block(uf2_block *block)
 
     if (block->flags & UF2_FLAG_NOT_MAIN_FLASH)
     {
-        printf("Ignoring not-for-flash UF2 block\n");
+        LOG_DEBUG("Ignoring not-for-flash UF2 block\n");
         return true;
     }
 
     if (block->payload_size != UF2_PAYLOAD_SIZE)
     {
-        printf("Unexpected payload size %lu\n", block->payload_size);
+        LOG_ERROR("Unexpected payload size %lu\n", block->payload_size);
         return false;
     }
 
     if (block->target_addr < FW_UPGRADE_TARGET_ADDR ||
-        block->target_addr >= FW_UPGRADE_TARGET_ADDR + FW_UPGRADE_TEMP_OFFSET)
-    {
-        printf("UF2 block offset out of range: 0x%08lx\n", block->target_addr);
-        return false;
-    }
-
-    if (block->block_no == 0)
-    {
-        printf("Got first UF2 block, total %lu blocks\n", block->num_blocks);
-        g_fwup_state.blocks_received = 0;
-        g_fwup_state.num_blocks = block->num_blocks;
-
-        printf("Stopping second core");
-        multicore_reset_core1();
-
-        uint32_t total_bytes = block->num_blocks * UF2_PAYLOAD_SIZE;
-        printf("Erasing temp area for %lu bytes\n", total_bytes);
-        erase_flash_area(FW_UPGRADE_TEMP_OFFSET, total_bytes);
-    }
-    else if (block->block_no != g_fwup_state.blocks_received)
+        block->target_addr >= FW_UPGRADE_TARGET_ADDR + FW_UPGRADE_MAX_SIZE)
     {
-        printf("UF2 block out of order, got %lu expected %lu\n",
-            block->block_no, g_fwup_state.blocks_received);
+        LOG_ERROR("UF2 block offset out of range: 0x%08lx\n", block->target_addr);
         return false;
     }
 
     uint32_t block_offset = block->target_addr - FW_UPGRADE_TARGET_ADDR;
-    uint32_t tmp_addr = FW_UPGRADE_TEMP_OFFSET + block_offset;
-    printf("Programming UF2 block %lu/%lu to %lu\n", block->block_no, block->num_blocks, tmp_addr);
-    if (!program_flash_block(tmp_addr, block->data))
+    if (block_offset % UF2_PAYLOAD_SIZE != 0)
     {
-        printf("Programming UF2 block to temporary flash failed at addr %lu\n", tmp_addr);
+        LOG_ERROR("UF2 block not page aligned: 0x%08lx\n", block->target_addr);
         return false;
     }
-    printf("Block programming successful\n");
-    g_fwup_state.blocks_received++;
 
-    return true;
+    LOG_DEBUG("Staging UF2 block %lu/%lu for %lu\n", block->block_no, block->num_blocks, block_offset);
+    return accept_block(block_offset, block->data, block->num_blocks);
 }
 
-err_t fwupgrade_post_receive_data(void *connection, struct pbuf *p)
+// Collect UF2 blocks from the uploaded or decompressed data
+static bool receive_uf2(const uint8_t *data, size_t len)
 {
-    uint8_t *data = (uint8_t*)p->payload;
-    printf("fwupgrade_post_receive_data %d 0x%02x 0x%02x\n", (int)p->len, data[0], data[1]);
-
     // Process one UF2 block at a time.
     // For RP2xxx the UF2 blocks are always 512 bytes in size.
-    size_t remain = p->len;
+    size_t remain = len;
     while (remain > 0)
     {
         size_t block_remain = sizeof(uf2_block) - g_fwup_state.block_size;
         size_t to_cpy = (remain > block_remain) ? block_remain : remain;
         memcpy((uint8_t*)&g_fwup_state.block + g_fwup_state.block_size, data, to_cpy);
         g_fwup_state.block_size += to_cpy;
+        g_fwup_state.file_offset += to_cpy;
         data += to_cpy;
         remain -= to_cpy;
 
@@ -223,37 +1052,464 @@ err_t fwupgrade_post_receive_data(void *connection, struct pbuf *p)
         {
             if (!handle_uf2_block(&g_fwup_state.block))
             {
-                printf("handle_uf2_block() failed\n");
-                return ERR_VAL;
+                LOG_ERROR("handle_uf2_block() failed\n");
+                return false;
             }
             g_fwup_state.block_size = 0;
+
+            // Only whole blocks are hashed, so that the hash is at the resume
+            // offset when the upload is cut off in the middle of a block
+            if (g_fwup_state.format == UPLOAD_UF2)
+            {
+                hash_update((const uint8_t*)&g_fwup_state.block, sizeof(uf2_block));
+            }
+
+            if (g_fwup_state.checkpoint_due)
+            {
+                g_fwup_state.checkpoint_due = false;
+                if (!save_progress(g_fwup_state.file_offset))
+                {
+                    return false;
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+static bool receive_decompressed(void *context, const uint8_t *data, size_t len)
+{
+    return receive_uf2(data, len);
+}
+
+// Collect bytes of a header until it has size bytes, returns true once it does
+static bool collect_header(const uint8_t **data, size_t *len, size_t size)
+{
+    size_t to_cpy = size - g_fwup_state.header_size;
+    to_cpy = (*len > to_cpy) ? to_cpy : *len;
+    memcpy(g_fwup_state.header + g_fwup_state.header_size, *data, to_cpy);
+    g_fwup_state.header_size += to_cpy;
+    *data += to_cpy;
+    *len -= to_cpy;
+    return g_fwup_state.header_size == size;
+}
+
+// Split a compressed upload into sections and decompress the one for our family.
+// Each section starts with the family ID and the length of its data.
+static bool receive_compressed(const uint8_t *data, size_t len)
+{
+    hash_update(data, len);
+    while (len > 0)
+    {
+        if (g_fwup_state.header_size < 8)
+        {
+            if (collect_header(&data, &len, 8))
+            {
+                uint32_t family_id;
+                memcpy(&family_id, g_fwup_state.header, sizeof(family_id));
+                memcpy(&g_fwup_state.section_remain, g_fwup_state.header + 4, sizeof(uint32_t));
+                g_fwup_state.section_ours = (family_id == UF2_FAMILY_ID);
+                g_fwup_state.decoder.Reset();
+                LOG_DEBUG("Compressed section for family 0x%08lx, %lu bytes\n",
+                    family_id, g_fwup_state.section_remain);
+
+                // Sections may be empty
+                if (g_fwup_state.section_remain == 0)
+                {
+                    g_fwup_state.header_size = 0;
+                }
+            }
+            continue;
+        }
+
+        size_t to_use = (len > g_fwup_state.section_remain) ? g_fwup_state.section_remain : len;
+        if (g_fwup_state.section_ours &&
+            !g_fwup_state.decoder.Feed(data, to_use, receive_decompressed, NULL))
+        {
+            return false;
+        }
+        data += to_use;
+        len -= to_use;
+        g_fwup_state.section_remain -= to_use;
+        if (g_fwup_state.section_remain == 0)
+        {
+            g_fwup_state.header_size = 0;
+        }
+    }
+
+    return true;
+}
+
+// Check the patch header against the running firmware
+static bool start_delta(const fwupgrade_delta_header *header)
+{
+    if (header->family_id != UF2_FAMILY_ID)
+    {
+        LOG_ERROR("Patch is for family 0x%08lx, expected 0x%08x\n", header->family_id, UF2_FAMILY_ID);
+        return false;
+    }
+
+    if (header->base_size == 0 || header->base_size > FW_UPGRADE_TEMP_OFFSET ||
+        header->image_size == 0 || header->image_size % UF2_PAYLOAD_SIZE != 0 ||
+        header->image_size > FW_UPGRADE_MAX_SIZE)
+    {
+        LOG_ERROR("Invalid patch sizes %lu and %lu\n", header->base_size, header->image_size);
+        return false;
+    }
+
+    // The running firmware is only read until the image is committed, so the
+    // patch can copy from it while the new image is staged. It is checked
+    // against the base of the patch as the upload continues.
+    LOG_INFO("Applying patch to %lu bytes of running firmware, image %lu bytes\n",
+        header->base_size, header->image_size);
+    g_fwup_state.delta_base_hash.Reset();
+    g_fwup_state.delta_base_hashed = 0;
+    g_fwup_state.delta_base_verified = false;
+    memcpy(g_fwup_state.delta_base_sha256, header->base_sha256, SHA256_DIGEST_SIZE);
+    g_fwup_state.delta_base_size = header->base_size;
+    g_fwup_state.delta_num_blocks = header->image_size / UF2_PAYLOAD_SIZE;
+    g_fwup_state.delta_started = true;
+    return true;
+}
+
+// Hash the running firmware in proportion to the part of the patch received, and
+// all of it once the whole patch has arrived, so that no single callback of lwIP
+// hashes up to a megabyte of flash. Fails if it is not the base of the patch.
+static bool hash_delta_base()
+{
+    uint32_t base_size = g_fwup_state.delta_base_size;
+    uint32_t received = g_fwup_state.stats.bytes_received;
+    uint32_t target = base_size;
+    if (g_fwup_state.content_remain > 0)
+    {
+        target = (uint32_t)((uint64_t)base_size * received / (received + g_fwup_state.content_remain));
+        if (target < g_fwup_state.delta_base_hashed + FW_UPGRADE_BASE_HASH_SLICE)
+        {
+            target = g_fwup_state.delta_base_hashed + FW_UPGRADE_BASE_HASH_SLICE;
+        }
+        target = (target > base_size) ? base_size : target;
+    }
+
+    if (g_fwup_state.delta_base_verified || target <= g_fwup_state.delta_base_hashed)
+    {
+        return true;
+    }
+
+    g_fwup_state.delta_base_hash.Update((const uint8_t*)(XIP_BASE + g_fwup_state.delta_base_hashed),
+                                        target - g_fwup_state.delta_base_hashed);
+    g_fwup_state.delta_base_hashed = target;
+    if (target < base_size)
+    {
+        return true;
+    }
+
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    g_fwup_state.delta_base_hash.Finish(digest);
+    if (memcmp(digest, g_fwup_state.delta_base_sha256, sizeof(digest)) != 0)
+    {
+        LOG_ERROR("Patch does not apply to the running firmware\n");
+        set_error("patch does not apply to the running firmware");
+        return false;
+    }
+
+    LOG_INFO("Running firmware matches the base of the patch\n");
+    g_fwup_state.delta_base_verified = true;
+    return true;
+}
+
+// Add bytes to the image produced by a patch, staging each page when it is complete
+static bool delta_output(const uint8_t *data, size_t len)
+{
+    while (len > 0)
+    {
+        uint32_t used = g_fwup_state.delta_produced % UF2_PAYLOAD_SIZE;
+        size_t to_cpy = UF2_PAYLOAD_SIZE - used;
+        to_cpy = (len > to_cpy) ? to_cpy : len;
+        memcpy(g_fwup_state.delta_page + used, data, to_cpy);
+        g_fwup_state.delta_produced += to_cpy;
+        data += to_cpy;
+        len -= to_cpy;
+
+        if (g_fwup_state.delta_produced % UF2_PAYLOAD_SIZE == 0 &&
+            !accept_block(g_fwup_state.delta_produced - UF2_PAYLOAD_SIZE, g_fwup_state.delta_page,
+                          g_fwup_state.delta_num_blocks))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Parse an operation of a patch. Copies are done right away as they need no more input.
+static bool start_delta_op(const uint8_t *args)
+{
+    uint32_t offset, length;
+    if (g_fwup_state.delta_op == FW_UPGRADE_DELTA_COPY)
+    {
+        memcpy(&offset, args, sizeof(offset));
+        memcpy(&length, args + 4, sizeof(length));
+    }
+    else
+    {
+        offset = 0;
+        memcpy(&length, args, sizeof(length));
+    }
+
+    if (length > g_fwup_state.delta_num_blocks * UF2_PAYLOAD_SIZE - g_fwup_state.delta_produced ||
+        offset > g_fwup_state.delta_base_size || length > g_fwup_state.delta_base_size - offset)
+    {
+        LOG_ERROR("Patch operation %d out of range (%lu, %lu)\n", g_fwup_state.delta_op, offset, length);
+        return false;
+    }
+
+    if (g_fwup_state.delta_op == FW_UPGRADE_DELTA_COPY)
+    {
+        return delta_output((const uint8_t*)(XIP_BASE + offset), length);
+    }
+
+    g_fwup_state.delta_remain = length;
+    return true;
+}
+
+// Apply a patch to the running firmware as it arrives
+static bool receive_delta(const uint8_t *data, size_t len)
+{
+    hash_update(data, len);
+    while (len > 0)
+    {
+        if (!g_fwup_state.delta_started)
+        {
+            if (collect_header(&data, &len, sizeof(fwupgrade_delta_header)))
+            {
+                g_fwup_state.header_size = 0;
+                if (!start_delta((const fwupgrade_delta_header*)g_fwup_state.header))
+                {
+                    return false;
+                }
+            }
+        }
+        else if (g_fwup_state.delta_remain > 0)
+        {
+            size_t to_use = (len > g_fwup_state.delta_remain) ? g_fwup_state.delta_remain : len;
+            if (!delta_output(data, to_use))
+            {
+                return false;
+            }
+            data += to_use;
+            len -= to_use;
+            g_fwup_state.delta_remain -= to_use;
+        }
+        else
+        {
+            // Operation code and its arguments
+            if (g_fwup_state.header_size == 0)
+            {
+                g_fwup_state.delta_op = *data;
+                if (g_fwup_state.delta_op != FW_UPGRADE_DELTA_COPY &&
+                    g_fwup_state.delta_op != FW_UPGRADE_DELTA_INSERT)
+                {
+                    LOG_ERROR("Unknown patch operation %d\n", g_fwup_state.delta_op);
+                    return false;
+                }
+            }
+
+            size_t size = (g_fwup_state.delta_op == FW_UPGRADE_DELTA_COPY) ? 9 : 5;
+            if (collect_header(&data, &len, size))
+            {
+                g_fwup_state.header_size = 0;
+                if (!start_delta_op(g_fwup_state.header + 1))
+                {
+                    return false;
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+static bool receive_upload(const uint8_t *data, size_t len)
+{
+    // The format is recognized from the first bytes of the upload
+    if (g_fwup_state.format == UPLOAD_UNKNOWN)
+    {
+        if (!collect_header(&data, &len, FW_UPGRADE_MAGIC_SIZE))
+        {
+            return true;
+        }
+
+        g_fwup_state.header_size = 0;
+        if (memcmp(g_fwup_state.header, FW_UPGRADE_COMPRESSED_MAGIC, FW_UPGRADE_MAGIC_SIZE) == 0 ||
+            memcmp(g_fwup_state.header, FW_UPGRADE_DELTA_MAGIC, FW_UPGRADE_MAGIC_SIZE) == 0)
+        {
+            // The decompressor and patch state is not saved, so these uploads are only
+            // resumed by sending them again and skipping the blocks programmed already
+            if (g_fwup_state.file_offset != 0)
+            {
+                LOG_ERROR("Compressed uploads and patches cannot continue from an offset\n");
+                return false;
+            }
+
+            bool compressed = (memcmp(g_fwup_state.header, FW_UPGRADE_COMPRESSED_MAGIC, FW_UPGRADE_MAGIC_SIZE) == 0);
+            LOG_INFO("Receiving %s\n", compressed ? "compressed firmware" : "firmware patch");
+            g_fwup_state.format = compressed ? UPLOAD_COMPRESSED : UPLOAD_DELTA;
+            g_fwup_state.log_checkpoints = false;
+            hash_update(g_fwup_state.header, FW_UPGRADE_MAGIC_SIZE);
+        }
+        else
+        {
+            g_fwup_state.format = UPLOAD_UF2;
+            if (!receive_uf2(g_fwup_state.header, FW_UPGRADE_MAGIC_SIZE))
+            {
+                return false;
+            }
         }
     }
 
+    if (g_fwup_state.format == UPLOAD_COMPRESSED)
+    {
+        return receive_compressed(data, len);
+    }
+    else if (g_fwup_state.format == UPLOAD_DELTA)
+    {
+        return receive_delta(data, len);
+    }
+    return receive_uf2(data, len);
+}
+
+err_t fwupgrade_post_receive_data(void *connection, struct pbuf *p)
+{
+    LOG_DEBUG("fwupgrade_post_receive_data %d\n", (int)p->tot_len);
+
+    bool success = true;
+    for (struct pbuf *q = p; q != NULL && success; q = q->next)
+    {
+        success = receive_upload((const uint8_t*)q->payload, q->len);
+    }
+    g_fwup_state.stats.bytes_received += p->tot_len;
+    g_fwup_state.unacked += p->tot_len;
+    g_fwup_state.content_remain -= (p->tot_len < g_fwup_state.content_remain) ? p->tot_len : g_fwup_state.content_remain;
     pbuf_free(p);
-    return ERR_OK;
+
+    if (success && g_fwup_state.format == UPLOAD_DELTA && g_fwup_state.delta_started)
+    {
+        success = hash_delta_base();
+    }
+
+    if (!success)
+    {
+        set_error("invalid upload data");
+    }
+
+    // The window is opened once the data has been programmed to flash, so that
+    // the sender waits for the flash instead of filling the pbuf pool. httpd
+    // finishes the request only after all of it has been acknowledged.
+    if (!success || g_fwup_state.content_remain == 0 ||
+        g_fwup_state.stage_pages == 0 || g_fwup_state.unacked >= FW_UPGRADE_WND_HOLD)
+    {
+        httpd_post_data_recved(connection, (u16_t)g_fwup_state.unacked);
+        g_fwup_state.unacked = 0;
+    }
+
+    return success ? ERR_OK : ERR_VAL;
 }
 
 void start_multicore_i2c();
 
+// Check the hash of the uploaded file against the digest given by the client
+static bool verify_upload()
+{
+    if (!g_fwup_state.hash_valid)
+    {
+        LOG_ERROR("Upload digest cannot be checked, the file was not sent from a checkpoint\n");
+        set_error("digest cannot be checked");
+        return false;
+    }
+
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    hash_finish(digest);
+    if (memcmp(digest, g_fwup_state.expected_digest, sizeof(digest)) != 0)
+    {
+        LOG_ERROR("Upload SHA-256 does not match, discarding it\n");
+        set_error("digest mismatch");
+        if (g_fwup_state.progress_started)
+        {
+            discard_progress();
+        }
+        return false;
+    }
+
+    LOG_INFO("Upload SHA-256 verified\n");
+    return true;
+}
+
 void fwupgrade_post_finished(void *connection, char *response_uri, u16_t response_uri_len)
 {
-    if (g_fwup_state.num_blocks == 0 ||
-        g_fwup_state.blocks_received != g_fwup_state.num_blocks)
+    fwupgrade_stats *stats = &g_fwup_state.stats;
+    stats->duration_us = time_us_32() - stats->start_us;
+    uint32_t duration_ms = stats->duration_us / 1000;
+    LOG_INFO("fwupgrade received %lu bytes in %lu ms (%lu bytes/s)\n", stats->bytes_received, duration_ms,
+        (duration_ms > 0) ? (uint32_t)((uint64_t)stats->bytes_received * 1000 / duration_ms) : 0);
+
+    bool complete = (g_fwup_state.num_blocks != 0 &&
+                     g_fwup_state.blocks_received == g_fwup_state.num_blocks);
+
+    // Program the blocks of the last sector
+    if (complete && !flush_stage())
     {
-        printf("fwupgrade interrupted, %lu/%lu blocks done\n",
+        LOG_ERROR("Programming the last sector failed\n");
+        set_error("programming flash failed");
+        complete = false;
+    }
+
+    // A patch is only committed once the running firmware has been checked against its base
+    if (complete && g_fwup_state.format == UPLOAD_DELTA && !g_fwup_state.delta_base_verified)
+    {
+        LOG_ERROR("Running firmware was not checked against the patch\n");
+        set_error("patch does not apply to the running firmware");
+        complete = false;
+    }
+
+    // The image is only committed when the uploaded file has the digest given by the client
+    if (complete && g_fwup_state.verify_digest && !verify_upload())
+    {
+        complete = false;
+    }
+
+    // The client tells success from failure by the status of the result
+    snprintf(response_uri, response_uri_len, "/fw_upgrade_result.json");
+
+    LOG_INFO("fwupgrade erased %lu sectors, programmed %lu blocks in %lu operations, max %lu us with interrupts off\n",
+        stats->sectors_erased, stats->blocks_programmed, stats->program_operations, stats->max_irq_off_us);
+
+    if (!complete)
+    {
+        LOG_WARN("fwupgrade interrupted, %lu/%lu blocks done\n",
             g_fwup_state.blocks_received, g_fwup_state.num_blocks);
+        set_error("upload incomplete");
 
         if (g_fwup_state.num_blocks > 0)
         {
+            // Save what has arrived so that the upload can be resumed from the
+            // start of the block that was cut off
+            if (g_fwup_state.progress_started &&
+                (!flush_stage() || !save_progress(g_fwup_state.file_offset - g_fwup_state.block_size)))
+            {
+                LOG_ERROR("Saving upload progress failed\n");
+            }
+
             // We reset multicore so restore it back to operation
             start_multicore_i2c();
         }
     }
     else
     {
-        printf("fwupgrade_post_finished\n");
-        snprintf(response_uri, response_uri_len, "/fw_upgrade.html");
+        LOG_INFO("fwupgrade_post_finished\n");
+        if (g_fwup_state.progress_started)
+        {
+            discard_progress();
+        }
 
         // Let lwip post the result and then proceed to copy the firmware to the actual
         // location and reboot.
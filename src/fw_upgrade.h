@@ -34,4 +34,46 @@ err_t fwupgrade_post_begin(void *connection, const char *uri, const char *http_r
 err_t fwupgrade_post_receive_data(void *connection, struct pbuf *p);
 
 // Called from http_post_finished
-void fwupgrade_post_finished(void *connection, char *response_uri, u16_t response_uri_len);
\ No newline at end of file
+void fwupgrade_post_finished(void *connection, char *response_uri, u16_t response_uri_len);
+
+// Longest image identity passed as ?fwid=<id>, including the terminator
+#define FW_UPGRADE_FWID_SIZE 65
+
+// Write the progress saved for resuming an interrupted upload as JSON,
+// returns the length like snprintf()
+int fwupgrade_status_json(char *buf, size_t size);
+
+// Write the result of the last upload as JSON, {"status":"ok"} or
+// {"status":"error","error":"<reason>"}, returns the length like snprintf()
+int fwupgrade_result_json(char *buf, size_t size);
+
+// Measurements of the last firmware upload
+typedef struct {
+    uint32_t start_us;
+    // Time from the start of the upload until it finished, set when it finishes
+    uint32_t duration_us;
+    uint32_t bytes_received;
+    uint32_t blocks_programmed;
+    // Blocks are programmed a sector at a time, or fewer when a sector is not full
+    uint32_t program_operations;
+    uint32_t sectors_erased;
+    // Longest time interrupts were disabled for a single flash operation
+    uint32_t max_irq_off_us;
+} fwupgrade_stats;
+
+const fwupgrade_stats *fwupgrade_get_stats();
+
+// Result of the firmware commit done before the last reboot
+typedef struct {
+    bool valid;
+    // Every sector was rewritten without comparing it to the running firmware
+    bool full;
+    uint32_t sectors_rewritten;
+    uint32_t sectors_total;
+    uint32_t duration_us;
+} fwupgrade_commit_result;
+
+// Called once at startup, picks up the result of a commit before the reboot
+void fwupgrade_init();
+
+const fwupgrade_commit_result *fwupgrade_get_commit_result();
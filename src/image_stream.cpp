@@ -0,0 +1,251 @@
+/**
+ * ZuluIDE™ - Copyright (c) 2023 Rabbit Hole Computing™
+ *
+ * ZuluIDE™ firmware is licensed under the GPL version 3 or any later version.
+ *
+ * https://www.gnu.org/licenses/gpl-3.0.html
+ * ----
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ **/
+
+#include "image_stream.h"
+
+ImageStream::ImageStream(size_t window, size_t retained, size_t maxSessions, uint32_t timeoutMs)
+    : window(window), retained(retained), maxSessions(maxSessions), timeoutMs(timeoutMs) {}
+
+ImageStream::~ImageStream() {
+   for (auto record : records) {
+      delete[] record;
+   }
+}
+
+size_t ImageStream::RequestsNeeded() const {
+   uint32_t nextSeq = firstSeq + records.size();
+   uint32_t requestedEnd = nextSeq + inFlight;
+   size_t used = records.size() + inFlight;
+   size_t capacity = (retained > used) ? retained - used : 0;
+
+   size_t needed = 0;
+   for (auto &session : sessions) {
+      if (session.pending) {
+         // The stream has to move on to the next pass before this session can start.
+         needed = capacity;
+         continue;
+      }
+
+      bool endReceived = false;
+      for (uint32_t seq = session.cursor; seq < nextSeq; seq++) {
+         if (records[seq - firstSeq] == nullptr) {
+            endReceived = true;
+            break;
+         }
+      }
+
+      uint32_t target = session.cursor + window;
+      if (!endReceived && target > requestedEnd && target - requestedEnd > needed) {
+         needed = target - requestedEnd;
+      }
+   }
+
+   return (needed < capacity) ? needed : capacity;
+}
+
+void ImageStream::RequestSent(uint32_t now) {
+   if (inFlight == 0) {
+      lastAnswer = now;
+   }
+   inFlight++;
+}
+
+void ImageStream::Received(char *image, uint32_t now) {
+   lastAnswer = now;
+   records.push_back(image);
+   if (inFlight > 0) {
+      inFlight--;
+   }
+
+   if (image == nullptr) {
+      passStart = firstSeq + records.size();
+      for (auto &session : sessions) {
+         if (session.pending) {
+            session.pending = false;
+            session.cursor = passStart;
+         }
+      }
+   }
+
+   Trim();
+}
+
+void ImageStream::Dropped() {
+   if (inFlight > 0) {
+      inFlight--;
+   }
+   Trim();
+}
+
+bool ImageStream::ExpireRequests(uint32_t now) {
+   if (inFlight == 0 || (uint32_t)(now - lastAnswer) <= timeoutMs) {
+      return false;
+   }
+
+   Reset();
+   return true;
+}
+
+void ImageStream::Reset() {
+   for (auto record : records) {
+      delete[] record;
+   }
+   firstSeq += records.size();
+   records.clear();
+   passStart = firstSeq;
+   inFlight = 0;
+   sessions.clear();
+}
+
+uint32_t ImageStream::OpenSession(uint32_t now) {
+   Expire(now);
+   if (maxSessions == 0) {
+      return DefaultSession;
+   }
+
+   if (sessions.size() >= maxSessions) {
+      // Make room by ending the session that has been idle the longest.
+      auto oldest = sessions.begin();
+      for (auto it = sessions.begin(); it != sessions.end(); it++) {
+         if ((uint32_t)(now - it->lastUsed) > (uint32_t)(now - oldest->lastUsed)) {
+            oldest = it;
+         }
+      }
+      sessions.erase(oldest);
+   }
+
+   uint32_t token = nextToken++;
+   if (nextToken == DefaultSession) {
+      nextToken++;
+   }
+   Start(token, now);
+   return token;
+}
+
+ImageStream::Result ImageStream::Peek(uint32_t token, uint32_t now, const char **image) {
+   Expire(now);
+   Session *session = Find(token);
+   if (session == nullptr) {
+      if (token != DefaultSession) {
+         return Result::Expired;
+      }
+      session = Start(token, now);
+   }
+
+   session->lastUsed = now;
+   if (session->pending || session->cursor >= firstSeq + records.size()) {
+      return Result::Wait;
+   }
+
+   char *record = records[session->cursor - firstSeq];
+   if (record == nullptr) {
+      return Result::Done;
+   }
+
+   *image = record;
+   return Result::Image;
+}
+
+void ImageStream::Advance(uint32_t token) {
+   Session *session = Find(token);
+   if (session != nullptr && !session->pending && session->cursor < firstSeq + records.size()) {
+      session->cursor++;
+      Trim();
+   }
+}
+
+void ImageStream::Close(uint32_t token) {
+   for (auto it = sessions.begin(); it != sessions.end(); it++) {
+      if (it->token == token) {
+         sessions.erase(it);
+         Trim();
+         return;
+      }
+   }
+}
+
+ImageStream::Session *ImageStream::Find(uint32_t token) {
+   for (auto &session : sessions) {
+      if (session.token == token) {
+         return &session;
+      }
+   }
+   return nullptr;
+}
+
+/**
+   Starts a session at the beginning of the current pass if it is still
+   retained, otherwise at the beginning of the next one.
+ */
+ImageStream::Session *ImageStream::Start(uint32_t token, uint32_t now) {
+   Session session;
+   session.token = token;
+   session.cursor = passStart;
+   session.pending = passStart < firstSeq;
+   session.lastUsed = now;
+   sessions.push_back(session);
+   return &sessions.back();
+}
+
+void ImageStream::Expire(uint32_t now) {
+   if (ExpireRequests(now)) {
+      return;
+   }
+
+   bool expired = false;
+   for (auto it = sessions.begin(); it != sessions.end();) {
+      if ((uint32_t)(now - it->lastUsed) > timeoutMs) {
+         it = sessions.erase(it);
+         expired = true;
+      } else {
+         it++;
+      }
+   }
+
+   if (expired) {
+      Trim();
+   }
+}
+
+/**
+   Frees the images every session has moved past. The start of the current
+   pass is kept for sessions that start later, unless it would take room
+   needed to keep the window of the running sessions filled.
+ */
+void ImageStream::Trim() {
+   uint32_t nextSeq = firstSeq + records.size();
+   uint32_t keepFrom = nextSeq;
+   for (auto &session : sessions) {
+      if (!session.pending && session.cursor < keepFrom) {
+         keepFrom = session.cursor;
+      }
+   }
+
+   if (passStart >= firstSeq && passStart < keepFrom && nextSeq + inFlight - passStart + window <= retained) {
+      keepFrom = passStart;
+   }
+
+   while (firstSeq < keepFrom && !records.empty()) {
+      delete[] records.front();
+      records.pop_front();
+      firstSeq++;
+   }
+}
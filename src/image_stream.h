@@ -0,0 +1,159 @@
+/**
+ * ZuluIDE™ - Copyright (c) 2023 Rabbit Hole Computing™
+ *
+ * ZuluIDE™ firmware is licensed under the GPL version 3 or any later version.
+ *
+ * https://www.gnu.org/licenses/gpl-3.0.html
+ * ----
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ **/
+
+#ifndef IMAGE_STREAM_H
+#define IMAGE_STREAM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+/**
+   Shares the images returned by iterate requests between several clients.
+   The server answers iterate requests with the images in order, then an end
+   of list marker, and then starts over. Every client iterates through a
+   session that has its own cursor into this stream, so sessions started at
+   about the same time are served from the same images and the server only
+   sends each image once for all of them.
+ */
+class ImageStream {
+  public:
+   enum class Result { Image,
+                       Wait,
+                       Done,
+                       Expired };
+
+   /**
+      Token of the session used by clients that do not ask for one.
+    */
+   static const uint32_t DefaultSession = 0;
+
+   /**
+      window is the number of images requested ahead of the fastest session,
+      retained is the most images kept in memory or in flight at any time.
+    */
+   ImageStream(size_t window, size_t retained, size_t maxSessions, uint32_t timeoutMs);
+   ~ImageStream();
+
+   /**
+      Number of iterate requests that should be sent now.
+    */
+   size_t RequestsNeeded() const;
+
+   /**
+      Records that an iterate request was sent at now.
+    */
+   void RequestSent(uint32_t now);
+
+   /**
+      Number of iterate requests that have not been answered yet.
+    */
+   size_t InFlight() const { return inFlight; }
+
+   /**
+      Adds the answer to the oldest request in flight, taking ownership of
+      image, or NULL for the end of list marker.
+    */
+   void Received(char *image, uint32_t now);
+
+   /**
+      Forgets an iterate request that was dropped before it was sent.
+    */
+   void Dropped();
+
+   /**
+      Drops every image and session like Reset when the requests in flight
+      have not been answered for the session timeout, as the server lost
+      them. Returns true if it did.
+    */
+   bool ExpireRequests(uint32_t now);
+
+   /**
+      Drops every image and session, e.g. after the requests in flight were lost.
+    */
+   void Reset();
+
+   /**
+      Starts a new session and returns its token, or DefaultSession if none is available.
+    */
+   uint32_t OpenSession(uint32_t now);
+
+   /**
+      Reports what the session sees next. For Result::Image the image is
+      stored in image and stays valid until Advance or Close is called.
+      The default session is created when it does not exist.
+    */
+   Result Peek(uint32_t token, uint32_t now, const char **image);
+
+   /**
+      Moves the session past the image returned by Peek.
+    */
+   void Advance(uint32_t token);
+
+   /**
+      Ends the session.
+    */
+   void Close(uint32_t token);
+
+   /**
+      Number of images currently held in memory.
+    */
+   size_t Retained() const { return records.size(); }
+
+   /**
+      Number of open sessions.
+    */
+   size_t Sessions() const { return sessions.size(); }
+
+  private:
+   struct Session {
+      uint32_t token;
+      // Sequence number of the next image for this session.
+      uint32_t cursor;
+      // Waiting for the start of the next pass, as the current one is no longer retained.
+      bool pending;
+      uint32_t lastUsed;
+   };
+
+   Session *Find(uint32_t token);
+   Session *Start(uint32_t token, uint32_t now);
+   void Expire(uint32_t now);
+   void Trim();
+
+   size_t window;
+   size_t retained;
+   size_t maxSessions;
+   uint32_t timeoutMs;
+   uint32_t nextToken = 1;
+
+   // Received answers starting with sequence number firstSeq, NULL marks the end of the list.
+   std::deque<char *> records;
+   uint32_t firstSeq = 0;
+   // Sequence number of the first image after the last end of list marker received.
+   uint32_t passStart = 0;
+   size_t inFlight = 0;
+   // Time of the last answer, or of the request sent when none were in flight.
+   uint32_t lastAnswer = 0;
+   std::vector<Session> sessions;
+};
+
+#endif
@@ -0,0 +1,77 @@
+/**
+ * ZuluIDE™ - Copyright (c) 2023 Rabbit Hole Computing™
+ *
+ * ZuluIDE™ firmware is licensed under the GPL version 3 or any later version.
+ *
+ * https://www.gnu.org/licenses/gpl-3.0.html
+ * ----
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ **/
+
+#include "json_scan.h"
+
+const char *JsonSkipSpace(const char *p, const char *end) {
+   while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) {
+      p++;
+   }
+   return p;
+}
+
+const char *JsonSkipString(const char *p, const char *end) {
+   for (p++; p < end; p++) {
+      if (*p == '\\') {
+         p++;
+      } else if (*p == '"') {
+         return p + 1;
+      }
+   }
+   return nullptr;
+}
+
+const char *JsonSkipValue(const char *p, const char *end) {
+   int depth = 0;
+   while (p < end) {
+      switch (*p) {
+      case '"':
+         p = JsonSkipString(p, end);
+         if (p == nullptr) {
+            return nullptr;
+         }
+         if (depth == 0) {
+            return p;
+         }
+         continue;
+      case '{':
+      case '[':
+         depth++;
+         break;
+      case '}':
+      case ']':
+         if (depth == 0) {
+            return p;
+         }
+         if (--depth == 0) {
+            return p + 1;
+         }
+         break;
+      case ',':
+         if (depth == 0) {
+            return p;
+         }
+         break;
+      }
+      p++;
+   }
+   return (depth == 0) ? p : nullptr;
+}
@@ -0,0 +1,44 @@
+/**
+ * ZuluIDE™ - Copyright (c) 2023 Rabbit Hole Computing™
+ *
+ * ZuluIDE™ firmware is licensed under the GPL version 3 or any later version.
+ *
+ * https://www.gnu.org/licenses/gpl-3.0.html
+ * ----
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ **/
+
+#ifndef JSON_SCAN_H
+#define JSON_SCAN_H
+
+/**
+   Returns the end of the whitespace starting at p. These helpers walk JSON
+   text ending at end without decoding it.
+ */
+const char *JsonSkipSpace(const char *p, const char *end);
+
+/**
+   Returns the end of the string whose opening quote is at p, or nullptr if it
+   is not terminated.
+ */
+const char *JsonSkipString(const char *p, const char *end);
+
+/**
+   Returns the end of the JSON value starting at p, or nullptr if it is not
+   terminated. Nested objects and arrays are skipped as a whole. A value ends
+   before a comma or closing bracket that is not nested in it.
+ */
+const char *JsonSkipValue(const char *p, const char *end);
+
+#endif
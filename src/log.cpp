@@ -0,0 +1,92 @@
+/**
+ * ZuluIDE™ - Copyright (c) 2023 Rabbit Hole Computing™
+ *
+ * ZuluIDE™ firmware is licensed under the GPL version 3 or any later version.
+ *
+ * https://www.gnu.org/licenses/gpl-3.0.html
+ * ----
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ **/
+
+#include "log.h"
+
+#include <hardware/sync.h>
+#include <hardware/timer.h>
+#include <pico/platform.h>
+
+#include <cstdio>
+
+// Number of messages each core can log before they are drained.
+#ifndef LOG_RING_ENTRIES
+#define LOG_RING_ENTRIES 64
+#endif
+
+static LogEntry logEntries[NUM_CORES][LOG_RING_ENTRIES];
+static LogRing logRings[NUM_CORES] = {
+   LogRing(logEntries[0], LOG_RING_ENTRIES),
+   LogRing(logEntries[1], LOG_RING_ENTRIES)
+};
+
+LogEntry *LogReserve(uint8_t level, const char *format) {
+   uint core = get_core_num();
+   // Keeps handlers on this core from reserving at the same time, and the
+   // timestamps of a ring in order.
+   uint32_t saved_irq = save_and_disable_interrupts();
+   LogEntry *entry = logRings[core].Reserve();
+   uint32_t now = time_us_32();
+   restore_interrupts(saved_irq);
+
+   if (entry) {
+      entry->timeUs = now;
+      entry->level = level;
+      entry->core = core;
+      entry->format = format;
+   }
+   return entry;
+}
+
+void LogCommit(LogEntry *entry) {
+   logRings[entry->core].Commit(entry);
+}
+
+void LogDrain(size_t max) {
+   static const char *const levels[] = {"D", "I", "W", "E"};
+   for (uint core = 0; core < NUM_CORES; core++) {
+      uint32_t dropped = logRings[core].TakeDropped();
+      if (dropped > 0) {
+         printf("[core %u] %lu log messages dropped\n", core, (unsigned long)dropped);
+      }
+   }
+
+   for (size_t i = 0; i < max; i++) {
+      const LogEntry *entry = nullptr;
+      uint core = 0;
+      for (uint ring = 0; ring < NUM_CORES; ring++) {
+         const LogEntry *next = logRings[ring].Peek();
+         if (next && (entry == nullptr || (int32_t)(next->timeUs - entry->timeUs) < 0)) {
+            entry = next;
+            core = ring;
+         }
+      }
+
+      if (entry == nullptr) {
+         return;
+      }
+
+      printf("[%5lu.%06lu %u %s] ", (unsigned long)(entry->timeUs / 1000000), (unsigned long)(entry->timeUs % 1000000),
+             core, levels[entry->level]);
+      printf(entry->format, entry->Arg(0), entry->Arg(1), entry->Arg(2), entry->Arg(3));
+      logRings[core].Pop();
+   }
+}
@@ -0,0 +1,82 @@
+/**
+ * ZuluIDE™ - Copyright (c) 2023 Rabbit Hole Computing™
+ *
+ * ZuluIDE™ firmware is licensed under the GPL version 3 or any later version.
+ *
+ * https://www.gnu.org/licenses/gpl-3.0.html
+ * ----
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ **/
+
+#ifndef LOG_H
+#define LOG_H
+
+#include "log_ring.h"
+
+#define LOG_LEVEL_DEBUG 0
+#define LOG_LEVEL_INFO  1
+#define LOG_LEVEL_WARN  2
+#define LOG_LEVEL_ERROR 3
+#define LOG_LEVEL_NONE  4
+
+// Messages below this level are removed at compile time.
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+/**
+   Reserves an entry in the log ring of the calling core and stamps it with
+   the time, level and format, or returns nullptr if the ring is full. Safe to
+   call from interrupt handlers.
+ */
+LogEntry *LogReserve(uint8_t level, const char *format);
+
+/**
+   Hands an entry returned by LogReserve over to LogDrain.
+ */
+void LogCommit(LogEntry *entry);
+
+/**
+   Prints up to max logged messages to stdio, oldest first across both
+   cores. Called from the main loop so printing does not delay the code that
+   logs.
+ */
+void LogDrain(size_t max);
+
+template <typename... Args>
+inline void LogWrite(uint8_t level, const char *format, Args... args) {
+   LogEntry *entry = LogReserve(level, format);
+   if (entry) {
+      entry->Capture(0, args...);
+      LogCommit(entry);
+   }
+}
+
+/**
+   Logs a message printf style. The format must be a string literal and the
+   arguments integers, pointers or strings; at most LOG_ARGS_MAX are kept.
+ */
+#define LOG_AT(level, ...)                  \
+   do {                                     \
+      if ((level) >= LOG_LEVEL) {           \
+         LogWrite((level), __VA_ARGS__);    \
+      }                                     \
+   } while (0)
+
+#define LOG_DEBUG(...) LOG_AT(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#define LOG_INFO(...) LOG_AT(LOG_LEVEL_INFO, __VA_ARGS__)
+#define LOG_WARN(...) LOG_AT(LOG_LEVEL_WARN, __VA_ARGS__)
+#define LOG_ERROR(...) LOG_AT(LOG_LEVEL_ERROR, __VA_ARGS__)
+
+#endif
@@ -0,0 +1,176 @@
+/**
+ * ZuluIDE™ - Copyright (c) 2023 Rabbit Hole Computing™
+ *
+ * ZuluIDE™ firmware is licensed under the GPL version 3 or any later version.
+ *
+ * https://www.gnu.org/licenses/gpl-3.0.html
+ * ----
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ **/
+
+#include "log_aggregator.h"
+
+#include <cstdio>
+#include <cstring>
+
+// Tokens are counted in units of 1/60000 of a line, so a bucket gains
+// perMinute units every millisecond.
+static const uint32_t LINE_COST = 60000;
+
+LogAggregator::LogAggregator(const Config *configs, uint32_t holdMs, Sink sink) : holdMs(holdMs), sink(sink) {
+   for (int i = 0; i < LOG_AGGREGATOR_TYPES; i++) {
+      Channel &channel = channels[i];
+      channel.config = configs[i];
+      channel.length = 0;
+      channel.startMs = 0;
+      channel.last[0] = 0;
+      channel.lastMs = 0;
+      channel.repeats = 0;
+      channel.tokens = channel.config.burst * LINE_COST;
+      channel.refillMs = 0;
+      channel.suppressed = 0;
+   }
+}
+
+void LogAggregator::Add(int type, const char *line, uint32_t nowMs) {
+   if (type < 0 || type >= LOG_AGGREGATOR_TYPES) {
+      return;
+   }
+   Channel &channel = channels[type];
+
+   size_t length = strnlen(line, LOG_AGGREGATOR_LINE_SIZE - 1);
+   while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r')) {
+      length--;
+   }
+   if (length == 0) {
+      return;
+   }
+
+   if (channel.last[0] != 0 && strlen(channel.last) == length && memcmp(channel.last, line, length) == 0) {
+      channel.repeats++;
+      channel.lastMs = nowMs;
+      return;
+   }
+   FlushRepeats(channel, nowMs);
+
+   Refill(channel, nowMs);
+   if (channel.tokens < LINE_COST) {
+      channel.suppressed++;
+      dropped++;
+      // Repeats of a dropped line are rate limited like any other line.
+      channel.last[0] = 0;
+      return;
+   }
+   channel.tokens -= LINE_COST;
+
+   if (channel.suppressed > 0) {
+      char note[48];
+      int noteLength = snprintf(note, sizeof(note), "%lu messages suppressed", (unsigned long)channel.suppressed);
+      if (Append(channel, note, noteLength, nowMs)) {
+         channel.suppressed = 0;
+      }
+   }
+
+   if (!Append(channel, line, length, nowMs)) {
+      channel.suppressed++;
+      dropped++;
+      channel.last[0] = 0;
+      return;
+   }
+
+   memcpy(channel.last, line, length);
+   channel.last[length] = 0;
+   channel.lastMs = nowMs;
+}
+
+void LogAggregator::Poll(uint32_t nowMs) {
+   for (auto &channel : channels) {
+      if (channel.repeats > 0 && (uint32_t)(nowMs - channel.lastMs) >= holdMs) {
+         FlushRepeats(channel, nowMs);
+      }
+
+      if (channel.length > 0 && (uint32_t)(nowMs - channel.startMs) >= holdMs) {
+         Send(channel);
+      }
+   }
+}
+
+void LogAggregator::Refill(Channel &channel, uint32_t nowMs) {
+   uint32_t capacity = channel.config.burst * LINE_COST;
+   uint32_t elapsed = nowMs - channel.refillMs;
+   channel.refillMs = nowMs;
+   if (channel.config.perMinute == 0) {
+      return;
+   }
+
+   // Limit the elapsed time so the refill cannot overflow.
+   if (elapsed > capacity / channel.config.perMinute) {
+      elapsed = capacity / channel.config.perMinute;
+   }
+   channel.tokens += elapsed * channel.config.perMinute;
+   if (channel.tokens > capacity) {
+      channel.tokens = capacity;
+   }
+}
+
+void LogAggregator::FlushRepeats(Channel &channel, uint32_t nowMs) {
+   if (channel.repeats == 0) {
+      return;
+   }
+
+   char note[48];
+   int noteLength = snprintf(note, sizeof(note), "last message repeated %lu times", (unsigned long)channel.repeats);
+   if (Append(channel, note, noteLength, nowMs)) {
+      channel.repeats = 0;
+   }
+   // Lines after the count are not repeats of the counted line.
+   channel.last[0] = 0;
+}
+
+bool LogAggregator::Append(Channel &channel, const char *text, size_t length, uint32_t nowMs) {
+   // The prefix, a separator and the terminator need room as well.
+   const size_t maxLength = LOG_AGGREGATOR_FRAME_SIZE - 3;
+   if (length > maxLength) {
+      length = maxLength;
+   }
+
+   size_t needed = ((channel.length > 1) ? 1 : 0) + length;
+   if (channel.length > 0 && channel.length + needed + 1 > LOG_AGGREGATOR_FRAME_SIZE) {
+      if (!Send(channel)) {
+         return false;
+      }
+   }
+
+   if (channel.length == 0) {
+      channel.frame[0] = channel.config.prefix;
+      channel.length = 1;
+      channel.startMs = nowMs;
+   } else {
+      channel.frame[channel.length++] = '\n';
+   }
+   memcpy(channel.frame + channel.length, text, length);
+   channel.length += length;
+   channel.frame[channel.length] = 0;
+   return true;
+}
+
+bool LogAggregator::Send(Channel &channel) {
+   channel.frame[channel.length] = 0;
+   if (!sink(channel.frame, channel.length)) {
+      return false;
+   }
+
+   channel.length = 0;
+   return true;
+}
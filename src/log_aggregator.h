@@ -0,0 +1,116 @@
+/**
+ * ZuluIDE™ - Copyright (c) 2023 Rabbit Hole Computing™
+ *
+ * ZuluIDE™ firmware is licensed under the GPL version 3 or any later version.
+ *
+ * https://www.gnu.org/licenses/gpl-3.0.html
+ * ----
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ **/
+
+#ifndef LOG_AGGREGATOR_H
+#define LOG_AGGREGATOR_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Number of message types, each sent in frames of its own.
+#ifndef LOG_AGGREGATOR_TYPES
+#define LOG_AGGREGATOR_TYPES 2
+#endif
+
+// Largest frame, including the type prefix and the terminator.
+#ifndef LOG_AGGREGATOR_FRAME_SIZE
+#define LOG_AGGREGATOR_FRAME_SIZE 512
+#endif
+
+// Longer lines are truncated.
+#ifndef LOG_AGGREGATOR_LINE_SIZE
+#define LOG_AGGREGATOR_LINE_SIZE 128
+#endif
+
+/**
+   Collects log lines into frames for the I2C server without allocating
+   memory. A frame holds the prefix character of its type followed by lines
+   separated by newlines, and is handed to the sink once it is full or its
+   oldest line has waited holdMs. Each type is rate limited with a token
+   bucket; lines over the limit are dropped and counted in a note sent with
+   the next line that is let through. A line repeating the previous one of
+   its type is counted instead of sent, and the count is sent once a
+   different line arrives or holdMs passes.
+ */
+class LogAggregator {
+  public:
+   struct Config {
+      // Character the server uses to tell the type of the frame.
+      char prefix;
+      // Lines that can be sent at once after a quiet period.
+      uint16_t burst;
+      // Lines per minute sent on average once the burst is used up.
+      uint16_t perMinute;
+   };
+
+   /**
+      Sends a NUL terminated frame of length bytes, returning false if it
+      cannot be sent now, in which case it is offered again later.
+    */
+   typedef bool (*Sink)(const char *frame, size_t length);
+
+   /**
+      configs holds LOG_AGGREGATOR_TYPES entries, one for each type.
+    */
+   LogAggregator(const Config *configs, uint32_t holdMs, Sink sink);
+
+   /**
+      Adds a line of the given type logged at nowMs. Trailing newlines are
+      removed.
+    */
+   void Add(int type, const char *line, uint32_t nowMs);
+
+   /**
+      Sends the frames and repeat counts that are due. Called regularly.
+    */
+   void Poll(uint32_t nowMs);
+
+   /**
+      Total number of lines dropped by rate limiting or a full frame.
+    */
+   uint32_t Dropped() const { return dropped; }
+
+  private:
+   struct Channel {
+      Config config;
+      char frame[LOG_AGGREGATOR_FRAME_SIZE];
+      size_t length;
+      uint32_t startMs;
+      char last[LOG_AGGREGATOR_LINE_SIZE];
+      uint32_t lastMs;
+      uint32_t repeats;
+      uint32_t tokens;
+      uint32_t refillMs;
+      uint32_t suppressed;
+   };
+
+   void Refill(Channel &channel, uint32_t nowMs);
+   void FlushRepeats(Channel &channel, uint32_t nowMs);
+   bool Append(Channel &channel, const char *text, size_t length, uint32_t nowMs);
+   bool Send(Channel &channel);
+
+   Channel channels[LOG_AGGREGATOR_TYPES];
+   uint32_t holdMs;
+   Sink sink;
+   uint32_t dropped = 0;
+};
+
+#endif
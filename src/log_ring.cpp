@@ -0,0 +1,89 @@
+/**
+ * ZuluIDE™ - Copyright (c) 2023 Rabbit Hole Computing™
+ *
+ * ZuluIDE™ firmware is licensed under the GPL version 3 or any later version.
+ *
+ * https://www.gnu.org/licenses/gpl-3.0.html
+ * ----
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ **/
+
+#include "log_ring.h"
+
+#include <cstring>
+
+void LogEntry::CaptureString(int index, const char *value) {
+   size_t length = value ? strlen(value) : 0;
+   size_t space = LOG_TEXT_SIZE - textUsed;
+   if (space == 0) {
+      // No room left, point at the terminator of the previous string.
+      args[index] = LOG_TEXT_SIZE - 1;
+   } else {
+      if (length >= space) {
+         length = space - 1;
+      }
+      if (length > 0) {
+         memcpy(text + textUsed, value, length);
+      }
+      text[textUsed + length] = 0;
+      args[index] = textUsed;
+      textUsed += length + 1;
+   }
+   stringArgs |= 1 << index;
+}
+
+LogEntry *LogRing::Reserve() {
+   if (head - tail >= count) {
+      dropped = dropped + 1;
+      return nullptr;
+   }
+
+   LogEntry *entry = &entries[head % count];
+   head = head + 1;
+   entry->stringArgs = 0;
+   entry->textUsed = 0;
+   return entry;
+}
+
+void LogRing::Commit(LogEntry *entry) {
+   // The entry must be complete before the reader sees it as ready.
+   __sync_synchronize();
+   entry->ready = 1;
+}
+
+const LogEntry *LogRing::Peek() const {
+   if (tail == head) {
+      return nullptr;
+   }
+
+   const LogEntry *entry = &entries[tail % count];
+   if (!entry->ready) {
+      return nullptr;
+   }
+   __sync_synchronize();
+   return entry;
+}
+
+void LogRing::Pop() {
+   entries[tail % count].ready = 0;
+   __sync_synchronize();
+   tail = tail + 1;
+}
+
+uint32_t LogRing::TakeDropped() {
+   uint32_t total = dropped;
+   uint32_t result = total - droppedReported;
+   droppedReported = total;
+   return result;
+}
@@ -0,0 +1,138 @@
+/**
+ * ZuluIDE™ - Copyright (c) 2023 Rabbit Hole Computing™
+ *
+ * ZuluIDE™ firmware is licensed under the GPL version 3 or any later version.
+ *
+ * https://www.gnu.org/licenses/gpl-3.0.html
+ * ----
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ **/
+
+#ifndef LOG_RING_H
+#define LOG_RING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#ifndef LOG_ARGS_MAX
+#define LOG_ARGS_MAX 4
+#endif
+
+#ifndef LOG_TEXT_SIZE
+#define LOG_TEXT_SIZE 32
+#endif
+
+/**
+   Log message stored in binary form. The format string is kept as a pointer,
+   so it must be a string literal, and formatting is deferred until the entry
+   is drained. Integer and pointer arguments are stored as they are, while
+   string arguments are copied into text, truncated if they do not fit.
+ */
+struct LogEntry {
+   uint32_t timeUs;
+   uint8_t level;
+   uint8_t core;
+   // Bit i is set if args[i] is the offset of a string stored in text.
+   uint8_t stringArgs;
+   // Bytes of text used by string arguments.
+   uint8_t textUsed;
+   volatile uint8_t ready;
+   const char *format;
+   uintptr_t args[LOG_ARGS_MAX];
+   char text[LOG_TEXT_SIZE];
+
+   /**
+      Stores the arguments of a log call from argument index on.
+    */
+   void Capture(int) {}
+
+   template <typename T, typename... Rest>
+   void Capture(int index, T value, Rest... rest) {
+      static_assert(sizeof...(Rest) < LOG_ARGS_MAX, "Too many log arguments");
+      static_assert((std::is_integral<T>::value || std::is_enum<T>::value || std::is_pointer<T>::value) &&
+                    sizeof(T) <= sizeof(uintptr_t), "Log arguments must be integers, pointers or strings");
+      args[index] = (uintptr_t)value;
+      Capture(index + 1, rest...);
+   }
+
+   template <typename... Rest>
+   void Capture(int index, const char *value, Rest... rest) {
+      CaptureString(index, value);
+      Capture(index + 1, rest...);
+   }
+
+   template <typename... Rest>
+   void Capture(int index, char *value, Rest... rest) {
+      CaptureString(index, value);
+      Capture(index + 1, rest...);
+   }
+
+   /**
+      Returns argument index as it should be passed to printf.
+    */
+   uintptr_t Arg(int index) const {
+      return (stringArgs & (1 << index)) ? (uintptr_t)(text + args[index]) : args[index];
+   }
+
+   void CaptureString(int index, const char *value);
+};
+
+/**
+   Fixed size ring of log entries with a single writer and a single reader,
+   which may run on different cores. Writers that can interrupt each other,
+   such as code and interrupt handlers on the same core, must not be inside
+   Reserve at the same time. Entries are read in the order they are reserved;
+   a reserved entry that is not committed yet holds back the later ones.
+ */
+class LogRing {
+  public:
+   LogRing(LogEntry *entries, size_t count) : entries(entries), count(count) {}
+
+   /**
+      Returns the next free entry, or nullptr if the ring is full, in which
+      case the message is counted as dropped.
+    */
+   LogEntry *Reserve();
+
+   /**
+      Makes an entry returned by Reserve available to the reader.
+    */
+   void Commit(LogEntry *entry);
+
+   /**
+      Returns the oldest committed entry without removing it, or nullptr.
+    */
+   const LogEntry *Peek() const;
+
+   /**
+      Removes the entry returned by Peek.
+    */
+   void Pop();
+
+   /**
+      Returns the number of messages dropped since the last call and resets it.
+    */
+   uint32_t TakeDropped();
+
+  private:
+   LogEntry *entries;
+   size_t count;
+   volatile uint32_t head = 0;
+   volatile uint32_t tail = 0;
+   volatile uint32_t dropped = 0;
+   uint32_t droppedReported = 0;
+};
+
+#endif
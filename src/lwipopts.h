@@ -36,9 +36,9 @@
 #define LWIP_NETIF_LINK_CALLBACK    1
 #define LWIP_NETIF_HOSTNAME         1
 #define LWIP_NETCONN                0
-#define MEM_STATS                   0
+#define MEM_STATS                   1
 #define SYS_STATS                   0
-#define MEMP_STATS                  0
+#define MEMP_STATS                  1
 #define LINK_STATS                  0
 // #define ETH_PAD_SIZE                2
 #define LWIP_CHKSUM_ALGORITHM       3
@@ -57,10 +57,15 @@
 #define LWIP_HTTPD_DYNAMIC_HEADERS  1
 #define LWIP_HTTPD_FILE_EXTENSION   1
 #define LWIP_HTTPD_SUPPORT_POST     1
+// The firmware upload opens the TCP window as its data is written to flash.
+#define LWIP_HTTPD_POST_MANUAL_WND  1
+#define HTTPD_ADDITIONAL_CONTENT_TYPES {"cbor", HTTP_CONTENT_TYPE("application/cbor")}
+
+// Memory statistics are reported by /metrics.
+#define LWIP_STATS                  1
 
 #ifndef NDEBUG
 #define LWIP_DEBUG                  1
-#define LWIP_STATS                  1
 #define LWIP_STATS_DISPLAY          1
 #endif
 
@@ -0,0 +1,83 @@
+/**
+ * ZuluIDE™ - Copyright (c) 2023 Rabbit Hole Computing™
+ *
+ * ZuluIDE™ firmware is licensed under the GPL version 3 or any later version.
+ *
+ * https://www.gnu.org/licenses/gpl-3.0.html
+ * ----
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ **/
+
+#include "lzss_decoder.h"
+
+#include <cstring>
+
+#define LZSS_WINDOW_MASK ((1u << LZSS_WINDOW_BITS) - 1)
+#define LZSS_LITERAL_BITS 9
+#define LZSS_REFERENCE_BITS (1 + LZSS_WINDOW_BITS + LZSS_LOOKAHEAD_BITS)
+
+void LzssDecoder::Reset() {
+   memset(window, 0, sizeof(window));
+   position = 0;
+   bits = 0;
+   bitCount = 0;
+   outputSize = 0;
+}
+
+bool LzssDecoder::Feed(const uint8_t *input, size_t length, Sink sink, void *context) {
+   for (size_t i = 0; i < length; i++) {
+      bits = (bits << 8) | input[i];
+      bitCount += 8;
+
+      while (bitCount > 0) {
+         bool literal = (bits >> (bitCount - 1)) & 1;
+         int needed = literal ? LZSS_LITERAL_BITS : LZSS_REFERENCE_BITS;
+         if (bitCount < needed) {
+            break;
+         }
+
+         uint32_t symbol = (bits >> (bitCount - needed)) & ((1u << needed) - 1);
+         bitCount -= needed;
+         bits &= (1u << bitCount) - 1;
+
+         uint32_t distance = 0;
+         uint32_t count = 1;
+         if (!literal) {
+            distance = ((symbol >> LZSS_LOOKAHEAD_BITS) & LZSS_WINDOW_MASK) + 1;
+            count = (symbol & ((1u << LZSS_LOOKAHEAD_BITS) - 1)) + 1;
+         }
+
+         for (uint32_t j = 0; j < count; j++) {
+            uint8_t byte = literal ? (uint8_t)symbol : window[(position - distance) & LZSS_WINDOW_MASK];
+            window[position & LZSS_WINDOW_MASK] = byte;
+            position++;
+
+            output[outputSize++] = byte;
+            if (outputSize == sizeof(output)) {
+               outputSize = 0;
+               if (!sink(context, output, sizeof(output))) {
+                  return false;
+               }
+            }
+         }
+      }
+   }
+
+   if (outputSize > 0) {
+      size_t size = outputSize;
+      outputSize = 0;
+      return sink(context, output, size);
+   }
+   return true;
+}
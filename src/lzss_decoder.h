@@ -0,0 +1,75 @@
+/**
+ * ZuluIDE™ - Copyright (c) 2023 Rabbit Hole Computing™
+ *
+ * ZuluIDE™ firmware is licensed under the GPL version 3 or any later version.
+ *
+ * https://www.gnu.org/licenses/gpl-3.0.html
+ * ----
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ **/
+
+#ifndef LZSS_DECODER_H
+#define LZSS_DECODER_H
+
+#include <cstddef>
+#include <cstdint>
+
+#define LZSS_WINDOW_BITS 10
+#define LZSS_LOOKAHEAD_BITS 4
+
+/**
+   Streaming decoder for LZSS data in the heatshrink format, with a window of
+   2^LZSS_WINDOW_BITS bytes and matches of up to 2^LZSS_LOOKAHEAD_BITS bytes.
+   Each symbol starts with a flag bit: 1 is followed by a literal byte, and 0
+   by the distance back into the window minus one and the match length minus
+   one, all most significant bit first. The window starts out as zeros.
+   Input can be fed in pieces of any size, and the output is passed to a sink
+   as it is produced.
+ */
+class LzssDecoder {
+  public:
+   /**
+      Receives decoded bytes, returns false to stop decoding.
+    */
+   typedef bool (*Sink)(void *context, const uint8_t *data, size_t length);
+
+   LzssDecoder() { Reset(); }
+
+   void Reset();
+
+   /**
+      Decodes the input, passing the output to sink. Returns false if the
+      sink stopped decoding.
+    */
+   bool Feed(const uint8_t *input, size_t length, Sink sink, void *context);
+
+   /**
+      Number of bytes decoded since Reset().
+    */
+   uint32_t Decoded() const { return position; }
+
+  private:
+   uint8_t window[1 << LZSS_WINDOW_BITS];
+   uint32_t position;
+
+   // Input bits that do not make a whole symbol yet
+   uint32_t bits;
+   int bitCount;
+
+   // Decoded bytes are passed to the sink in pieces
+   uint8_t output[64];
+   size_t outputSize;
+};
+
+#endif
@@ -29,6 +29,7 @@
 #include <cstdio>
 #include <cstdarg>
 #include <cstring>
+#include <malloc.h>
 #include <string>
 #include <vector>
 
@@ -43,8 +44,22 @@
 #include "lwip/init.h"
 #include "lwip/netif.h"
 #include "lwip/dhcp.h"
+#include "lwip/memp.h"
+#include "lwip/stats.h"
 #include "pico/cyw43_arch.h"
 #include "url_decode.h"
+#include "filename_index.h"
+#include "arena.h"
+#include "image_stream.h"
+#include "snapshot.h"
+#include "status_model.h"
+#include "cbor.h"
+#include "batch_request.h"
+#include "command_tracker.h"
+#include "log.h"
+#include "log_aggregator.h"
+#include "metrics.h"
+#include "trace.h"
 
 static const uint I2C_SLAVE_ADDRESS = 0x45;
 static const uint I2C_BAUDRATE = 400000;  // 100 kHz
@@ -52,6 +67,84 @@ static const uint I2C_BAUDRATE = 400000;  // 100 kHz
 static const uint I2C_SLAVE_SDA_PIN = 0;  // PICO_DEFAULT_I2C_SDA_PIN; // 4
 static const uint I2C_SLAVE_SCL_PIN = 1;  // PICO_DEFAULT_I2C_SCL_PIN; // 5
 
+#ifndef FILENAMES_PAGE_DEFAULT_LIMIT
+#define FILENAMES_PAGE_DEFAULT_LIMIT 25
+#endif
+
+#ifndef FILENAMES_PAGE_MAX_LIMIT
+#define FILENAMES_PAGE_MAX_LIMIT 100
+#endif
+
+// Size of the chunks the image JSON items of a full image list are allocated from.
+#ifndef IMAGE_ARENA_CHUNK_SIZE
+#define IMAGE_ARENA_CHUNK_SIZE 8192
+#endif
+
+// Number of images kept requested from the server or buffered ahead of the client while iterating.
+#ifndef IMAGE_PREFETCH_WINDOW
+#define IMAGE_PREFETCH_WINDOW 4
+#endif
+
+// Most images kept in memory for the iteration sessions, including requests in flight.
+#ifndef IMAGE_STREAM_RETAINED
+#define IMAGE_STREAM_RETAINED (4 * IMAGE_PREFETCH_WINDOW)
+#endif
+
+// Number of clients that can iterate the images at the same time.
+#ifndef IMAGE_SESSIONS_MAX
+#define IMAGE_SESSIONS_MAX 4
+#endif
+
+// Iteration sessions not used for this long are ended.
+#ifndef IMAGE_SESSION_TIMEOUT_MS
+#define IMAGE_SESSION_TIMEOUT_MS 30000
+#endif
+
+// Number of logged messages printed per pass of the main loop.
+#ifndef LOG_DRAIN_PER_LOOP
+#define LOG_DRAIN_PER_LOOP 8
+#endif
+
+// Number of load image and eject commands whose progress can be queried with /command.
+#ifndef COMMANDS_TRACKED
+#define COMMANDS_TRACKED 16
+#endif
+
+// Load image and eject commands not sent or not reflected in the status for this long time out.
+#ifndef COMMAND_TIMEOUT_MS
+#define COMMAND_TIMEOUT_MS 30000
+#endif
+
+// Largest body of a POST /batch request, which also limits the length of image names in it.
+#ifndef BATCH_MAX_BODY
+#define BATCH_MAX_BODY 2048
+#endif
+
+// Largest number of commands in a POST /batch request.
+#ifndef BATCH_MAX_COMMANDS
+#define BATCH_MAX_COMMANDS 16
+#endif
+
+// Time a log message for the ZuluIDE is held back so later ones can be sent in the same frame.
+#ifndef LOG_FORWARD_HOLD_MS
+#define LOG_FORWARD_HOLD_MS 250
+#endif
+
+// Entries of the I2C output queue left free for commands when forwarding log messages.
+#ifndef LOG_FORWARD_QUEUE_RESERVE
+#define LOG_FORWARD_QUEUE_RESERVE 4
+#endif
+
+// Number of routes whose request latencies are reported separately by /metrics.
+#ifndef METRICS_ROUTES_MAX
+#define METRICS_ROUTES_MAX 32
+#endif
+
+// Interval for sampling the free heap and the WiFi signal strength for /metrics.
+#ifndef METRICS_SAMPLE_MS
+#define METRICS_SAMPLE_MS 100
+#endif
+
 static const uint8_t GPIO_BOARD_TYPE = 5; // Determins if the shield is using a Pico or a laid down RP2040
 static const uint8_t GPIO_MCU_LED    = 26;
 
@@ -63,15 +156,39 @@ enum class FilenameCacheState { Idle, Start, Fetching, Full, Overflow};
 
 enum class ImageCacheState { Idle,
                              Fetching,
-                             Full,
-                             Iterating,
-                             IteratingFinished };
+                             Full };
 
 enum class IPAddressState { Init, Sending, Received};
 
 static volatile FilenameCacheState filenameState = FilenameCacheState::Idle;
 
-static char filenames_json[FILENAMES_JSON_CACHE_SIZE] = {0};
+/**
+   Filename cache JSON along with the offset and length of each filename stored
+   in it, used to serve pages of the cache, and a sorted index for searching.
+ */
+struct FilenamesSnapshot : public Snapshot {
+   std::string json;
+   std::vector<uint32_t> offsets;
+   std::vector<uint16_t> lengths;
+   FilenameIndex index;
+};
+
+// Filename cache being filled while the server sends the filenames.
+static FilenamesSnapshot *filenamesBuilding = nullptr;
+
+// Last complete filename cache. Its version identifies the cache in page cursors
+// so that stale cursors can be detected.
+static SnapshotSlot filenamesSlot;
+
+// Query from the last /search call, consumed when /search.json is opened.
+static char searchQuery[256];
+static uint32_t searchLimit;
+
+// Page requested by the last /filenames call, consumed when /filenames_page.json is opened.
+static struct {
+   uint32_t offset;
+   uint32_t limit;
+} filenamesPage;
 
 static volatile ImageCacheState imageState = ImageCacheState::Idle;
 
@@ -86,13 +203,71 @@ char ipBuffer[32] = {0};
 
 static char versionJson[MAX_MSG_SIZE];
 
-static char currentStatus[MAX_MSG_SIZE];
+// Last system status received from the server, as a TextSnapshot.
+static SnapshotSlot statusSlot;
+
+// Fields of the last system status and the generation each last changed in.
+static StatusModel statusModel;
+
+// Fields requested by the last /status call, consumed when /status_fields.json is opened.
+static char statusFields[128];
+
+// Generation requested by the last /status/delta call, consumed when /status_delta.json is opened.
+static uint32_t statusSince;
 
-static queue_t imageQueue;
+// Images received while iterating, shared by the sessions of every client iterating them.
+static ImageStream imageStream(IMAGE_PREFETCH_WINDOW, IMAGE_STREAM_RETAINED, IMAGE_SESSIONS_MAX, IMAGE_SESSION_TIMEOUT_MS);
 
-static std::vector<char *> images;
+// Progress of the latest load image and eject commands.
+static CommandTracker commandTracker(COMMANDS_TRACKED, COMMAND_TIMEOUT_MS * 1000);
 
-static char *imageJson = NULL;
+// Id of the command queued by the last /image or /eject call, or requested by the last
+// /command call, consumed when /command_id.json or /command.json is opened.
+static uint32_t commandId;
+
+// Commands of the POST /batch request being received and the result of the last one.
+static BatchRequest batchRequest(BATCH_MAX_BODY, BATCH_MAX_COMMANDS);
+static std::string batchResult;
+
+// Session of the last /nextImage call, consumed when /nextImage.json or /session.json is opened.
+static uint32_t nextImageSession;
+
+/**
+   Image JSON items of a full image list, allocated from the arena of the
+   list and freed with it. /images.json is streamed from these fragments, so
+   the list is never copied into a single document.
+ */
+struct ImageListSnapshot : public Snapshot {
+   ImageListSnapshot() : arena(IMAGE_ARENA_CHUNK_SIZE) {}
+   Arena arena;
+   std::vector<char *> fragments;
+   std::vector<uint16_t> lengths;
+   // Length of /images.json, the items separated by commas within brackets.
+   size_t jsonLength = 2;
+   // Length of /images.cbor, measured in the lwIP context when it is first
+   // requested. The items are encoded as they are sent.
+   size_t cborLength = 0;
+};
+
+// Image list being filled while the server sends the full list of images.
+static ImageListSnapshot *imagesBuilding = nullptr;
+
+// Last complete image list.
+static SnapshotSlot imagesSlot;
+
+// Request latencies of each route, from opening the response until it is closed.
+static RouteMetrics routeMetrics(METRICS_ROUTES_MAX);
+static uint32_t httpNotFound = 0;
+
+// Lowest free heap seen while sampling, and the last WiFi signal strength.
+static size_t heapMinFree = SIZE_MAX;
+static int32_t wifiRssi = 0;
+static bool wifiRssiValid = false;
+
+// WiFi connection attempts and links lost since boot.
+static uint32_t wifiConnects = 0;
+static uint32_t wifiConnectFailures = 0;
+static uint32_t wifiLinkLosses = 0;
 
 static std::string wifiPass;
 
@@ -126,9 +301,27 @@ namespace ClientMessage {
 }
 static State programState = State::WaitForAPIVersion;
 
+/**
+   Sends a frame of log messages unless that would leave too little room in
+   the output queue for commands.
+ */
+static bool SendServerLogFrame(const char* frame, size_t length) {
+   if (zuluide::i2c::client::OutputQueueSpace() <= LOG_FORWARD_QUEUE_RESERVE) {
+      return false;
+   }
+   return zuluide::i2c::client::EnqueueRequest(I2C_CLIENT_LOG_MSG, frame);
+}
+
+// Rate limits per ClientMessage::Type, in the order of the enum.
+static const LogAggregator::Config serverLogConfigs[LOG_AGGREGATOR_TYPES] = {
+   {ClientMessage::Prefix::Normal, 10, 30},
+   {ClientMessage::Prefix::Debug, 5, 10},
+};
+static LogAggregator serverLog(serverLogConfigs, LOG_FORWARD_HOLD_MS, SendServerLogFrame);
+
 
 
-void RebuildImageJson();
+void PublishImageFragments();
 
 static uint32_t millis() {
    return to_ms_since_boot(get_absolute_time());
@@ -139,6 +332,10 @@ static uint32_t millis() {
  */
 static void reset() {
    zuluide::i2c::client::EnqueueRequest(I2C_CLIENT_RESET_QUEUE);
+   // Any iterate requests were dropped with the queue.
+   cyw43_arch_lwip_begin();
+   imageStream.Reset();
+   cyw43_arch_lwip_end();
    static_ip_set = false;
    memset(&static_ip, 0, sizeof(static_ip));
    memset(&static_netmask, 0, sizeof(static_netmask));
@@ -148,42 +345,19 @@ static void reset() {
 namespace zuluide::i2c::client {
 
    /**
- * Send message to i2c server to log
+ * Send message to i2c server to log. Messages are packed into frames, rate
+ * limited and collapsed when repeated by serverLog.
  */
 void LogMessageToServer(ClientMessage::Type type, const char* format, ...)
 {
-   // Prepend a character to indicate the type of message being sent.
-   char prefix  = ClientMessage::Prefix::Unknown;
-   switch(type)
-   {
-      case ClientMessage::Type::Normal:
-         prefix = ClientMessage::Prefix::Normal;
-         break;
-      case ClientMessage::Type::Debug:
-         prefix = ClientMessage::Prefix::Debug;
-         break;
-      default:
-         prefix = ClientMessage::Prefix::Unknown;
-   }
-   // Minimize the size need to store format with the prefix in message.
-   size_t format_len = strlen(format);
-   if (format_len > MAX_MSG_SIZE - 2) {
-      format_len = MAX_MSG_SIZE - 2;
-   }
-   char *message = new char[format_len + 2];
-   memset(message, '\0', format_len + 2);
-   message[0] = prefix;
-   strncpy(message + 1, format, format_len);
-
-   // Use printf formatting to build payload message, then send to server and print to console.
-   char payload[MAX_MSG_SIZE] = {0};
+   // Format the message, print it to console and queue it for the server.
+   char line[LOG_AGGREGATOR_LINE_SIZE];
    va_list args;
    va_start(args, format);
-   vsnprintf(payload, sizeof(payload), message, args);
+   vsnprintf(line, sizeof(line), format, args);
    va_end(args);
-   printf("%s\n", payload + 1);
-   zuluide::i2c::client::EnqueueRequest(I2C_CLIENT_LOG_MSG, payload);
-   delete[] message;
+   printf("%s\n", line);
+   serverLog.Add(static_cast<int>(type), line, millis());
 }
 
 /**
@@ -255,70 +429,155 @@ void ProcessWiFiConnect()
 }
 
 /**
-   Callback function for receiving system status that copies the status
-   into a local buffer for use by the web server.
+   Stores the filename of the image mounted according to the last system
+   status in filename, returning false if no image is mounted.
+ */
+static bool StatusImageFilename(std::string &filename) {
+   std::string image;
+   std::string name;
+   StatusModel imageFields;
+   if (!statusModel.Get("image", image) || !imageFields.Update(image.data(), image.size()) ||
+       !imageFields.Get("filename", name) || name.size() < 2 || name[0] != '"') {
+      return false;
+   }
+
+   filename.resize(DecodeJsonString(name.data() + 1, name.size() - 2, NULL));
+   DecodeJsonString(name.data() + 1, name.size() - 2, &filename[0]);
+   return true;
+}
+
+/**
+   Callback function for receiving system status that publishes the status
+   as a new snapshot for use by the web server.
  */
 void ProcessSystemStatus(const uint8_t *message, size_t length) {
-   memset(currentStatus, 0, MAX_MSG_SIZE);
-   memcpy(currentStatus, message, MAX_MSG_SIZE);
+   auto status = new TextSnapshot(std::string((const char*)message, strnlen((const char*)message, length)));
+   cyw43_arch_lwip_begin();
+   statusSlot.Publish(status);
+   if (!statusModel.Update(status->text.data(), status->text.size())) {
+      LOG_WARN("Unable to parse the fields of the system status\n");
+   }
+   std::string image;
+   bool mounted = StatusImageFilename(image);
+   commandTracker.StatusReceived(mounted ? image.c_str() : nullptr, time_us_32());
+   cyw43_arch_lwip_end();
 }
 
 void ProcessUpdateFilenames(const uint8_t *message, size_t length) {
    printf("Begining filename cache update process\n");
    filenameState = FilenameCacheState::Start;
+
+   // The image list changes along with the filenames, so the next /images fetches it again.
+   cyw43_arch_lwip_begin();
+   if (imageState == ImageCacheState::Full) {
+      imageState = ImageCacheState::Idle;
+   }
+   cyw43_arch_lwip_end();
+}
+
+/**
+   Appends a filename to the cache being built and records where it is stored
+   so pages of the cache can be built without parsing the JSON.
+ */
+static void AddFilename(const uint8_t *message, size_t length) {
+   filenamesBuilding->offsets.push_back(filenamesBuilding->json.size());
+   filenamesBuilding->lengths.push_back(length);
+   filenamesBuilding->json.append((const char*)message, length);
+}
+
+/**
+   Reserves room for a cache an eighth larger than the published one, so the
+   cache being built does not reallocate, needing twice its size, while the
+   published one is still held.
+ */
+static void ReserveFilenames(FilenamesSnapshot *building) {
+   auto published = (const FilenamesSnapshot*)filenamesSlot.Current();
+   if (published == nullptr) {
+      return;
+   }
+
+   size_t jsonSize = published->json.size() + published->json.size() / 8;
+   building->json.reserve((jsonSize < FILENAMES_JSON_CACHE_SIZE) ? jsonSize : FILENAMES_JSON_CACHE_SIZE);
+   size_t count = published->offsets.size() + published->offsets.size() / 8 + 1;
+   building->offsets.reserve(count);
+   building->lengths.reserve(count);
+}
+
+/**
+   Drops the cache being built after it outgrew FILENAMES_JSON_CACHE_SIZE.
+ */
+static void FilenamesOverflowed() {
+   delete filenamesBuilding;
+   filenamesBuilding = nullptr;
+   filenameState = FilenameCacheState::Overflow;
 }
 
 /**
    Callback function for receiving a filename from the I2C server.
-   It adds the filename to JSON file cached in SRAM.
+   It adds the filename to the JSON cache being built in SRAM, which is
+   published once the last filename is received. Until then the previously
+   published cache is still served.
  */
 void ProcessFilename(const uint8_t *message, size_t length) {
-   const size_t cache_size = sizeof(filenames_json);
-   printf("Process filename length: %d\n", length);
+   const size_t cache_size = FILENAMES_JSON_CACHE_SIZE;
+   LOG_DEBUG("Process filename length: %u\n", length);
    if (filenameState == FilenameCacheState::Start) {
-      memset(filenames_json, '\0', cache_size);
+      delete filenamesBuilding;
+      filenamesBuilding = new FilenamesSnapshot();
+      ReserveFilenames(filenamesBuilding);
       if (cache_size < sizeof("{\"filenames\":[")) {
          printf("Filename cache overflowed after init, increase cache size\n");
-         filenameState = FilenameCacheState::Overflow;
+         FilenamesOverflowed();
          return;
       } else {
-         strcat(filenames_json, "{\"filenames\":[");
+         filenamesBuilding->json = "{\"filenames\":[";
       }
    }
 
    if (length > 0) {
       if (filenameState == FilenameCacheState::Start)
       {
-         if (strlen(filenames_json) + strlen("\"") + length + strlen("\"") + 1 > cache_size) {
+         if (filenamesBuilding->json.size() + strlen("\"") + length + strlen("\"") + 1 > cache_size) {
             printf("Filename cache overflowed adding the first filename JSON cache\n");
-            filenameState = FilenameCacheState::Overflow;
+            FilenamesOverflowed();
             return;
          }
-         strcat(filenames_json, "\"");
-         memcpy(filenames_json + strlen(filenames_json), message, length);
-         strcat(filenames_json, "\"");
+         filenamesBuilding->json += "\"";
+         AddFilename(message, length);
+         filenamesBuilding->json += "\"";
          filenameState = FilenameCacheState::Fetching;
       } else if (filenameState == FilenameCacheState::Fetching) {
-         if (strlen(filenames_json) + strlen(",\"") + length + strlen("\"") + 1 > cache_size) {
+         if (filenamesBuilding->json.size() + strlen(",\"") + length + strlen("\"") + 1 > cache_size) {
             printf("Filename cache overflowed adding a filename JSON cache\n");
-            filenameState = FilenameCacheState::Overflow;
+            FilenamesOverflowed();
             return;
          }
-         strcat(filenames_json, ",\"");
-         memcpy(filenames_json + strlen(filenames_json), message, length);
-         strcat(filenames_json, "\"");
+         filenamesBuilding->json += ",\"";
+         AddFilename(message, length);
+         filenamesBuilding->json += "\"";
       }
    } else {
       if (filenameState == FilenameCacheState::Start || filenameState == FilenameCacheState::Fetching)
       {
-         if (strlen(filenames_json) + strlen("]}") + 1 > cache_size) {
+         if (filenamesBuilding->json.size() + strlen("]}") + 1 > cache_size) {
             printf("Filename cache overflowed adding closing characters\n");
-            filenameState = FilenameCacheState::Overflow;
+            FilenamesOverflowed();
          } else {
             printf("Received filename of length zero, setting state to Full\n");
             // All images received.
-            strcat(filenames_json, "]}");
+            FilenamesSnapshot *filenames = filenamesBuilding;
+            filenamesBuilding = nullptr;
+            filenames->json += "]}";
+            // Only give back the room left by growing past the reserved size, as
+            // shrinking copies the cache.
+            if (filenames->json.capacity() - filenames->json.size() > filenames->json.size() / 8) {
+               filenames->json.shrink_to_fit();
+            }
+            filenames->index.Build(filenames->json.c_str(), filenames->offsets.data(), filenames->lengths.data(), filenames->offsets.size());
+            cyw43_arch_lwip_begin();
+            filenamesSlot.Publish(filenames);
             filenameState = FilenameCacheState::Full;
+            cyw43_arch_lwip_end();
          }
       }
    }
@@ -326,32 +585,43 @@ void ProcessFilename(const uint8_t *message, size_t length) {
 
 /**
    Callback function fo receiving an image from the I2C server.
-   If the web service is iterating, the image is cached for the
+   If the image answers an iterate request, it is queued for the
    next iterate request from the web server client. If the
    web service is retrieving all fo the images, it is cached in a
-   vector until all are received and a single JSON document
-   is built for all of the images.
+   vector until all are received and then served as a single JSON
+   document.
  */
 void ProcessImage(const uint8_t *message, size_t length) {
+   if (imageStream.InFlight() > 0) {
+      // Answer to an iterate request. The stream is shared with the web server callbacks.
+      char *image = NULL;
+      if (length > 0) {
+         image = new char[length + 1];
+         memset(image, 0, length + 1);
+         memcpy(image, message, length);
+      }
+
+      cyw43_arch_lwip_begin();
+      imageStream.Received(image, millis());
+      cyw43_arch_lwip_end();
+      return;
+   }
+
+   if (imagesBuilding == nullptr) {
+      imagesBuilding = new ImageListSnapshot();
+   }
+
    if (length > 0) {
-      char *image = new char[length + 1];
-      memset(image, 0, length + 1);
+      length = strnlen((const char *)message, length);
+      char *image = imagesBuilding->arena.Allocate(length + 1);
       memcpy(image, message, length);
-      if (imageState == ImageCacheState::Iterating) {
-         queue_try_add(&imageQueue, &image);
-      } else {
-         images.push_back(image);
-      }
+      image[length] = 0;
+      imagesBuilding->jsonLength += length + (imagesBuilding->fragments.empty() ? 0 : 1);
+      imagesBuilding->fragments.push_back(image);
+      imagesBuilding->lengths.push_back(length);
    } else {
-      if (imageState == ImageCacheState::Iterating) {
-         imageState = ImageCacheState::IteratingFinished;
-      } else {
-         // Rebuild the image.
-         RebuildImageJson();
-
-         // All images received.
-         imageState = ImageCacheState::Full;
-      }
+      // All images received.
+      PublishImageFragments();
    }
 }
 
@@ -437,54 +707,231 @@ void ProcessIPAddressAck() {
    printf("Server received IP Address.\n");
 
 }
+
+/**
+   Callback function for a tracked load image or eject request that has been
+   sent to the I2C server.
+ */
+void ProcessRequestSent(uint32_t trackId, uint32_t sentUs) {
+   cyw43_arch_lwip_begin();
+   commandTracker.Sent(trackId, sentUs);
+   cyw43_arch_lwip_end();
+}
+
+/**
+   Callback function for a request dropped from the full request queue.
+   Iterate requests that are never sent will not be answered.
+ */
+void ProcessRequestDropped(uint8_t command, uint32_t trackId) {
+   cyw43_arch_lwip_begin();
+   if (command == I2C_CLIENT_FETCH_ITR_IMAGE) {
+      imageStream.Dropped();
+   }
+   if (trackId != 0) {
+      commandTracker.Failed(trackId);
+   }
+   cyw43_arch_lwip_end();
+}
 }  // namespace zuluide::i2c::client
 
 /**
    Redirect a request to /version to /version.json.
  */
 static const char *cgi_handler_version(int index, int numParams, char *pcParam[], char *pcValue[]) {
+   TraceScope trace("cgi /version");
    return "/version.json";
 }
 
 /**
-   Redirect a request to /status to /status.json.
+   Redirect a request to /status to /status.json, or to the fields listed in
+   the fields query parameter, e.g. /status?fields=image,isPrimary.
  */
 static const char *cgi_handler_status(int index, int numParams, char *pcParam[], char *pcValue[]) {
+   TraceScope trace("cgi /status");
+   for (int i = 0; i < numParams; i++) {
+      if (strcmp(pcParam[i], "fields") == 0 && pcValue[i] != NULL) {
+         urldecode(pcValue[i]);
+         strncpy(statusFields, pcValue[i], sizeof(statusFields) - 1);
+         statusFields[sizeof(statusFields) - 1] = 0;
+         return "/status_fields.json";
+      }
+   }
+
    return "/status.json";
 }
 
+/**
+   Returns the status fields that changed after the generation given in the
+   since query parameter, along with the current generation to pass next time.
+ */
+static const char *cgi_handler_status_delta(int index, int numParams, char *pcParam[], char *pcValue[]) {
+   TraceScope trace("cgi /status/delta");
+   statusSince = 0;
+   for (int i = 0; i < numParams; i++) {
+      if (strcmp(pcParam[i], "since") == 0 && pcValue[i] != NULL) {
+         statusSince = strtoul(pcValue[i], NULL, 10);
+      }
+   }
+
+   return "/status_delta.json";
+}
+
+/**
+   Serves a slice of the filename cache selected with the offset/limit or cursor
+   query parameters. A cursor is returned with each page and identifies both the
+   cache generation and the next offset, so a client paging through a cache that
+   has since been rebuilt receives a stale message instead of a mixed listing.
+ */
+static const char *filenames_page(int numParams, char *params[], char *values[]) {
+   uint32_t offset = 0;
+   uint32_t limit = FILENAMES_PAGE_DEFAULT_LIMIT;
+   bool refresh = false;
+   bool stale = false;
+   for (int i = 0; i < numParams; i++) {
+      if (strcmp(params[i], "refresh") == 0) {
+         refresh = true;
+      } else if (values[i] == NULL) {
+         // lwIP passes NULL for parameters without a value.
+         continue;
+      } else if (strcmp(params[i], "offset") == 0) {
+         offset = strtoul(values[i], NULL, 10);
+      } else if (strcmp(params[i], "limit") == 0) {
+         limit = strtoul(values[i], NULL, 10);
+      } else if (strcmp(params[i], "cursor") == 0) {
+         char *end;
+         uint32_t generation = strtoul(values[i], &end, 10);
+         if (*end != '.' || generation != filenamesSlot.Version()) {
+            stale = true;
+         } else {
+            offset = strtoul(end + 1, NULL, 10);
+         }
+      }
+   }
+
+   if (filenameState == FilenameCacheState::Overflow) {
+      return "/overflow.json";
+   }
+
+   // While the cache is refreshed the previous one is still served.
+   if (filenamesSlot.Current() == nullptr) {
+      return "/wait.json";
+   }
+
+   if (stale) {
+      return "/stale.json";
+   }
+
+   if (refresh && !zuluide::i2c::client::EnqueueRequest(I2C_CLIENT_FETCH_FILENAMES)) {
+      LOG_WARN("Failed to add fetch filenames to output queue.\n");
+   }
+
+   filenamesPage.offset = offset;
+   // A page of no filenames would return a cursor to itself.
+   if (limit < 1) {
+      limit = 1;
+   }
+   filenamesPage.limit = (limit > FILENAMES_PAGE_MAX_LIMIT) ? FILENAMES_PAGE_MAX_LIMIT : limit;
+   return "/filenames_page.json";
+}
+
+/**
+   Returns true if the parameters select a page of the filename cache. Other
+   parameters, such as a cache buster, still get the whole cache.
+ */
+static bool is_filenames_page(int numParams, char *params[]) {
+   for (int i = 0; i < numParams; i++) {
+      if (strcmp(params[i], "offset") == 0 || strcmp(params[i], "limit") == 0 ||
+          strcmp(params[i], "cursor") == 0) {
+         return true;
+      }
+   }
+   return false;
+}
+
 static const char *cgi_handler_filenames(int index, int numParams, char *pcParam[], char *pcValue[]) {
-   printf("Sending filenames cached JSON\n");
+   TraceScope trace("cgi /filenames");
+   if (is_filenames_page(numParams, pcParam)) {
+      return filenames_page(numParams, pcParam, pcValue);
+   }
+
+   LOG_DEBUG("Sending filenames cached JSON\n");
    if (filenameState == FilenameCacheState::Full) {
       if (!zuluide::i2c::client::EnqueueRequest(I2C_CLIENT_FETCH_FILENAMES)) {
-         printf("Failed to add fetch filenames to output queue.\n");
+         LOG_WARN("Failed to add fetch filenames to output queue.\n");
       }
    }
 
-   if (filenameState == FilenameCacheState::Start ||  filenameState == FilenameCacheState::Fetching) {
+   if (filenameState == FilenameCacheState::Overflow) {
+      return "/overflow.json";
+   }
+
+   if (filenamesSlot.Current() == nullptr) {
       return "/wait.json";
    }
 
+   return "/filenames.json";
+}
+
+/**
+   Searches the cached filenames for the q query parameter, ignoring case.
+ */
+static const char *cgi_handler_search(int index, int numParams, char *params[], char *values[]) {
+   TraceScope trace("cgi /search");
+   searchQuery[0] = 0;
+   searchLimit = FILENAMES_PAGE_DEFAULT_LIMIT;
+   for (int i = 0; i < numParams; i++) {
+      if (values[i] == NULL) {
+         continue;
+      }
+
+      if (strcmp(params[i], "q") == 0) {
+         urldecode(values[i]);
+         strncpy(searchQuery, values[i], sizeof(searchQuery) - 1);
+         searchQuery[sizeof(searchQuery) - 1] = 0;
+      } else if (strcmp(params[i], "limit") == 0) {
+         searchLimit = strtoul(values[i], NULL, 10);
+      }
+   }
+
+   if (searchLimit > FILENAMES_PAGE_MAX_LIMIT) {
+      searchLimit = FILENAMES_PAGE_MAX_LIMIT;
+   }
+
    if (filenameState == FilenameCacheState::Overflow) {
       return "/overflow.json";
    }
 
-   return "/filenames.json";
+   if (filenamesSlot.Current() == nullptr) {
+      return "/wait.json";
+   }
+
+   return "/search.json";
 }
 
 /**
    Fetches the entire set of images. If the images are not yet available then
-   a wait response is sent.
+   a wait response is sent. The refresh parameter fetches the list again.
  */
 static const char *cgi_handler_imgs(int index, int numParams, char *pcParam[], char *pcValue[]) {
-   if (imageState == ImageCacheState::Idle) {
+   TraceScope trace("cgi /images");
+   for (int i = 0; i < numParams; i++) {
+      if (strcmp(pcParam[i], "refresh") == 0 && imageState == ImageCacheState::Full) {
+         imageState = ImageCacheState::Idle;
+      }
+   }
+
+   // Answers the server lost would keep the full list from being fetched.
+   imageStream.ExpireRequests(millis());
+   if (imageState == ImageCacheState::Idle && imageStream.InFlight() == 0) {
       imageState = ImageCacheState::Fetching;
       if (!zuluide::i2c::client::EnqueueRequest(I2C_CLIENT_FETCH_IMAGES_JSON)) {
-         printf("Failed to add fetch images to output queue.\n");
+         LOG_WARN("Failed to add fetch images to output queue.\n");
+         imageState = ImageCacheState::Idle;
       }
    }
 
-   if (imageState == ImageCacheState::Fetching) {
+   // While the list is refreshed the previous one is still served.
+   if (imagesSlot.Current() == nullptr) {
       return "/wait.json";
    }
 
@@ -492,33 +939,78 @@ static const char *cgi_handler_imgs(int index, int numParams, char *pcParam[], c
 }
 
 /**
-   Fetches the next image when iterating the images. A wait message is sent when
-   an image is not ready. A done message is sent when the iteration if finished.
+   Keeps up to IMAGE_PREFETCH_WINDOW images requested from the server or buffered
+   ahead of the iterating clients, so iterating is not limited by the client
+   request round trip.
  */
-static const char *cgi_handler_next_image(int index, int numParams, char *pcParam[], char *pcValue[]) {
-   if (imageState == ImageCacheState::Idle) {
+static void PrefetchImages() {
+   for (size_t needed = imageStream.RequestsNeeded(); needed > 0; needed--) {
       if (!zuluide::i2c::client::EnqueueRequest(I2C_CLIENT_FETCH_ITR_IMAGE)) {
-         printf("Failed to add iterate image to output queue.\n");
+         LOG_WARN("Failed to add iterate image to output queue.\n");
+         break;
       }
+      imageStream.RequestSent(millis());
+   }
+}
 
-      imageState = ImageCacheState::Iterating;
-
+/**
+   Fetches the next image when iterating the images. A wait message is sent when
+   an image is not ready. A done message is sent when the iteration if finished.
+   Clients pass session=new to start their own iteration and then the returned
+   session token, otherwise they share a single default iteration.
+ */
+static const char *cgi_handler_next_image(int index, int numParams, char *pcParam[], char *pcValue[]) {
+   TraceScope trace("cgi /nextImage");
+   if (imageState == ImageCacheState::Fetching) {
+      // Iterated images could not be told apart from the full list being fetched.
       return "/wait.json";
-   } else if (imageState == ImageCacheState::Iterating) {
-      if (queue_is_empty(&imageQueue)) {
-         return "/wait.json";
-      } else {
-         // We have something that we are about to send out, lets fetch the next so we can be ready.
-         if (!zuluide::i2c::client::EnqueueRequest(I2C_CLIENT_FETCH_ITR_IMAGE)) {
-            printf("Failed to add iterate image to output queue.\n");
+   }
+
+   nextImageSession = ImageStream::DefaultSession;
+   for (int i = 0; i < numParams; i++) {
+      if (strcmp(pcParam[i], "session") == 0 && pcValue[i] != NULL) {
+         if (strcmp(pcValue[i], "new") == 0) {
+            nextImageSession = imageStream.OpenSession(millis());
+            PrefetchImages();
+            return "/session.json";
          }
+         nextImageSession = strtoul(pcValue[i], NULL, 10);
       }
-   } else if (imageState == ImageCacheState::IteratingFinished) {
-      imageState = ImageCacheState::Idle;
-      return "/done.json";
    }
 
-   return "/nextImage.json";
+   const char *image;
+   switch (imageStream.Peek(nextImageSession, millis(), &image)) {
+      case ImageStream::Result::Image:
+         return "/nextImage.json";
+      case ImageStream::Result::Done:
+         imageStream.Close(nextImageSession);
+         return "/done.json";
+      case ImageStream::Result::Expired:
+         return "/expired.json";
+      default:
+         PrefetchImages();
+         return "/wait.json";
+   }
+}
+
+/**
+   Enqueues a load image or eject request to the I2C server and starts
+   tracking it, storing its id in id. image is ignored for ejects. Returns
+   false if the request could not be queued.
+ */
+static bool enqueue_tracked(CommandTracker::Kind kind, const char *image, uint32_t *id) {
+   *id = commandTracker.Add(kind, image, time_us_32());
+   bool queued;
+   if (kind == CommandTracker::Kind::Eject) {
+      queued = zuluide::i2c::client::EnqueueTrackedRequest(I2C_CLIENT_EJECT_IMAGE, "", *id);
+   } else {
+      queued = zuluide::i2c::client::EnqueueTrackedRequest(I2C_CLIENT_LOAD_IMAGE, image, *id);
+   }
+
+   if (!queued) {
+      commandTracker.Failed(*id);
+   }
+   return queued;
 }
 
 /**
@@ -526,14 +1018,15 @@ static const char *cgi_handler_next_image(int index, int numParams, char *pcPara
    query parameter imageName.
  */
 static const char *cgi_handler_image(int index, int numParams, char *params[], char *values[]) {
+   TraceScope trace("cgi /image");
    if (numParams > 0) {
       for (int i = 0; i < numParams; i++) {
-         if (strncmp(params[i], "imageName", sizeof("imageName")) == 0) {
+         if (strncmp(params[i], "imageName", sizeof("imageName")) == 0 && values[i] != NULL) {
             // Decoding parameters that were URL encoded.
             urldecode(values[i]);
-            printf("Setting image to: %s\n", values[i]);
-            zuluide::i2c::client::EnqueueRequest(I2C_CLIENT_LOAD_IMAGE, values[i]);
-            return "/ok.json";
+            LOG_INFO("Setting image to: %s\n", values[i]);
+            enqueue_tracked(CommandTracker::Kind::LoadImage, values[i], &commandId);
+            return "/command_id.json";
          }
       }
    }
@@ -545,31 +1038,153 @@ static const char *cgi_handler_image(int index, int numParams, char *params[], c
    Allows the user to eject the currently mounted image.
 */
 static const char *cgi_handler_eject(int index, int numParams, char *params[], char *values[]) {
-   zuluide::i2c::client::EnqueueRequest(I2C_CLIENT_EJECT_IMAGE);
-   return "/ok.json";
+   TraceScope trace("cgi /eject");
+   enqueue_tracked(CommandTracker::Kind::Eject, NULL, &commandId);
+   return "/command_id.json";
 }
 
+/**
+   Reports the progress of the command whose id is given in the id query
+   parameter.
+ */
+static const char *cgi_handler_command(int index, int numParams, char *params[], char *values[]) {
+   TraceScope trace("cgi /command");
+   commandId = 0;
+   for (int i = 0; i < numParams; i++) {
+      if (strcmp(params[i], "id") == 0 && values[i] != NULL) {
+         commandId = strtoul(values[i], NULL, 10);
+      }
+   }
+
+   return "/command.json";
+}
+
+
+static const char *cgi_handler_cbor(int index, int numParams, char *pcParam[], char *pcValue[]);
 
 static const tCGI cgi_handlers[] = {
                                     {"/version", cgi_handler_version},
                                     {"/status", cgi_handler_status},
+                                    {"/status/delta", cgi_handler_status_delta},
                                     {"/filenames", cgi_handler_filenames},
+                                    {"/search", cgi_handler_search},
                                     {"/images", cgi_handler_imgs},
                                     {"/image", cgi_handler_image},
                                     {"/eject", cgi_handler_eject},
-                                    {"/nextImage", cgi_handler_next_image}
+                                    {"/command", cgi_handler_command},
+                                    {"/nextImage", cgi_handler_next_image},
+                                    {"/version.cbor", cgi_handler_cbor},
+                                    {"/status.cbor", cgi_handler_cbor},
+                                    {"/status/delta.cbor", cgi_handler_cbor},
+                                    {"/filenames.cbor", cgi_handler_cbor},
+                                    {"/images.cbor", cgi_handler_cbor}
 };
 
+/**
+   Returns uri with a .json extension replaced by .cbor. The result is only
+   valid until the next call.
+ */
+static const char *cbor_uri(const char *uri) {
+   static char cborUri[32];
+   const char *extension = strrchr(uri, '.');
+   if (extension == NULL || strcmp(extension, ".json") != 0 || (extension - uri) + sizeof(".cbor") > sizeof(cborUri)) {
+      return uri;
+   }
+
+   memcpy(cborUri, uri, extension - uri);
+   strcpy(cborUri + (extension - uri), ".cbor");
+   return cborUri;
+}
+
+/**
+   Handles a request to /<name>.cbor with the handler of /<name>, answering
+   with the CBOR encoding of the JSON file it selects. The Accept header is
+   not passed on to CGI handlers, so the encoding is chosen by the suffix.
+ */
+static const char *cgi_handler_cbor(int index, int numParams, char *pcParam[], char *pcValue[]) {
+   TraceScope trace("cgi .cbor");
+   const char *uri = cgi_handlers[index].pcCGIName;
+   size_t length = strlen(uri) - strlen(".cbor");
+   for (size_t i = 0; i < sizeof(cgi_handlers)/sizeof(cgi_handlers[0]); i++) {
+      const char *name = cgi_handlers[i].pcCGIName;
+      if (strlen(name) == length && strncmp(name, uri, length) == 0) {
+         return cbor_uri(cgi_handlers[i].pfnCGIHandler(i, numParams, pcParam, pcValue));
+      }
+   }
+
+   return uri;
+}
+
 /* Handlers for POST requests */
 
 err_t (*g_httpd_post_receive_data_handler)(void *connection, struct pbuf *p);
 void (*g_httpd_post_finished_handler)(void *connection, char *response_uri, u16_t response_uri_len);
 
+/**
+   Collects the body of a POST /batch request.
+ */
+static err_t batch_post_receive_data(void *connection, struct pbuf *p) {
+   for (struct pbuf *q = p; q != NULL; q = q->next) {
+      batchRequest.Append((const char*)q->payload, q->len);
+   }
+   pbuf_free(p);
+   return ERR_OK;
+}
+
+/**
+   Enqueues the commands of a POST /batch request to the I2C server and
+   responds with the result of each. Nothing is enqueued unless every command
+   is valid and fits into the request queue, so a batch is never partly sent.
+   httpd also calls this when the connection drops before the whole body has
+   arrived, which Parse rejects.
+ */
+static void batch_post_finished(void *connection, char *response_uri, u16_t response_uri_len) {
+   TraceScope trace("post /batch");
+   const char *status = "ok";
+   auto &entries = batchRequest.Entries();
+   if (!batchRequest.Parse()) {
+      status = "error";
+      for (auto &entry : entries) {
+         if (entry.error == nullptr) {
+            entry.status = "skipped";
+         }
+      }
+   } else if (zuluide::i2c::client::OutputQueueSpace() < entries.size()) {
+      status = "busy";
+      for (auto &entry : entries) {
+         entry.status = "busy";
+      }
+   } else {
+      for (auto &entry : entries) {
+         bool sent;
+         if (entry.command == BatchRequest::Command::Eject) {
+            sent = enqueue_tracked(CommandTracker::Kind::Eject, NULL, &entry.id);
+         } else {
+            LOG_INFO("Setting image to: %s\n", entry.argument.c_str());
+            sent = enqueue_tracked(CommandTracker::Kind::LoadImage, entry.argument.c_str(), &entry.id);
+         }
+
+         if (!sent) {
+            entry.status = "error";
+            entry.error = "queue full";
+            status = "error";
+         }
+      }
+   }
+
+   LOG_INFO("Batch of %lu commands: %s\n", (unsigned long)entries.size(), status);
+   batchResult.clear();
+   batchRequest.BuildResult(status, batchResult);
+   snprintf(response_uri, response_uri_len, "/batch.json");
+}
+
 err_t httpd_post_begin(void *connection, const char *uri, const char *http_request,
                        u16_t http_request_len, int content_len, char *response_uri,
                        u16_t response_uri_len, u8_t *post_auto_wnd)
 {
-   if (strcmp(uri, "/fw_upgrade.cgi") == 0)
+   // The upload may continue an interrupted one, e.g. /fw_upgrade.cgi?fwid=abc&offset=4096
+   if (strncmp(uri, "/fw_upgrade.cgi", strlen("/fw_upgrade.cgi")) == 0 &&
+       (uri[strlen("/fw_upgrade.cgi")] == '\0' || uri[strlen("/fw_upgrade.cgi")] == '?'))
    {
       g_httpd_post_receive_data_handler = &fwupgrade_post_receive_data;
       g_httpd_post_finished_handler = &fwupgrade_post_finished;
@@ -577,6 +1192,21 @@ err_t httpd_post_begin(void *connection, const char *uri, const char *http_reque
          response_uri, response_uri_len, post_auto_wnd);
    }
 
+   if (strcmp(uri, "/batch") == 0)
+   {
+      g_httpd_post_receive_data_handler = &batch_post_receive_data;
+      g_httpd_post_finished_handler = &batch_post_finished;
+      if (!batchRequest.Begin((size_t)content_len)) {
+         // Answered right away without reading the body.
+         batchRequest.Parse();
+         batchResult.clear();
+         batchRequest.BuildResult("error", batchResult);
+         snprintf(response_uri, response_uri_len, "/batch.json");
+         return ERR_VAL;
+      }
+      return ERR_OK;
+   }
+
    g_httpd_post_receive_data_handler = nullptr;
    g_httpd_post_finished_handler = nullptr;
    return ERR_VAL;
@@ -613,6 +1243,40 @@ static bool has_elapsed(uint32_t start, uint32_t elapsed) {
    return (uint32_t)(millis() - start) > elapsed;
 }
 
+// Bounds of the heap, as used by the SDK's _sbrk.
+extern "C" char end;
+extern "C" char __StackLimit;
+
+/**
+   Bytes of heap not allocated, counting space not yet taken by malloc.
+ */
+static size_t HeapFree() {
+   size_t total = &__StackLimit - &end;
+   return total - mallinfo().uordblks;
+}
+
+/**
+   Samples the values reported by /metrics that are not counted as they change.
+ */
+static void SampleMetrics() {
+   static uint32_t last_sample = 0;
+   if (!has_elapsed(last_sample, METRICS_SAMPLE_MS)) {
+      return;
+   }
+   last_sample = millis();
+
+   size_t heap_free = HeapFree();
+   if (heap_free < heapMinFree) {
+      heapMinFree = heap_free;
+   }
+
+   static uint32_t last_rssi = 0;
+   if (programState == State::Normal && has_elapsed(last_rssi, 10 * METRICS_SAMPLE_MS)) {
+      wifiRssiValid = cyw43_wifi_get_rssi(&cyw43_state, &wifiRssi) == 0;
+      last_rssi = millis();
+   }
+}
+
 void start_multicore_i2c() {
    multicore_launch_core1(core1_main);
    uint32_t g = multicore_fifo_pop_blocking();
@@ -643,11 +1307,10 @@ int main() {
 
    stdio_init_all();
    printf("Starting.\n");
+   fwupgrade_init();
 
-   memset(currentStatus, 0, MAX_MSG_SIZE);
    memset(versionJson, '\0', MAX_MSG_SIZE);
    sprintf(versionJson,"{\"clientAPIVersion\":\"%s\", \"serverAPIVersion\": \"server failed to send version\"}", I2C_API_VERSION);
-   queue_init(&imageQueue, sizeof(char *), 1);
 
    start_multicore_i2c();
 
@@ -778,6 +1441,7 @@ int main() {
                }
 
                int connection_result;  
+               TRACE_INSTANT("wifi connect", open_network);
                if (open_network) {
                      connection_result = cyw43_arch_wifi_connect_timeout_ms(
                         wifiSSID.c_str(),
@@ -790,12 +1454,18 @@ int main() {
                         CYW43_AUTH_WPA2_AES_PSK,
                         WIFI_CONNECT_TIMEOUT_MS);
                }
+               TRACE_INSTANT("wifi connect done", (uint32_t)connection_result);
                if (PICO_ERROR_NONE != connection_result) {
                   reset();
+                  wifiConnectFailures++;
                   LogMessageToServer(ClientMessage::Type::Normal, "Failed to connect to WiFi.");
                   programState = State::WaitingForSSID;
                } else {
                   zuluide::i2c::client::EnqueueRequest(I2C_CLIENT_RESET_QUEUE);
+                  cyw43_arch_lwip_begin();
+                  imageStream.Reset();
+                  cyw43_arch_lwip_end();
+                  wifiConnects++;
                   LogMessageToServer(ClientMessage::Type::Normal, "Connected to WiFi.");
                   extern cyw43_t cyw43_state;
                   auto ip_addr = cyw43_state.netif[CYW43_ITF_STA].ip_addr.addr;
@@ -834,6 +1504,9 @@ int main() {
             // Test for WIFI going down.
             if (cyw43_tcpip_link_status(&cyw43_state, CYW43_ITF_STA) != CYW43_LINK_UP) {
                programState = State::WIFIDown;
+               wifiLinkLosses++;
+               TRACE_INSTANT("wifi down", 0);
+               wifiRssiValid = false;
                LogMessageToServer(ClientMessage::Type::Normal, "WiFi connection down.\n");
 
                cyw43_arch_gpio_put(CYW43_WL_GPIO_LED_PIN, 0);
@@ -861,6 +1534,14 @@ int main() {
          }
          send_ip_start_time = millis();
       }
+
+      // Print what was logged while handling requests and I2C traffic.
+      LogDrain(LOG_DRAIN_PER_LOOP);
+
+      // Forward log messages that have been held back long enough.
+      serverLog.Poll(millis());
+
+      SampleMetrics();
    }
 
 
@@ -869,63 +1550,608 @@ int main() {
 }
 
 /**
-   Builds a JSON document using the individual image JSON items sotred in images.
-   After it is finished, it clears images and puts the result in imageJson
+   Publishes the image list received from the server as the one served by
+   /images.json. The previous list is freed once no response uses it.
+ */
+void PublishImageFragments() {
+   ImageListSnapshot *list = imagesBuilding;
+   imagesBuilding = nullptr;
+
+   LOG_INFO("Image list of %lu images, arena %lu bytes in %lu chunks\n", (unsigned long)list->fragments.size(),
+            (unsigned long)list->arena.Used(), (unsigned long)list->arena.Chunks());
+
+   cyw43_arch_lwip_begin();
+   imagesSlot.Publish(list);
+   imageState = ImageCacheState::Full;
+   cyw43_arch_lwip_end();
+}
+
+/**
+   Content of a file opened by fs_open_custom. Files that are generated for a
+   single request own their buffer, which is released in fs_close_custom.
  */
-void RebuildImageJson() {
-   size_t totalSize = 2;
-   for (auto item : images) {
-      totalSize += strlen(item) + 1;
+struct CustomFile {
+   const char *data;
+   char *owned;
+
+   // Snapshot holding data, released when the file is closed so the data stays
+   // unchanged while it is sent even if a newer snapshot is published.
+   Snapshot *snapshot;
+
+   // Files without data are produced piece by piece by next, which returns
+   // NULL after the last piece. item is free for next to track its progress.
+   const char *(*next)(CustomFile *file, size_t *length);
+   const char *piece;
+   size_t pieceLength;
+   size_t piecePos;
+   size_t item;
+
+   // Space for next to build pieces in.
+   std::string scratch;
+
+   // Route the file answers and when it was opened, for /metrics.
+   bool timed;
+   size_t route;
+   uint32_t openedUs;
+};
+
+int get_file_contents(struct fs_file *file, const char *fileContents, int fileLen) {
+   memset(file, 0, sizeof(struct fs_file));
+   if (fileContents) {
+      file->pextension = new CustomFile{fileContents, NULL, NULL, NULL, NULL, 0, 0, 0};
+      file->data = NULL;
+      file->len = fileLen;
+      file->index = 0;
+      file->flags = FS_FILE_FLAGS_HEADER_PERSISTENT;
+      return 1;
+   } else {
+      return 0;
    }
+}
 
-   if (imageJson != NULL) {
-      delete[] imageJson;
+/**
+   Like get_file_contents, but the file takes ownership of fileContents.
+ */
+int get_owned_file_contents(struct fs_file *file, char *fileContents, int fileLen) {
+   if (get_file_contents(file, fileContents, fileLen)) {
+      ((CustomFile*)file->pextension)->owned = fileContents;
+      return 1;
    }
 
-   imageJson = new char[totalSize + 3];
-   imageJson[0] = '[';
-   int pos = 1;
-   for (auto item : images) {
-      if (pos > 1) {
-         strcat(imageJson, ",");
-         pos++;
+   return 0;
+}
+
+/**
+   Opens a file with a copy of contents.
+ */
+int get_string_file_contents(struct fs_file *file, const std::string &contents) {
+   char *copy = new char[contents.size() + 1];
+   memcpy(copy, contents.c_str(), contents.size() + 1);
+   return get_owned_file_contents(file, copy, contents.size());
+}
+
+/**
+   Like get_file_contents, but fileContents belongs to snapshot, which the file
+   takes a reference to until it is closed.
+ */
+int get_snapshot_file_contents(struct fs_file *file, Snapshot *snapshot, const char *fileContents, int fileLen) {
+   if (get_file_contents(file, fileContents, fileLen)) {
+      ((CustomFile*)file->pextension)->snapshot = snapshot->Acquire();
+      return 1;
+   }
+
+   return 0;
+}
+
+/**
+   Builds the JSON document for the page of the filename cache requested by the
+   last /filenames call.
+ */
+static char *BuildFilenamesPage(int *length) {
+   auto filenames = (const FilenamesSnapshot*)filenamesSlot.Current();
+   uint32_t total = filenames->offsets.size();
+   uint32_t first = (filenamesPage.offset < total) ? filenamesPage.offset : total;
+   uint32_t last = (total - first > filenamesPage.limit) ? first + filenamesPage.limit : total;
+
+   size_t size = 128;
+   for (uint32_t i = first; i < last; i++) {
+      size += filenames->lengths[i] + 3;
+   }
+
+   char *page = new char[size];
+   int pos = snprintf(page, size, "{\"generation\":%lu,\"total\":%lu,\"offset\":%lu,\"filenames\":[",
+                      (unsigned long)filenames->Version(), (unsigned long)total, (unsigned long)first);
+   for (uint32_t i = first; i < last; i++) {
+      if (i > first) {
+         page[pos++] = ',';
       }
+      page[pos++] = '"';
+      memcpy(page + pos, filenames->json.data() + filenames->offsets[i], filenames->lengths[i]);
+      pos += filenames->lengths[i];
+      page[pos++] = '"';
+   }
+   page[pos++] = ']';
 
-      strcat(imageJson, item);
-      pos += strlen(item);
+   if (last < total) {
+      pos += snprintf(page + pos, size - pos, ",\"next\":\"%lu.%lu\"",
+                      (unsigned long)filenames->Version(), (unsigned long)last);
    }
+   page[pos++] = '}';
+   page[pos] = 0;
 
-   imageJson[pos] = ']';
-   imageJson[pos + 1] = 0;
+   *length = pos;
+   return page;
+}
 
-   // Delete the images prior to clearing them.
-   for (auto item : images) {
-      delete[] item;
+/**
+   Builds the JSON document with the filenames matching the last /search call.
+ */
+static char *BuildSearchResults(int *length) {
+   auto filenames = (const FilenamesSnapshot*)filenamesSlot.Current();
+   std::vector<uint32_t> matches;
+   size_t total = filenames->index.Search(searchQuery, searchLimit, matches);
+
+   size_t size = 64;
+   for (auto i : matches) {
+      size += filenames->lengths[i] + 3;
    }
 
-   images.clear();
+   char *results = new char[size];
+   int pos = snprintf(results, size, "{\"total\":%lu,\"filenames\":[", (unsigned long)total);
+   for (size_t i = 0; i < matches.size(); i++) {
+      if (i > 0) {
+         results[pos++] = ',';
+      }
+      results[pos++] = '"';
+      memcpy(results + pos, filenames->json.data() + filenames->offsets[matches[i]], filenames->lengths[matches[i]]);
+      pos += filenames->lengths[matches[i]];
+      results[pos++] = '"';
+   }
+   results[pos++] = ']';
+   results[pos++] = '}';
+   results[pos] = 0;
+
+   *length = pos;
+   return results;
 }
 
-int get_file_contents(struct fs_file *file, const char *fileContents, int fileLen) {
+/**
+   Opens a file of fileLen bytes whose content is produced by next.
+ */
+int get_generated_file_contents(struct fs_file *file, const char *(*next)(CustomFile *file, size_t *length), int fileLen) {
    memset(file, 0, sizeof(struct fs_file));
-   if (fileContents) {
-      file->pextension = (void*)fileContents;
-      file->data = NULL;
-      file->len = fileLen;
-      file->index = 0;
-      file->flags = FS_FILE_FLAGS_HEADER_PERSISTENT;
-      return 1;
+   file->pextension = new CustomFile{NULL, NULL, NULL, next, NULL, 0, 0, 0};
+   file->data = NULL;
+   file->len = fileLen;
+   file->index = 0;
+   file->flags = FS_FILE_FLAGS_HEADER_PERSISTENT;
+   return 1;
+}
+
+/**
+   Produces /images.json from the image list snapshot held by the file: the
+   opening bracket, each image item followed by a separator and the closing bracket.
+ */
+static const char *NextImageJsonPiece(CustomFile *file, size_t *length) {
+   auto list = (const ImageListSnapshot*)file->snapshot;
+   size_t count = list->fragments.size();
+   size_t piece = file->item++;
+   *length = 1;
+   if (piece == 0) {
+      return "[";
+   }
+
+   size_t image = (piece - 1) / 2;
+   if (image < count) {
+      if (piece % 2 == 1) {
+         *length = list->lengths[image];
+         return list->fragments[image];
+      } else if (image + 1 < count) {
+         return ",";
+      }
+   }
+
+   if (piece == ((count > 0) ? 2 * count : 1)) {
+      return "]";
+   }
+
+   return NULL;
+}
+
+// Largest JSON object written for one trace event, longer ones are truncated.
+#define TRACE_EVENT_JSON_SIZE 160
+
+static const char TRACE_JSON_START[] =
+   "{\"traceEvents\":["
+   "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"core 0\"}},"
+   "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"core 1\"}}";
+static const char TRACE_JSON_END[] = "]}";
+
+/**
+   Trace events copied for a single /trace.json response.
+ */
+struct TraceDump : public Snapshot {
+   TraceEvent events[TRACE_COLLECT_MAX];
+   size_t count;
+};
+
+/**
+   Formats event as it follows the thread name events of /trace.json.
+ */
+static size_t FormatTraceJson(const TraceEvent &event, char (&buffer)[TRACE_EVENT_JSON_SIZE]) {
+   int length = FormatTraceEvent(event, false, buffer, sizeof(buffer));
+   if (length < 0) {
+      buffer[0] = 0;
+      return 0;
+   }
+   return ((size_t)length < sizeof(buffer)) ? length : sizeof(buffer) - 1;
+}
+
+/**
+   Produces /trace.json in the Chrome trace event format from the events
+   copied when it was opened.
+ */
+static const char *NextTracePiece(CustomFile *file, size_t *length) {
+   auto dump = (const TraceDump*)file->snapshot;
+   size_t piece = file->item++;
+   if (piece == 0) {
+      *length = sizeof(TRACE_JSON_START) - 1;
+      return TRACE_JSON_START;
+   } else if (piece <= dump->count) {
+      char buffer[TRACE_EVENT_JSON_SIZE];
+      *length = FormatTraceJson(dump->events[piece - 1], buffer);
+      file->scratch.assign(buffer, *length);
+      return file->scratch.data();
+   } else if (piece == dump->count + 1) {
+      *length = sizeof(TRACE_JSON_END) - 1;
+      return TRACE_JSON_END;
+   }
+
+   return NULL;
+}
+
+/**
+   Opens /trace.json with a copy of the latest trace events of both cores.
+ */
+static int open_trace_file(struct fs_file *file) {
+   auto dump = new TraceDump();
+   dump->count = TraceCollect(dump->events);
+
+   size_t length = sizeof(TRACE_JSON_START) - 1 + sizeof(TRACE_JSON_END) - 1;
+   char buffer[TRACE_EVENT_JSON_SIZE];
+   for (size_t i = 0; i < dump->count; i++) {
+      length += FormatTraceJson(dump->events[i], buffer);
+   }
+
+   get_generated_file_contents(file, NextTracePiece, length);
+   ((CustomFile*)file->pextension)->snapshot = dump;
+   return 1;
+}
+
+/**
+   Encodes image item number image of the list as CBOR into out. Items that
+   are not valid JSON are encoded as null so the length stays known.
+ */
+static void EncodeImageCbor(const ImageListSnapshot *list, size_t image, std::string &out) {
+   out.clear();
+   if (!JsonToCbor(list->fragments[image], list->lengths[image], out)) {
+      out.assign(1, (char)0xf6);
+   }
+}
+
+/**
+   Records the length of the /images.cbor array of the list, unless it is
+   already known.
+ */
+static void MeasureImageListCbor(ImageListSnapshot *list) {
+   if (list->cborLength > 0) {
+      return;
+   }
+
+   uint8_t head[CBOR_HEAD_MAX_SIZE];
+   std::string item;
+   size_t length = CborHead(CborType::Array, list->fragments.size(), head);
+   for (size_t i = 0; i < list->fragments.size(); i++) {
+      EncodeImageCbor(list, i, item);
+      length += item.size();
+   }
+   list->cborLength = length;
+}
+
+/**
+   Produces /images.cbor from the image list snapshot held by the file: the
+   array head followed by each image item, which is encoded as it is sent.
+ */
+static const char *NextImageCborPiece(CustomFile *file, size_t *length) {
+   auto list = (const ImageListSnapshot*)file->snapshot;
+   size_t piece = file->item++;
+   if (piece == 0) {
+      file->scratch.clear();
+      CborAppendHead(file->scratch, CborType::Array, list->fragments.size());
+   } else if (piece <= list->fragments.size()) {
+      EncodeImageCbor(list, piece - 1, file->scratch);
    } else {
+      return NULL;
+   }
+
+   *length = file->scratch.size();
+   return file->scratch.data();
+}
+
+/**
+   Produces /filenames.cbor from the filenames snapshot held by the file: the
+   heads of the map and of the filename array, followed by each filename.
+ */
+static const char *NextFilenameCborPiece(CustomFile *file, size_t *length) {
+   auto filenames = (const FilenamesSnapshot*)file->snapshot;
+   size_t piece = file->item++;
+   file->scratch.clear();
+   if (piece == 0) {
+      CborAppendHead(file->scratch, CborType::Map, 1);
+      CborAppendHead(file->scratch, CborType::Text, strlen("filenames"));
+      file->scratch += "filenames";
+      CborAppendHead(file->scratch, CborType::Array, filenames->offsets.size());
+   } else if (piece <= filenames->offsets.size()) {
+      const char *name = filenames->json.data() + filenames->offsets[piece - 1];
+      size_t nameLength = filenames->lengths[piece - 1];
+      size_t decodedLength = DecodeJsonString(name, nameLength, NULL);
+      CborAppendHead(file->scratch, CborType::Text, decodedLength);
+      size_t start = file->scratch.size();
+      file->scratch.resize(start + decodedLength);
+      DecodeJsonString(name, nameLength, &file->scratch[start]);
+   } else {
+      return NULL;
+   }
+
+   *length = file->scratch.size();
+   return file->scratch.data();
+}
+
+#if MEMP_STATS
+// Names of the lwIP memory pools, in the order of memp_t.
+static const char *const mempNames[] = {
+#define LWIP_MEMPOOL(name, num, size, desc) #name,
+#include "lwip/priv/memp_std.h"
+};
+#endif
+
+/**
+   Writes a gauge with a state label for each of names, set to 1 for the
+   current state and 0 for the others.
+ */
+static void WriteStateMetric(MetricsText &text, const char *name, const char *help, const char *const *names, size_t count, size_t current) {
+   text.Describe(name, "gauge", help);
+   std::string labels;
+   for (size_t i = 0; i < count; i++) {
+      labels = "state=";
+      MetricsText::AppendLabelValue(labels, names[i]);
+      text.Sample(name, labels.c_str(), (int64_t)(i == current));
+   }
+}
+
+/**
+   Builds the document served by /metrics in the Prometheus text format.
+ */
+static void BuildMetrics(std::string &out) {
+   MetricsText text(out);
+
+   routeMetrics.Write(text, "zuluide_http_request_duration_seconds", "Time from opening a response until it was closed, by route.");
+   text.Describe("zuluide_http_not_found_total", "counter", "Requests for files that do not exist.");
+   text.Sample("zuluide_http_not_found_total", NULL, (int64_t)httpNotFound);
+
+   zuluide::i2c::client::Stats i2c;
+   zuluide::i2c::client::GetStats(&i2c);
+   text.Describe("zuluide_i2c_frames_total", "counter", "I2C frames exchanged with the ZuluIDE.");
+   text.Sample("zuluide_i2c_frames_total", "direction=\"sent\"", (int64_t)i2c.framesSent);
+   text.Sample("zuluide_i2c_frames_total", "direction=\"received\"", (int64_t)i2c.framesReceived);
+   text.Describe("zuluide_i2c_bytes_total", "counter", "I2C bytes exchanged with the ZuluIDE.");
+   text.Sample("zuluide_i2c_bytes_total", "direction=\"sent\"", (int64_t)i2c.bytesSent);
+   text.Sample("zuluide_i2c_bytes_total", "direction=\"received\"", (int64_t)i2c.bytesReceived);
+   text.Describe("zuluide_i2c_queue_depth", "gauge", "Entries in the I2C queues.");
+   text.Sample("zuluide_i2c_queue_depth", "queue=\"output\"", (int64_t)i2c.outputQueueLevel);
+   text.Sample("zuluide_i2c_queue_depth", "queue=\"input\"", (int64_t)i2c.inputQueueLevel);
+   text.Sample("zuluide_i2c_queue_depth", "queue=\"avail_input\"", (int64_t)i2c.availInputQueueLevel);
+   text.Describe("zuluide_i2c_queue_high_water", "gauge", "Most entries the I2C queues held since boot.");
+   text.Sample("zuluide_i2c_queue_high_water", "queue=\"output\"", (int64_t)i2c.outputQueueHighWater);
+   text.Sample("zuluide_i2c_queue_high_water", "queue=\"input\"", (int64_t)i2c.inputQueueHighWater);
+   text.Describe("zuluide_i2c_queue_low_water", "gauge", "Fewest free receive buffers since boot.");
+   text.Sample("zuluide_i2c_queue_low_water", "queue=\"avail_input\"", (int64_t)i2c.availInputQueueLowWater);
+   text.Describe("zuluide_i2c_output_queue_resets_total", "counter", "Times the I2C output queue was cleared because it was full.");
+   text.Sample("zuluide_i2c_output_queue_resets_total", NULL, (int64_t)i2c.outputQueueResets);
+
+   size_t heapFree = HeapFree();
+   if (heapFree < heapMinFree) {
+      heapMinFree = heapFree;
+   }
+   text.Describe("zuluide_heap_free_bytes", "gauge", "Heap not allocated.");
+   text.Sample("zuluide_heap_free_bytes", NULL, (int64_t)heapFree);
+   text.Describe("zuluide_heap_min_free_bytes", "gauge", "Lowest free heap seen since boot.");
+   text.Sample("zuluide_heap_min_free_bytes", NULL, (int64_t)heapMinFree);
+
+#if MEM_STATS
+   text.Describe("zuluide_lwip_mem_bytes", "gauge", "lwIP heap usage.");
+   text.Sample("zuluide_lwip_mem_bytes", "kind=\"used\"", (int64_t)lwip_stats.mem.used);
+   text.Sample("zuluide_lwip_mem_bytes", "kind=\"max\"", (int64_t)lwip_stats.mem.max);
+   text.Sample("zuluide_lwip_mem_bytes", "kind=\"avail\"", (int64_t)lwip_stats.mem.avail);
+   text.Describe("zuluide_lwip_mem_errors_total", "counter", "Failed lwIP heap allocations.");
+   text.Sample("zuluide_lwip_mem_errors_total", NULL, (int64_t)lwip_stats.mem.err);
+#endif
+#if MEMP_STATS
+   text.Describe("zuluide_lwip_memp_used", "gauge", "Entries in use in each lwIP memory pool, including pbufs.");
+   std::string labels;
+   for (size_t i = 0; i < MEMP_MAX; i++) {
+      labels = "pool=";
+      MetricsText::AppendLabelValue(labels, mempNames[i]);
+      text.Sample("zuluide_lwip_memp_used", labels.c_str(), (int64_t)lwip_stats.memp[i]->used);
+   }
+   text.Describe("zuluide_lwip_memp_max", "gauge", "Most entries used in each lwIP memory pool.");
+   for (size_t i = 0; i < MEMP_MAX; i++) {
+      labels = "pool=";
+      MetricsText::AppendLabelValue(labels, mempNames[i]);
+      text.Sample("zuluide_lwip_memp_max", labels.c_str(), (int64_t)lwip_stats.memp[i]->max);
+   }
+   text.Describe("zuluide_lwip_memp_errors_total", "counter", "Failed allocations from each lwIP memory pool.");
+   for (size_t i = 0; i < MEMP_MAX; i++) {
+      labels = "pool=";
+      MetricsText::AppendLabelValue(labels, mempNames[i]);
+      text.Sample("zuluide_lwip_memp_errors_total", labels.c_str(), (int64_t)lwip_stats.memp[i]->err);
+   }
+#endif
+
+   if (wifiRssiValid) {
+      text.Describe("zuluide_wifi_rssi_dbm", "gauge", "WiFi signal strength.");
+      text.Sample("zuluide_wifi_rssi_dbm", NULL, (int64_t)wifiRssi);
+   }
+   text.Describe("zuluide_wifi_connects_total", "counter", "WiFi connection attempts, by result.");
+   text.Sample("zuluide_wifi_connects_total", "result=\"success\"", (int64_t)wifiConnects);
+   text.Sample("zuluide_wifi_connects_total", "result=\"failure\"", (int64_t)wifiConnectFailures);
+   text.Describe("zuluide_wifi_link_losses_total", "counter", "Times the WiFi link went down.");
+   text.Sample("zuluide_wifi_link_losses_total", NULL, (int64_t)wifiLinkLosses);
+
+   static const char *const filenameStates[] = {"idle", "start", "fetching", "full", "overflow"};
+   WriteStateMetric(text, "zuluide_filename_cache_state", "State of the filename cache.",
+                    filenameStates, sizeof(filenameStates) / sizeof(filenameStates[0]), (size_t)filenameState);
+   auto filenames = (const FilenamesSnapshot*)filenamesSlot.Current();
+   text.Describe("zuluide_filename_cache_filenames", "gauge", "Filenames in the published filename cache.");
+   text.Sample("zuluide_filename_cache_filenames", NULL, (int64_t)(filenames ? filenames->offsets.size() : 0));
+   text.Describe("zuluide_filename_cache_bytes", "gauge", "Size of the published filename cache JSON.");
+   text.Sample("zuluide_filename_cache_bytes", NULL, (int64_t)(filenames ? filenames->json.size() : 0));
+   text.Describe("zuluide_filename_cache_generation", "gauge", "Version of the published filename cache.");
+   text.Sample("zuluide_filename_cache_generation", NULL, (int64_t)filenamesSlot.Version());
+
+   static const char *const imageStates[] = {"idle", "fetching", "full"};
+   WriteStateMetric(text, "zuluide_image_cache_state", "State of the image list cache.",
+                    imageStates, sizeof(imageStates) / sizeof(imageStates[0]), (size_t)imageState);
+   auto imageList = (const ImageListSnapshot*)imagesSlot.Current();
+   text.Describe("zuluide_image_cache_images", "gauge", "Images in the published image list.");
+   text.Sample("zuluide_image_cache_images", NULL, (int64_t)(imageList ? imageList->fragments.size() : 0));
+   text.Describe("zuluide_image_cache_bytes", "gauge", "Size of the published image list JSON.");
+   text.Sample("zuluide_image_cache_bytes", NULL, (int64_t)(imageList ? imageList->jsonLength : 0));
+   text.Describe("zuluide_image_arena_bytes", "gauge", "Bytes allocated from the arena of the published image list.");
+   text.Sample("zuluide_image_arena_bytes", NULL, (int64_t)(imageList ? imageList->arena.Used() : 0));
+   text.Describe("zuluide_image_stream_images", "gauge", "Images buffered for /nextImage sessions.");
+   text.Sample("zuluide_image_stream_images", NULL, (int64_t)imageStream.Retained());
+   text.Describe("zuluide_image_stream_sessions", "gauge", "Open /nextImage sessions.");
+   text.Sample("zuluide_image_stream_sessions", NULL, (int64_t)imageStream.Sessions());
+   text.Describe("zuluide_image_stream_in_flight", "gauge", "Image requests waiting for the ZuluIDE.");
+   text.Sample("zuluide_image_stream_in_flight", NULL, (int64_t)imageStream.InFlight());
+
+   const fwupgrade_stats *upgrade = fwupgrade_get_stats();
+   text.Describe("zuluide_fwupgrade_bytes", "gauge", "Bytes received by the last firmware upload.");
+   text.Sample("zuluide_fwupgrade_bytes", NULL, (int64_t)upgrade->bytes_received);
+   text.Describe("zuluide_fwupgrade_duration_us", "gauge", "Duration of the last finished firmware upload.");
+   text.Sample("zuluide_fwupgrade_duration_us", NULL, (int64_t)upgrade->duration_us);
+   text.Describe("zuluide_fwupgrade_max_irq_off_us", "gauge", "Longest time interrupts were disabled for flash during the last firmware upload.");
+   text.Sample("zuluide_fwupgrade_max_irq_off_us", NULL, (int64_t)upgrade->max_irq_off_us);
+   text.Describe("zuluide_fwupgrade_flash_operations", "gauge", "Flash operations of the last firmware upload.");
+   text.Sample("zuluide_fwupgrade_flash_operations", "operation=\"erase\"", (int64_t)upgrade->sectors_erased);
+   text.Sample("zuluide_fwupgrade_flash_operations", "operation=\"program\"", (int64_t)upgrade->program_operations);
+   text.Describe("zuluide_fwupgrade_blocks_programmed", "gauge", "UF2 blocks programmed by the last firmware upload.");
+   text.Sample("zuluide_fwupgrade_blocks_programmed", NULL, (int64_t)upgrade->blocks_programmed);
+
+   const fwupgrade_commit_result *commit = fwupgrade_get_commit_result();
+   if (commit->valid) {
+      text.Describe("zuluide_fwupgrade_commit_sectors", "gauge", "Sectors of the firmware image committed before the last reboot.");
+      text.Sample("zuluide_fwupgrade_commit_sectors", "state=\"rewritten\"", (int64_t)commit->sectors_rewritten);
+      text.Sample("zuluide_fwupgrade_commit_sectors", "state=\"unchanged\"", (int64_t)(commit->sectors_total - commit->sectors_rewritten));
+      text.Describe("zuluide_fwupgrade_commit_duration_us", "gauge", "Time interrupts were disabled to commit the firmware before the last reboot.");
+      text.Sample("zuluide_fwupgrade_commit_duration_us", NULL, (int64_t)commit->duration_us);
+   }
+}
+
+static int open_custom_file(struct fs_file *file, const char *name);
+
+/**
+   Opens the CBOR encoding of a JSON file. The filename and image lists are
+   encoded piece by piece as they are sent, while the other files are small
+   enough to be encoded as a whole. The length of an image list is measured
+   once and kept with the list.
+ */
+static int open_cbor_file(struct fs_file *file, const char *name) {
+   uint8_t head[CBOR_HEAD_MAX_SIZE];
+   if (strcmp(name, "/filenames.cbor") == 0) {
+      auto filenames = (FilenamesSnapshot*)filenamesSlot.Current();
+      if (filenames == nullptr) {
+         return 0;
+      }
+
+      size_t length = 1 + 1 + strlen("filenames") + CborHead(CborType::Array, filenames->offsets.size(), head);
+      for (size_t i = 0; i < filenames->offsets.size(); i++) {
+         size_t decodedLength = DecodeJsonString(filenames->json.data() + filenames->offsets[i], filenames->lengths[i], NULL);
+         length += CborHead(CborType::Text, decodedLength, head) + decodedLength;
+      }
+      get_generated_file_contents(file, NextFilenameCborPiece, length);
+      ((CustomFile*)file->pextension)->snapshot = filenames->Acquire();
+      return 1;
+   } else if (strcmp(name, "/images.cbor") == 0) {
+      auto list = (ImageListSnapshot*)imagesSlot.Current();
+      if (list == nullptr) {
+         return 0;
+      }
+
+      MeasureImageListCbor(list);
+      get_generated_file_contents(file, NextImageCborPiece, list->cborLength);
+      ((CustomFile*)file->pextension)->snapshot = list->Acquire();
+      return 1;
+   }
+
+   char jsonName[32];
+   size_t baseLength = strlen(name) - strlen(".cbor");
+   if (baseLength + sizeof(".json") > sizeof(jsonName)) {
       return 0;
    }
+   memcpy(jsonName, name, baseLength);
+   strcpy(jsonName + baseLength, ".json");
+
+   struct fs_file json;
+   if (!open_custom_file(&json, jsonName)) {
+      return 0;
+   }
+   CustomFile *jsonFile = (CustomFile*)json.pextension;
+   std::string cbor;
+   bool encoded = jsonFile->data != NULL && JsonToCbor(jsonFile->data, json.len, cbor);
+   fs_close_custom(&json);
+   if (!encoded) {
+      LOG_WARN("Unable to encode %s as CBOR\n", jsonName);
+      return 0;
+   }
+
+   return get_string_file_contents(file, cbor);
 }
 
-int fs_open_custom(struct fs_file *file, const char *name) {
-   printf("open custom name: %s\n", name);
+/**
+   Opens the file answering a request for name, without counting it in the
+   route metrics.
+ */
+static int open_custom_file(struct fs_file *file, const char *name) {
+   size_t nameLength = strlen(name);
+   if (nameLength > strlen(".cbor") && strcmp(name + nameLength - strlen(".cbor"), ".cbor") == 0) {
+      return open_cbor_file(file, name);
+   }
+
    if (strncmp(name, "/status.json", sizeof("/status.json")) == 0) {
-      return get_file_contents(file, currentStatus, strlen(currentStatus));
+      auto status = (TextSnapshot*)statusSlot.Current();
+      if (status == nullptr) {
+         return get_file_contents(file, "", 0);
+      }
+      return get_snapshot_file_contents(file, status, status->text.data(), status->text.size());
+   } else if (strncmp(name, "/status_fields.json", sizeof("/status_fields.json")) == 0) {
+      std::string fields;
+      statusModel.Project(statusFields, fields);
+      return get_string_file_contents(file, fields);
+   } else if (strncmp(name, "/status_delta.json", sizeof("/status_delta.json")) == 0) {
+      std::string delta;
+      statusModel.Delta(statusSince, delta);
+      return get_string_file_contents(file, delta);
    } else if (strncmp(name, "/images.json", sizeof("/images.json")) == 0) {
-      return get_file_contents(file, imageJson, strlen(imageJson));
+      auto list = (ImageListSnapshot*)imagesSlot.Current();
+      if (list == nullptr) {
+         return 0;
+      }
+
+      get_generated_file_contents(file, NextImageJsonPiece, list->jsonLength);
+      ((CustomFile*)file->pextension)->snapshot = list->Acquire();
+      return 1;
    } else if (strncmp(name, "/ok.json", sizeof("/ok.json")) == 0) {
       auto okMessage = "{\"status\": \"ok\"}";
       return get_file_contents(file, okMessage, strlen(okMessage));
@@ -935,6 +2161,27 @@ int fs_open_custom(struct fs_file *file, const char *name) {
    } else if (strncmp(name, "/overflow.json", sizeof("/overflow.json")) == 0) {
       auto waitMessage = "{\"status\": \"overflow\"}";
       return get_file_contents(file, waitMessage, strlen(waitMessage));
+   } else if (strncmp(name, "/stale.json", sizeof("/stale.json")) == 0) {
+      auto staleMessage = "{\"status\": \"stale\"}";
+      return get_file_contents(file, staleMessage, strlen(staleMessage));
+   } else if (strncmp(name, "/session.json", sizeof("/session.json")) == 0) {
+      char *sessionMessage = new char[48];
+      int length = snprintf(sessionMessage, 48, "{\"status\": \"wait\", \"session\": %lu}", (unsigned long)nextImageSession);
+      return get_owned_file_contents(file, sessionMessage, length);
+   } else if (strncmp(name, "/expired.json", sizeof("/expired.json")) == 0) {
+      auto expiredMessage = "{\"status\": \"expired\"}";
+      return get_file_contents(file, expiredMessage, strlen(expiredMessage));
+   } else if (strncmp(name, "/command_id.json", sizeof("/command_id.json")) == 0) {
+      char *idMessage = new char[48];
+      int length = snprintf(idMessage, 48, "{\"status\": \"ok\", \"id\": %lu}", (unsigned long)commandId);
+      return get_owned_file_contents(file, idMessage, length);
+   } else if (strncmp(name, "/command.json", sizeof("/command.json")) == 0) {
+      std::string progress;
+      commandTracker.Expire(time_us_32());
+      commandTracker.Describe(commandId, progress);
+      return get_string_file_contents(file, progress);
+   } else if (strncmp(name, "/batch.json", sizeof("/batch.json")) == 0) {
+      return get_string_file_contents(file, batchResult);
    } else if (strncmp(name, "/done.json", sizeof("/done.json")) == 0) {
       auto doneMessage = "{\"status\": \"done\"}";
       return get_file_contents(file, doneMessage, strlen(doneMessage));
@@ -947,13 +2194,30 @@ int fs_open_custom(struct fs_file *file, const char *name) {
    } else if (strncmp(name, "/style.css", sizeof("/style.css")) == 0) {
       return get_file_contents(file, style_css, strlen(style_css));
    } else if (strncmp(name, "/filenames.json", sizeof("/filenames.json")) == 0) {
-      return get_file_contents(file, filenames_json, strlen(filenames_json));
+      auto filenames = (FilenamesSnapshot*)filenamesSlot.Current();
+      if (filenames == nullptr) {
+         return 0;
+      }
+      return get_snapshot_file_contents(file, filenames, filenames->json.data(), filenames->json.size());
+   } else if (strncmp(name, "/filenames_page.json", sizeof("/filenames_page.json")) == 0) {
+      int length;
+      char *page = BuildFilenamesPage(&length);
+      return get_owned_file_contents(file, page, length);
+   } else if (strncmp(name, "/search.json", sizeof("/search.json")) == 0) {
+      int length;
+      char *results = BuildSearchResults(&length);
+      return get_owned_file_contents(file, results, length);
    } else if (strncmp(name, "/nextImage.json", sizeof("/nextImage.json")) == 0) {
-      char *image;
-      if (queue_try_remove(&imageQueue, &image)) {
-         int retVal = get_file_contents(file, image, strlen(image));
-         delete[] image;
-         return retVal;
+      const char *image;
+      if (imageStream.Peek(nextImageSession, millis(), &image) == ImageStream::Result::Image) {
+         // Other sessions may still need the image, so the client gets a copy.
+         size_t length = strlen(image);
+         char *copy = new char[length + 1];
+         memcpy(copy, image, length + 1);
+         imageStream.Advance(nextImageSession);
+         // The client is about to receive this one, so request the next.
+         PrefetchImages();
+         return get_owned_file_contents(file, copy, length);
       }
 
       return 0;
@@ -962,14 +2226,85 @@ int fs_open_custom(struct fs_file *file, const char *name) {
       return get_file_contents(file, version_js, strlen(version_js));
    } else if (strncmp(name, "/version.json", sizeof("/version.json")) == 0) {
       return get_file_contents(file, versionJson, strlen(versionJson));
+   } else if (strncmp(name, "/fw_upgrade_status.json", sizeof("/fw_upgrade_status.json")) == 0) {
+      char status[160];
+      int length = fwupgrade_status_json(status, sizeof(status));
+      return get_string_file_contents(file, std::string(status, length));
+   } else if (strncmp(name, "/fw_upgrade_result.json", sizeof("/fw_upgrade_result.json")) == 0) {
+      char result[96];
+      int length = fwupgrade_result_json(result, sizeof(result));
+      return get_string_file_contents(file, std::string(result, length));
+   } else if (strncmp(name, "/trace.json", sizeof("/trace.json")) == 0) {
+      return open_trace_file(file);
+   } else if (strncmp(name, "/metrics", sizeof("/metrics")) == 0) {
+      std::string metrics;
+      BuildMetrics(metrics);
+      return get_string_file_contents(file, metrics);
    } else {
-      printf("Unable to find %s\n", name);
+      LOG_WARN("Unable to find %s\n", name);
       return 0;
    }
 }
 
+int fs_open_custom(struct fs_file *file, const char *name) {
+   LOG_DEBUG("open custom name: %s\n", name);
+   TraceScope trace("fs_open");
+   uint32_t openedUs = time_us_32();
+   if (!open_custom_file(file, name)) {
+      httpNotFound++;
+      return 0;
+   }
+
+   CustomFile *customFile = (CustomFile*)file->pextension;
+   customFile->timed = true;
+   customFile->route = routeMetrics.Find(name);
+   customFile->openedUs = openedUs;
+   return 1;
+}
+
 void fs_close_custom(struct fs_file *file) {
-   printf("close custom closing file\n");
+   LOG_DEBUG("close custom closing file\n");
+   CustomFile *customFile = (CustomFile*)file->pextension;
+   if (customFile) {
+      TRACE_INSTANT("fs_close", file->index);
+      if (customFile->timed) {
+         routeMetrics.Observe(customFile->route, time_us_32() - customFile->openedUs);
+      }
+      delete[] customFile->owned;
+      if (customFile->snapshot) {
+         customFile->snapshot->Release();
+      }
+      delete customFile;
+      file->pextension = NULL;
+   }
+}
+
+/**
+   Copies up to count bytes of a generated file into buffer.
+ */
+static int read_pieces(CustomFile *customFile, char *buffer, int count) {
+   int read = 0;
+   while (read < count) {
+      if (customFile->piecePos == customFile->pieceLength) {
+         customFile->piece = customFile->next(customFile, &customFile->pieceLength);
+         customFile->piecePos = 0;
+         if (customFile->piece == NULL) {
+            customFile->pieceLength = 0;
+            break;
+         }
+         continue;
+      }
+
+      size_t toCopy = customFile->pieceLength - customFile->piecePos;
+      if (toCopy > (size_t)(count - read)) {
+         toCopy = count - read;
+      }
+      memcpy(buffer + read, customFile->piece + customFile->piecePos, toCopy);
+      customFile->piecePos += toCopy;
+      read += toCopy;
+   }
+
+   return read;
 }
 
 int fs_read_custom(struct fs_file *file, char *buffer, int count) 
@@ -977,7 +2312,14 @@ int fs_read_custom(struct fs_file *file, char *buffer, int count)
    if (file->index >= file->len)
       return FS_READ_EOF;
    int read = (file->len - file->index < count) ? file->len - file->index : count; 
-   memcpy(buffer, (char*) file->pextension + file->index, read);
+   CustomFile *customFile = (CustomFile*)file->pextension;
+   if (customFile->next) {
+      read = read_pieces(customFile, buffer, read);
+      if (read == 0)
+         return FS_READ_EOF;
+   } else {
+      memcpy(buffer, customFile->data + file->index, read);
+   }
    file->index += read;
    return read;
 }
@@ -0,0 +1,168 @@
+/**
+ * ZuluIDE™ - Copyright (c) 2023 Rabbit Hole Computing™
+ *
+ * ZuluIDE™ firmware is licensed under the GPL version 3 or any later version.
+ *
+ * https://www.gnu.org/licenses/gpl-3.0.html
+ * ----
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ **/
+
+#include "metrics.h"
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+
+const uint32_t LatencyHistogram::BoundsUs[METRICS_LATENCY_BUCKETS] = {1000, 5000, 10000, 25000, 50000, 100000, 250000, 1000000};
+
+void LatencyHistogram::Observe(uint32_t us) {
+   size_t i = 0;
+   while (i < METRICS_LATENCY_BUCKETS && us > BoundsUs[i]) {
+      i++;
+   }
+   buckets[i]++;
+   count++;
+   sumUs += us;
+}
+
+uint32_t LatencyHistogram::Cumulative(size_t i) const {
+   uint32_t total = 0;
+   for (size_t j = 0; j <= i && j <= METRICS_LATENCY_BUCKETS; j++) {
+      total += buckets[j];
+   }
+   return total;
+}
+
+void MetricsText::Describe(const char *name, const char *type, const char *help) {
+   out += "# HELP ";
+   out += name;
+   out += ' ';
+   out += help;
+   out += "\n# TYPE ";
+   out += name;
+   out += ' ';
+   out += type;
+   out += '\n';
+}
+
+void MetricsText::Start(const char *name, const char *suffix, const char *labels, const char *extra) {
+   out += name;
+   out += suffix;
+   bool hasLabels = labels != NULL && labels[0] != 0;
+   if (hasLabels || extra != NULL) {
+      out += '{';
+      if (hasLabels) {
+         out += labels;
+      }
+      if (extra != NULL) {
+         if (hasLabels) {
+            out += ',';
+         }
+         out += extra;
+      }
+      out += '}';
+   }
+   out += ' ';
+}
+
+void MetricsText::Sample(const char *name, const char *labels, int64_t value) {
+   char number[24];
+   snprintf(number, sizeof(number), "%" PRId64 "\n", value);
+   Start(name, "", labels, NULL);
+   out += number;
+}
+
+void MetricsText::Histogram(const char *name, const char *labels, const LatencyHistogram &histogram) {
+   char text[40];
+   for (size_t i = 0; i <= METRICS_LATENCY_BUCKETS; i++) {
+      if (i < METRICS_LATENCY_BUCKETS) {
+         uint32_t us = LatencyHistogram::BoundsUs[i];
+         snprintf(text, sizeof(text), "le=\"%lu.%06lu\"", (unsigned long)(us / 1000000), (unsigned long)(us % 1000000));
+      } else {
+         strcpy(text, "le=\"+Inf\"");
+      }
+      Start(name, "_bucket", labels, text);
+      snprintf(text, sizeof(text), "%lu\n", (unsigned long)histogram.Cumulative(i));
+      out += text;
+   }
+
+   uint64_t sumUs = histogram.SumUs();
+   Start(name, "_sum", labels, NULL);
+   snprintf(text, sizeof(text), "%" PRIu64 ".%06lu\n", sumUs / 1000000, (unsigned long)(sumUs % 1000000));
+   out += text;
+   Start(name, "_count", labels, NULL);
+   snprintf(text, sizeof(text), "%lu\n", (unsigned long)histogram.Count());
+   out += text;
+}
+
+void MetricsText::AppendLabelValue(std::string &labels, const char *value) {
+   labels += '"';
+   for (const char *c = value; *c != 0; c++) {
+      if (*c == '\\' || *c == '"') {
+         labels += '\\';
+         labels += *c;
+      } else if (*c == '\n') {
+         labels += "\\n";
+      } else {
+         labels += *c;
+      }
+   }
+   labels += '"';
+}
+
+RouteMetrics::RouteMetrics(size_t capacity) : routes(new Route[capacity]), capacity(capacity) {
+   strcpy(other.name, "other");
+}
+
+RouteMetrics::~RouteMetrics() {
+   delete[] routes;
+}
+
+size_t RouteMetrics::Find(const char *route) {
+   for (size_t i = 0; i < used; i++) {
+      if (strncmp(routes[i].name, route, METRICS_ROUTE_NAME_SIZE - 1) == 0) {
+         return i;
+      }
+   }
+
+   if (used == capacity) {
+      return capacity;
+   }
+   strncpy(routes[used].name, route, METRICS_ROUTE_NAME_SIZE - 1);
+   routes[used].name[METRICS_ROUTE_NAME_SIZE - 1] = 0;
+   return used++;
+}
+
+void RouteMetrics::Observe(size_t index, uint32_t us) {
+   if (index < used) {
+      routes[index].latency.Observe(us);
+   } else {
+      other.latency.Observe(us);
+   }
+}
+
+void RouteMetrics::Write(MetricsText &text, const char *name, const char *help) const {
+   text.Describe(name, "histogram", help);
+   std::string labels;
+   for (size_t i = 0; i <= used; i++) {
+      const Route &route = (i < used) ? routes[i] : other;
+      if (i == used && route.latency.Count() == 0) {
+         break;
+      }
+      labels = "route=";
+      MetricsText::AppendLabelValue(labels, route.name);
+      text.Histogram(name, labels.c_str(), route.latency);
+   }
+}
@@ -0,0 +1,126 @@
+/**
+ * ZuluIDE™ - Copyright (c) 2023 Rabbit Hole Computing™
+ *
+ * ZuluIDE™ firmware is licensed under the GPL version 3 or any later version.
+ *
+ * https://www.gnu.org/licenses/gpl-3.0.html
+ * ----
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ **/
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Number of finite latency histogram buckets.
+#define METRICS_LATENCY_BUCKETS 8
+
+// Longest route name kept, including the terminator.
+#define METRICS_ROUTE_NAME_SIZE 32
+
+/**
+   Histogram of latencies in microseconds, with the bucket bounds of
+   BoundsUs and an implicit +Inf bucket.
+ */
+class LatencyHistogram {
+  public:
+   static const uint32_t BoundsUs[METRICS_LATENCY_BUCKETS];
+
+   void Observe(uint32_t us);
+
+   /**
+      Observations at or below BoundsUs[i], or every observation for
+      i == METRICS_LATENCY_BUCKETS, as Prometheus buckets are cumulative.
+    */
+   uint32_t Cumulative(size_t i) const;
+
+   uint32_t Count() const { return count; }
+   uint64_t SumUs() const { return sumUs; }
+
+  private:
+   uint32_t buckets[METRICS_LATENCY_BUCKETS + 1] = {};
+   uint32_t count = 0;
+   uint64_t sumUs = 0;
+};
+
+/**
+   Writes metrics in the Prometheus text exposition format. labels are
+   written as given, e.g. queue="output", and may be NULL.
+ */
+class MetricsText {
+  public:
+   explicit MetricsText(std::string &out) : out(out) {}
+
+   /**
+      Writes the HELP and TYPE lines that precede the samples of name.
+    */
+   void Describe(const char *name, const char *type, const char *help);
+
+   void Sample(const char *name, const char *labels, int64_t value);
+
+   /**
+      Writes the buckets, sum and count of histogram in seconds.
+    */
+   void Histogram(const char *name, const char *labels, const LatencyHistogram &histogram);
+
+   /**
+      Appends value to a label list, escaping it as the format requires.
+    */
+   static void AppendLabelValue(std::string &labels, const char *value);
+
+  private:
+   void Start(const char *name, const char *suffix, const char *labels, const char *extra);
+
+   std::string &out;
+};
+
+/**
+   Request latencies of each route, for up to capacity routes. Later routes
+   are counted under "other".
+ */
+class RouteMetrics {
+  public:
+   explicit RouteMetrics(size_t capacity);
+   ~RouteMetrics();
+   RouteMetrics(const RouteMetrics &) = delete;
+   RouteMetrics &operator=(const RouteMetrics &) = delete;
+
+   /**
+      Returns the index of route to pass to Observe, adding it if needed.
+    */
+   size_t Find(const char *route);
+
+   void Observe(size_t index, uint32_t us);
+
+   /**
+      Writes a histogram of name with a route label for each route.
+    */
+   void Write(MetricsText &text, const char *name, const char *help) const;
+
+  private:
+   struct Route {
+      char name[METRICS_ROUTE_NAME_SIZE];
+      LatencyHistogram latency;
+   };
+
+   Route *routes;
+   size_t capacity;
+   size_t used = 0;
+   Route other;
+};
+
+#endif
@@ -0,0 +1,72 @@
+/**
+ * ZuluIDE™ - Copyright (c) 2023 Rabbit Hole Computing™
+ *
+ * ZuluIDE™ firmware is licensed under the GPL version 3 or any later version.
+ *
+ * https://www.gnu.org/licenses/gpl-3.0.html
+ * ----
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ **/
+
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <cstddef>
+#include <cstdint>
+
+#define SHA256_DIGEST_SIZE 32
+#define SHA256_BLOCK_SIZE 64
+#define SHA256_STATE_WORDS 8
+
+/**
+   Software SHA-256 computed as data arrives. The state can be saved at a
+   multiple of the block size and the hash resumed from it later.
+ */
+class Sha256 {
+  public:
+   Sha256() { Reset(); }
+
+   void Reset();
+
+   /**
+      Continues the hash of length bytes, a multiple of SHA256_BLOCK_SIZE,
+      that left the given state.
+    */
+   void Resume(const uint32_t *state, uint64_t length);
+
+   void Update(const uint8_t *data, size_t length);
+
+   /**
+      State after the bytes hashed so far, which can be resumed when Length()
+      is a multiple of SHA256_BLOCK_SIZE.
+    */
+   const uint32_t *State() const { return state; }
+   uint64_t Length() const { return length; }
+
+   void Finish(uint8_t *digest);
+
+  private:
+   void Compress(const uint8_t *block);
+
+   uint32_t state[SHA256_STATE_WORDS];
+   uint64_t length;
+   uint8_t buffer[SHA256_BLOCK_SIZE];
+};
+
+/**
+   Parses a digest written as 64 hex digits, returns false if it is not one.
+ */
+bool ParseSha256(const char *hex, uint8_t *digest);
+
+#endif
@@ -0,0 +1,114 @@
+/**
+ * ZuluIDE™ - Copyright (c) 2023 Rabbit Hole Computing™
+ *
+ * ZuluIDE™ firmware is licensed under the GPL version 3 or any later version.
+ *
+ * https://www.gnu.org/licenses/gpl-3.0.html
+ * ----
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ **/
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <cstdint>
+#include <string>
+
+/**
+   Immutable, reference counted data shared between its writer and the web
+   server. A writer fills a new snapshot and publishes it in a SnapshotSlot;
+   responses keep the snapshot they started with until they are closed, so a
+   newer version never changes data that is partly sent.
+
+   The reference count is not atomic. Readers run in the lwIP context, so the
+   writer must publish from that context or with it locked, i.e. between
+   cyw43_arch_lwip_begin() and cyw43_arch_lwip_end().
+ */
+class Snapshot {
+  public:
+   virtual ~Snapshot() {}
+
+   /**
+      Takes another reference to the snapshot.
+    */
+   Snapshot *Acquire() {
+      refs++;
+      return this;
+   }
+
+   /**
+      Drops a reference, deleting the snapshot with the last one.
+    */
+   void Release() {
+      if (--refs == 0) {
+         delete this;
+      }
+   }
+
+   /**
+      Version the snapshot was published as, starting from one.
+    */
+   uint32_t Version() const { return version; }
+
+  private:
+   friend class SnapshotSlot;
+   uint16_t refs = 1;
+   uint32_t version = 0;
+};
+
+/**
+   Snapshot of a text document.
+ */
+class TextSnapshot : public Snapshot {
+  public:
+   explicit TextSnapshot(std::string &&text) : text(std::move(text)) {}
+   const std::string text;
+};
+
+/**
+   Holds the latest published snapshot.
+ */
+class SnapshotSlot {
+  public:
+   ~SnapshotSlot();
+
+   /**
+      Makes snapshot the current one, taking over the reference of the caller,
+      and releases the snapshot it replaces.
+    */
+   void Publish(Snapshot *snapshot);
+
+   /**
+      Returns a new reference to the current snapshot, or nullptr if none has
+      been published.
+    */
+   Snapshot *Acquire() const { return current ? current->Acquire() : nullptr; }
+
+   /**
+      Returns the current snapshot without taking a reference. It is only
+      valid until the next Publish.
+    */
+   Snapshot *Current() const { return current; }
+
+   /**
+      Number of snapshots published so far.
+    */
+   uint32_t Version() const { return version; }
+
+  private:
+   Snapshot *current = nullptr;
+   uint32_t version = 0;
+};
+
+#endif
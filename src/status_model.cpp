@@ -0,0 +1,187 @@
+/**
+ * ZuluIDE™ - Copyright (c) 2023 Rabbit Hole Computing™
+ *
+ * ZuluIDE™ firmware is licensed under the GPL version 3 or any later version.
+ *
+ * https://www.gnu.org/licenses/gpl-3.0.html
+ * ----
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ **/
+
+#include "status_model.h"
+#include "json_scan.h"
+
+#include <cstring>
+
+bool StatusModel::Update(const char *json, size_t length) {
+   const char *end = json + length;
+   const char *p = JsonSkipSpace(json, end);
+   if (p == end || *p != '{') {
+      return false;
+   }
+
+   // Parse into a list of spans first so a malformed status changes nothing.
+   struct Span {
+      const char *name;
+      size_t nameLength;
+      const char *value;
+      size_t valueLength;
+   };
+   std::vector<Span> spans;
+   p = JsonSkipSpace(p + 1, end);
+   while (p < end && *p != '}') {
+      if (*p != '"') {
+         return false;
+      }
+      const char *nameEnd = JsonSkipString(p, end);
+      if (nameEnd == nullptr) {
+         return false;
+      }
+      Span span = {p + 1, (size_t)(nameEnd - p - 2), nullptr, 0};
+      p = JsonSkipSpace(nameEnd, end);
+      if (p == end || *p != ':') {
+         return false;
+      }
+      p = JsonSkipSpace(p + 1, end);
+      const char *valueEnd = JsonSkipValue(p, end);
+      if (valueEnd == nullptr || valueEnd == p) {
+         return false;
+      }
+      // Trailing whitespace of numbers and literals is not part of the value.
+      const char *trimmed = valueEnd;
+      while (trimmed > p && (trimmed[-1] == ' ' || trimmed[-1] == '\t' || trimmed[-1] == '\r' || trimmed[-1] == '\n')) {
+         trimmed--;
+      }
+      span.value = p;
+      span.valueLength = trimmed - p;
+      spans.push_back(span);
+
+      p = JsonSkipSpace(valueEnd, end);
+      if (p < end && *p == ',') {
+         p = JsonSkipSpace(p + 1, end);
+      }
+   }
+   if (p == end) {
+      return false;
+   }
+
+   uint32_t next = generation + 1;
+   bool changed = false;
+   for (auto &field : fields) {
+      bool found = false;
+      for (auto &span : spans) {
+         if (span.nameLength == field.name.size() && memcmp(span.name, field.name.data(), span.nameLength) == 0) {
+            found = true;
+            break;
+         }
+      }
+      if (!found && field.present) {
+         field.present = false;
+         field.value.clear();
+         field.changed = next;
+         changed = true;
+      }
+   }
+
+   for (auto &span : spans) {
+      Field *field = Find(span.name, span.nameLength);
+      if (field == nullptr) {
+         fields.push_back(Field{std::string(span.name, span.nameLength), std::string(span.value, span.valueLength), next, true});
+         changed = true;
+      } else if (!field->present || field->value.compare(0, std::string::npos, span.value, span.valueLength) != 0) {
+         field->value.assign(span.value, span.valueLength);
+         field->present = true;
+         field->changed = next;
+         changed = true;
+      }
+   }
+
+   if (changed) {
+      generation = next;
+   }
+   return true;
+}
+
+void StatusModel::Project(const char *names, std::string &out) const {
+   out += '{';
+   bool first = true;
+   while (*names) {
+      const char *comma = strchr(names, ',');
+      size_t length = comma ? (size_t)(comma - names) : strlen(names);
+      const Field *field = Find(names, length);
+      if (field != nullptr && field->present) {
+         if (!first) {
+            out += ',';
+         }
+         first = false;
+         out += '"';
+         out += field->name;
+         out += "\":";
+         out += field->value;
+      }
+      names += length;
+      if (*names == ',') {
+         names++;
+      }
+   }
+   out += '}';
+}
+
+bool StatusModel::Get(const char *name, std::string &value) const {
+   const Field *field = Find(name, strlen(name));
+   if (field == nullptr || !field->present) {
+      return false;
+   }
+
+   value = field->value;
+   return true;
+}
+
+void StatusModel::Delta(uint32_t since, std::string &out) const {
+   if (since > generation) {
+      since = 0;
+   }
+
+   out += "{\"generation\":";
+   out += std::to_string(generation);
+   out += ",\"changed\":{";
+   bool first = true;
+   for (auto &field : fields) {
+      if (field.changed <= since || (since == 0 && !field.present)) {
+         continue;
+      }
+      if (!first) {
+         out += ',';
+      }
+      first = false;
+      out += '"';
+      out += field.name;
+      out += "\":";
+      out += field.present ? field.value : "null";
+   }
+   out += "}}";
+}
+
+StatusModel::Field *StatusModel::Find(const char *name, size_t length) {
+   for (auto &field : fields) {
+      if (field.name.size() == length && memcmp(field.name.data(), name, length) == 0) {
+         return &field;
+      }
+   }
+   return nullptr;
+}
+
+const StatusModel::Field *StatusModel::Find(const char *name, size_t length) const {
+   return const_cast<StatusModel*>(this)->Find(name, length);
+}
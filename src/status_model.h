@@ -0,0 +1,86 @@
+/**
+ * ZuluIDE™ - Copyright (c) 2023 Rabbit Hole Computing™
+ *
+ * ZuluIDE™ firmware is licensed under the GPL version 3 or any later version.
+ *
+ * https://www.gnu.org/licenses/gpl-3.0.html
+ * ----
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ **/
+
+#ifndef STATUS_MODEL_H
+#define STATUS_MODEL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+   Top level fields of the status JSON sent by the ZuluIDE. Each field keeps
+   its value as JSON text together with the generation in which it last
+   changed, so clients can ask for a subset of the fields or only for those
+   that changed since a generation they have already seen.
+ */
+class StatusModel {
+  public:
+   /**
+      Replaces the fields with those of the JSON object in json. Fields that
+      are missing from json are marked as removed. Returns false, leaving the
+      model unchanged, if json is not an object; otherwise the generation is
+      advanced if any field changed.
+    */
+   bool Update(const char *json, size_t length);
+
+   /**
+      Generation of the latest change, zero before the first status.
+    */
+   uint32_t Generation() const { return generation; }
+
+   /**
+      Appends a JSON object to out with the present fields whose names are
+      listed in names, separated by commas. Unknown names are skipped.
+    */
+   void Project(const char *names, std::string &out) const;
+
+   /**
+      Stores the JSON text of field name in value, returning false if the
+      field is not present.
+    */
+   bool Get(const char *name, std::string &value) const;
+
+   /**
+      Appends a JSON object to out with the current generation and the fields
+      that changed after generation since, where removed fields are null. A
+      since of zero or one from the future, e.g. from before a restart,
+      returns every present field.
+    */
+   void Delta(uint32_t since, std::string &out) const;
+
+  private:
+   struct Field {
+      std::string name;
+      std::string value;
+      uint32_t changed;
+      bool present;
+   };
+
+   Field *Find(const char *name, size_t length);
+   const Field *Find(const char *name, size_t length) const;
+
+   std::vector<Field> fields;
+   uint32_t generation = 0;
+};
+
+#endif
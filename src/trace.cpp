@@ -0,0 +1,57 @@
+/**
+ * ZuluIDE™ - Copyright (c) 2023 Rabbit Hole Computing™
+ *
+ * ZuluIDE™ firmware is licensed under the GPL version 3 or any later version.
+ *
+ * https://www.gnu.org/licenses/gpl-3.0.html
+ * ----
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ **/
+
+#include "trace.h"
+
+#include <hardware/sync.h>
+#include <hardware/timer.h>
+#include <pico/platform.h>
+
+#include <algorithm>
+
+static TraceEvent traceEntries[NUM_CORES][TRACE_RING_ENTRIES];
+static TraceRing traceRings[NUM_CORES] = {
+   TraceRing(traceEntries[0], TRACE_RING_ENTRIES),
+   TraceRing(traceEntries[1], TRACE_RING_ENTRIES)
+};
+
+void TraceRecord(const char *name, char phase, uint32_t arg) {
+   uint core = get_core_num();
+   // Keeps handlers on this core from recording at the same time, and the
+   // timestamps of a ring in order.
+   uint32_t saved_irq = save_and_disable_interrupts();
+   traceRings[core].Record(TraceEvent{time_us_32(), name, arg, phase, (uint8_t)core});
+   restore_interrupts(saved_irq);
+}
+
+size_t TraceCollect(TraceEvent *out) {
+   size_t count = 0;
+   for (uint core = 0; core < NUM_CORES; core++) {
+      count += traceRings[core].Copy(out + count, TRACE_RING_ENTRIES);
+   }
+
+   // Events of each core are already in order, so this keeps begin and end
+   // events with the same timestamp in order.
+   std::stable_sort(out, out + count, [](const TraceEvent &a, const TraceEvent &b) {
+      return (int32_t)(a.timeUs - b.timeUs) < 0;
+   });
+   return count;
+}
@@ -0,0 +1,90 @@
+/**
+ * ZuluIDE™ - Copyright (c) 2023 Rabbit Hole Computing™
+ *
+ * ZuluIDE™ firmware is licensed under the GPL version 3 or any later version.
+ *
+ * https://www.gnu.org/licenses/gpl-3.0.html
+ * ----
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ **/
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <pico/platform.h>
+
+#include "trace_ring.h"
+
+// Set to 0 to remove tracing at compile time.
+#ifndef TRACE_ENABLED
+#define TRACE_ENABLED 1
+#endif
+
+// Number of latest events kept for each core.
+#ifndef TRACE_RING_ENTRIES
+#define TRACE_RING_ENTRIES 256
+#endif
+
+// Most events returned by TraceCollect.
+#define TRACE_COLLECT_MAX (NUM_CORES * TRACE_RING_ENTRIES)
+
+/**
+   Records an event in the trace ring of the calling core. Safe to call from
+   interrupt handlers.
+ */
+void TraceRecord(const char *name, char phase, uint32_t arg);
+
+/**
+   Copies the latest events of both cores to out, which has room for
+   TRACE_COLLECT_MAX events, ordered by time. Returns their number.
+ */
+size_t TraceCollect(TraceEvent *out);
+
+/**
+   Records the beginning of a duration when constructed and its end when
+   destroyed.
+ */
+class TraceScope {
+  public:
+   explicit TraceScope(const char *name, uint32_t arg = 0) : name(name) {
+      if (TRACE_ENABLED) {
+         TraceRecord(name, 'B', arg);
+      }
+   }
+
+   ~TraceScope() {
+      if (TRACE_ENABLED) {
+         TraceRecord(name, 'E', 0);
+      }
+   }
+
+   TraceScope(const TraceScope &) = delete;
+   TraceScope &operator=(const TraceScope &) = delete;
+
+  private:
+   const char *name;
+};
+
+/**
+   Marks an instant, e.g. TRACE_INSTANT("enqueue", command). The name must be
+   a string literal.
+ */
+#define TRACE_INSTANT(name, arg)                  \
+   do {                                           \
+      if (TRACE_ENABLED) {                        \
+         TraceRecord((name), 'i', (arg));         \
+      }                                           \
+   } while (0)
+
+#endif
@@ -0,0 +1,67 @@
+/**
+ * ZuluIDE™ - Copyright (c) 2023 Rabbit Hole Computing™
+ *
+ * ZuluIDE™ firmware is licensed under the GPL version 3 or any later version.
+ *
+ * https://www.gnu.org/licenses/gpl-3.0.html
+ * ----
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ **/
+
+#include "trace_ring.h"
+
+#include <cstdio>
+
+void TraceRing::Record(const TraceEvent &event) {
+   entries[written % count] = event;
+   // The event must be complete before a reader on another core counts it.
+   __sync_synchronize();
+   written = written + 1;
+}
+
+size_t TraceRing::Copy(TraceEvent *out, size_t max) const {
+   uint32_t end = written;
+   __sync_synchronize();
+   uint32_t start = (end > count) ? end - count : 0;
+   if (end - start > max) {
+      start = end - max;
+   }
+   for (uint32_t i = start; i != end; i++) {
+      out[i - start] = entries[i % count];
+   }
+
+   // The writer may have overwritten the oldest events while they were
+   // copied, including the one it is writing now.
+   __sync_synchronize();
+   uint32_t after = written;
+   uint32_t valid = (after >= count) ? after - count + 1 : 0;
+   if (valid <= start) {
+      return end - start;
+   }
+   if (valid >= end) {
+      return 0;
+   }
+
+   size_t skipped = valid - start;
+   for (uint32_t i = 0; i < end - valid; i++) {
+      out[i] = out[i + skipped];
+   }
+   return end - valid;
+}
+
+int FormatTraceEvent(const TraceEvent &event, bool first, char *out, size_t size) {
+   return snprintf(out, size, "%s{\"name\":\"%s\",\"ph\":\"%c\",%s\"ts\":%lu,\"pid\":1,\"tid\":%u,\"args\":{\"arg\":%lu}}",
+                   first ? "" : ",", event.name, event.phase, (event.phase == 'i') ? "\"s\":\"t\"," : "",
+                   (unsigned long)event.timeUs, (unsigned)event.core, (unsigned long)event.arg);
+}
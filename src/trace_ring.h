@@ -0,0 +1,78 @@
+/**
+ * ZuluIDE™ - Copyright (c) 2023 Rabbit Hole Computing™
+ *
+ * ZuluIDE™ firmware is licensed under the GPL version 3 or any later version.
+ *
+ * https://www.gnu.org/licenses/gpl-3.0.html
+ * ----
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ **/
+
+#ifndef TRACE_RING_H
+#define TRACE_RING_H
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+   Timestamped trace event. The name is kept as a pointer, so it must be a
+   string literal, and it is written to JSON as it is, so it must not need
+   escaping.
+ */
+struct TraceEvent {
+   uint32_t timeUs;
+   const char *name;
+   uint32_t arg;
+   // 'B' begins and 'E' ends a duration and 'i' marks an instant, as in the
+   // Chrome trace event format.
+   char phase;
+   uint8_t core;
+};
+
+/**
+   Fixed size ring keeping the latest trace events of a single writer, which
+   overwrites the oldest ones. Writers that can interrupt each other must not
+   be inside Record at the same time. The events may be copied from another
+   core while they are written.
+ */
+class TraceRing {
+  public:
+   TraceRing(TraceEvent *entries, size_t count) : entries(entries), count(count) {}
+
+   void Record(const TraceEvent &event);
+
+   /**
+      Copies up to max of the latest events to out, oldest first, and returns
+      their number. Events overwritten while copying are left out.
+    */
+   size_t Copy(TraceEvent *out, size_t max) const;
+
+   /**
+      Number of events recorded since the ring was created.
+    */
+   uint32_t Written() const { return written; }
+
+  private:
+   TraceEvent *entries;
+   size_t count;
+   volatile uint32_t written = 0;
+};
+
+/**
+   Formats event as a Chrome trace_event JSON object into out, preceded by a
+   comma unless it is the first, and returns its length like snprintf.
+ */
+int FormatTraceEvent(const TraceEvent &event, bool first, char *out, size_t size);
+
+#endif
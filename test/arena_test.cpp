@@ -0,0 +1,83 @@
+#include "arena.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+/* Unit test helpers */
+#define COMMENT(x) printf("\n----" x "----\n");
+#define TEST(x) \
+    if (!(x)) { \
+        fprintf(stderr, "\033[31;1mFAILED:\033[22;39m %s:%d %s\n", __FILE__, __LINE__, #x); \
+        status = false; \
+    } else { \
+        printf("\033[32;1mOK:\033[22;39m %s\n", #x); \
+    }
+
+bool test_allocations_are_separate()
+{
+    bool status = true;
+    Arena arena(64);
+
+    COMMENT("test_allocations_are_separate()");
+    char *a = arena.Allocate(10);
+    char *b = arena.Allocate(30);
+    char *c = arena.Allocate(40);
+    memset(a, 'a', 10);
+    memset(b, 'b', 30);
+    memset(c, 'c', 40);
+    TEST(a[9] == 'a' && b[0] == 'b' && b[29] == 'b' && c[0] == 'c');
+    TEST(((uintptr_t)b % sizeof(void*)) == 0);
+    TEST(arena.Used() == 80);
+    TEST(arena.Chunks() == 2);
+    return status;
+}
+
+bool test_oversized()
+{
+    bool status = true;
+    Arena arena(64);
+
+    COMMENT("test_oversized()");
+    char *big = arena.Allocate(200);
+    memset(big, 'x', 200);
+    TEST(arena.Chunks() == 1);
+    arena.Reset();
+    TEST(arena.Chunks() == 0);
+    TEST(arena.Used() == 0);
+    return status;
+}
+
+bool test_reset_and_high_water()
+{
+    bool status = true;
+    Arena arena(64);
+
+    COMMENT("test_reset_and_high_water()");
+    for (int i = 0; i < 10; i++) {
+        arena.Allocate(32);
+    }
+    TEST(arena.Used() == 320);
+    TEST(arena.Chunks() == 5);
+    arena.Reset();
+    TEST(arena.Used() == 0);
+    TEST(arena.Chunks() == 1);
+    char *first = arena.Allocate(16);
+    TEST(first != nullptr);
+    TEST(arena.Chunks() == 1);
+    TEST(arena.HighWater() == 320);
+    return status;
+}
+
+
+int main()
+{
+    if (test_allocations_are_separate() && test_oversized() && test_reset_and_high_water())
+    {
+        return 0;
+    }
+    else
+    {
+        printf("Some tests failed\n");
+        return 1;
+    }
+}
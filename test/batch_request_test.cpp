@@ -0,0 +1,112 @@
+#include "batch_request.h"
+#include <stdio.h>
+#include <string.h>
+
+/* Unit test helpers */
+#define COMMENT(x) printf("\n----" x "----\n");
+#define TEST(x) \
+    if (!(x)) { \
+        fprintf(stderr, "\033[31;1mFAILED:\033[22;39m %s:%d %s\n", __FILE__, __LINE__, #x); \
+        status = false; \
+    } else { \
+        printf("\033[32;1mOK:\033[22;39m %s\n", #x); \
+    }
+
+static void append(BatchRequest &request, const char *body)
+{
+    request.Append(body, strlen(body));
+}
+
+bool test_commands()
+{
+    bool status = true;
+    BatchRequest request(256, 4);
+
+    COMMENT("test_commands()");
+    request.Begin(strlen("eject\r\nimage=Disc%201+of+2.iso\n\n"));
+    // Arrives split in the middle of a command.
+    append(request, "eject\r\nimage=Disc%201");
+    append(request, "+of+2.iso\n\n");
+    TEST(request.Parse());
+    TEST(request.Error() == nullptr);
+    TEST(request.Entries().size() == 2);
+    TEST(request.Entries()[0].command == BatchRequest::Command::Eject);
+    TEST(request.Entries()[1].command == BatchRequest::Command::LoadImage);
+    TEST(request.Entries()[1].argument == "Disc 1 of 2.iso");
+
+    std::string result;
+    request.BuildResult("ok", result);
+    TEST(result == "{\"status\":\"ok\",\"results\":[{\"status\":\"ok\"},{\"status\":\"ok\"}]}");
+
+    result.clear();
+    request.Entries()[1].id = 7;
+    request.BuildResult("ok", result);
+    TEST(result == "{\"status\":\"ok\",\"results\":[{\"status\":\"ok\"},{\"id\":7,\"status\":\"ok\"}]}");
+
+    request.Begin(strlen("eject&image=a.iso&eject"));
+    append(request, "eject&image=a.iso&eject");
+    TEST(request.Parse());
+    TEST(request.Entries().size() == 3);
+    TEST(request.Entries()[1].argument == "a.iso");
+    return status;
+}
+
+bool test_invalid()
+{
+    bool status = true;
+    BatchRequest request(32, 3);
+    std::string result;
+
+    COMMENT("test_invalid()");
+    request.Begin(strlen("eject\nreboot\nimage="));
+    append(request, "eject\nreboot\nimage=");
+    TEST(!request.Parse());
+    request.Entries()[0].status = "skipped";
+    request.BuildResult("error", result);
+    TEST(result == "{\"status\":\"error\",\"error\":\"invalid command\",\"results\":[{\"status\":\"skipped\"},"
+                   "{\"status\":\"error\",\"error\":\"unknown command\"},{\"status\":\"error\",\"error\":\"missing image name\"}]}");
+
+    request.Begin(0);
+    TEST(!request.Parse());
+    TEST(strcmp(request.Error(), "no commands") == 0);
+
+    request.Begin(strlen("eject\neject\neject\neject\n"));
+    append(request, "eject\neject\neject\neject\n");
+    TEST(!request.Parse());
+    TEST(strcmp(request.Error(), "too many commands") == 0);
+
+    TEST(!request.Begin(strlen("image=a-very-long-image-name.iso\n")));
+    append(request, "image=a-very-long-image-name.iso\n");
+    TEST(!request.Parse());
+    TEST(strcmp(request.Error(), "request too large") == 0);
+    TEST(request.Entries().empty());
+
+    // More data than announced is dropped as well.
+    TEST(request.Begin(6));
+    append(request, "eject\n");
+    append(request, "image=a-very-long-image-name.iso\n");
+    TEST(!request.Parse());
+    TEST(strcmp(request.Error(), "request too large") == 0);
+
+    // The connection dropped before the whole body arrived.
+    TEST(request.Begin(24));
+    append(request, "eject\nimage=Disc");
+    TEST(!request.Parse());
+    TEST(strcmp(request.Error(), "incomplete request") == 0);
+    TEST(request.Entries().empty());
+    return status;
+}
+
+
+int main()
+{
+    if (test_commands() && test_invalid())
+    {
+        return 0;
+    }
+    else
+    {
+        printf("Some tests failed\n");
+        return 1;
+    }
+}
@@ -0,0 +1,122 @@
+#include "cbor.h"
+#include <stdio.h>
+#include <string.h>
+
+/* Unit test helpers */
+#define COMMENT(x) printf("\n----" x "----\n");
+#define TEST(x) \
+    if (!(x)) { \
+        fprintf(stderr, "\033[31;1mFAILED:\033[22;39m %s:%d %s\n", __FILE__, __LINE__, #x); \
+        status = false; \
+    } else { \
+        printf("\033[32;1mOK:\033[22;39m %s\n", #x); \
+    }
+
+/* Encodes json and returns the encoding as lower case hex. */
+static std::string cbor_hex(const char *json)
+{
+    std::string out;
+    if (!JsonToCbor(json, strlen(json), out))
+    {
+        return "invalid";
+    }
+    std::string hex;
+    char byte[3];
+    for (unsigned char c : out)
+    {
+        snprintf(byte, sizeof(byte), "%02x", c);
+        hex += byte;
+    }
+    return hex;
+}
+
+bool test_heads()
+{
+    bool status = true;
+    uint8_t head[CBOR_HEAD_MAX_SIZE];
+
+    COMMENT("test_heads()");
+    TEST(CborHead(CborType::Unsigned, 23, head) == 1 && head[0] == 0x17);
+    TEST(CborHead(CborType::Unsigned, 24, head) == 2 && head[0] == 0x18 && head[1] == 24);
+    TEST(CborHead(CborType::Text, 500, head) == 3 && head[0] == 0x79 && head[1] == 0x01 && head[2] == 0xf4);
+    TEST(CborHead(CborType::Array, 1000000, head) == 5 && head[0] == 0x9a && head[1] == 0x00 && head[2] == 0x0f && head[3] == 0x42 && head[4] == 0x40);
+    TEST(CborHead(CborType::Unsigned, 1000000000000ULL, head) == 9 && head[0] == 0x1b && head[4] == 0xe8 && head[8] == 0x00);
+    return status;
+}
+
+bool test_values()
+{
+    bool status = true;
+
+    COMMENT("test_values()");
+    // Examples from RFC 8949 appendix A.
+    TEST(cbor_hex("0") == "00");
+    TEST(cbor_hex("100") == "1864");
+    TEST(cbor_hex("-1") == "20");
+    TEST(cbor_hex("-1000") == "3903e7");
+    TEST(cbor_hex("-0") == "00");
+    TEST(cbor_hex("18446744073709551615") == "1bffffffffffffffff");
+    TEST(cbor_hex("-18446744073709551616") == "3bffffffffffffffff");
+    TEST(cbor_hex("1.1") == "fb3ff199999999999a");
+    TEST(cbor_hex("-4.1") == "fbc010666666666666");
+    TEST(cbor_hex("false") == "f4");
+    TEST(cbor_hex("true") == "f5");
+    TEST(cbor_hex("null") == "f6");
+    TEST(cbor_hex("\"\"") == "60");
+    TEST(cbor_hex("\"IETF\"") == "6449455446");
+    TEST(cbor_hex("\"\\\"\\\\\"") == "62225c");
+    TEST(cbor_hex("\"\\u00fc\"") == "62c3bc");
+    TEST(cbor_hex("\"\\ud800\\udd51\"") == "64f0908591");
+    TEST(cbor_hex("[]") == "80");
+    TEST(cbor_hex("[1, [2, 3], [4, 5]]") == "8301820203820405");
+    TEST(cbor_hex("{}") == "a0");
+    TEST(cbor_hex("{\"a\": 1, \"b\": [2, 3]}") == "a26161016162820203");
+    TEST(cbor_hex(" {\"a\":{\"b\":\"c,}\"}} ") == "a16161a1616263632c7d");
+    return status;
+}
+
+bool test_invalid()
+{
+    bool status = true;
+
+    COMMENT("test_invalid()");
+    TEST(cbor_hex("") == "invalid");
+    TEST(cbor_hex("[1,") == "invalid");
+    TEST(cbor_hex("{\"a\" 1}") == "invalid");
+    TEST(cbor_hex("{1:2}") == "invalid");
+    TEST(cbor_hex("\"abc") == "invalid");
+    TEST(cbor_hex("[1] 2") == "invalid");
+    TEST(cbor_hex("nope") == "invalid");
+    TEST(cbor_hex("18446744073709551616") == "invalid");
+    TEST(cbor_hex("-18446744073709551617") == "invalid");
+    TEST(cbor_hex("--1") == "invalid");
+    TEST(cbor_hex("+1") == "invalid");
+    return status;
+}
+
+bool test_decode_string()
+{
+    bool status = true;
+    char out[16];
+
+    COMMENT("test_decode_string()");
+    TEST(DecodeJsonString("a\\tb", 4, nullptr) == 3);
+    TEST(DecodeJsonString("a\\tb", 4, out) == 3 && memcmp(out, "a\tb", 3) == 0);
+    TEST(DecodeJsonString("\\x", 2, out) == 2 && memcmp(out, "\\x", 2) == 0);
+    TEST(DecodeJsonString("\\u20ac", 6, out) == 3 && memcmp(out, "\xe2\x82\xac", 3) == 0);
+    return status;
+}
+
+
+int main()
+{
+    if (test_heads() && test_values() && test_invalid() && test_decode_string())
+    {
+        return 0;
+    }
+    else
+    {
+        printf("Some tests failed\n");
+        return 1;
+    }
+}
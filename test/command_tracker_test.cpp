@@ -0,0 +1,144 @@
+#include "command_tracker.h"
+#include <stdio.h>
+#include <string.h>
+
+/* Unit test helpers */
+#define COMMENT(x) printf("\n----" x "----\n");
+#define TEST(x) \
+    if (!(x)) { \
+        fprintf(stderr, "\033[31;1mFAILED:\033[22;39m %s:%d %s\n", __FILE__, __LINE__, #x); \
+        status = false; \
+    } else { \
+        printf("\033[32;1mOK:\033[22;39m %s\n", #x); \
+    }
+
+static std::string describe(const CommandTracker &tracker, uint32_t id)
+{
+    std::string out;
+    tracker.Describe(id, out);
+    return out;
+}
+
+bool test_stages()
+{
+    bool status = true;
+    CommandTracker tracker(4, 100000);
+
+    COMMENT("test_stages()");
+    uint32_t load = tracker.Add(CommandTracker::Kind::LoadImage, "a.iso", 1000);
+    TEST(load != 0);
+    TEST(describe(tracker, load) == "{\"id\":1,\"command\":\"image\",\"state\":\"queued\"}");
+
+    // A status from before the command was sent does not count.
+    tracker.StatusReceived("a.iso", 1500);
+    TEST(describe(tracker, load) == "{\"id\":1,\"command\":\"image\",\"state\":\"queued\"}");
+
+    tracker.Sent(load, 3000);
+    TEST(describe(tracker, load) == "{\"id\":1,\"command\":\"image\",\"state\":\"sent\",\"queueLatencyUs\":2000}");
+    tracker.StatusReceived(nullptr, 4000);
+    tracker.StatusReceived("b.iso", 5000);
+    TEST(describe(tracker, load) == "{\"id\":1,\"command\":\"image\",\"state\":\"sent\",\"queueLatencyUs\":2000}");
+    tracker.StatusReceived("a.iso", 9000);
+    TEST(describe(tracker, load) == "{\"id\":1,\"command\":\"image\",\"state\":\"reflected\",\"queueLatencyUs\":2000,"
+                                    "\"statusLatencyUs\":6000,\"totalLatencyUs\":8000}");
+
+    uint32_t eject = tracker.Add(CommandTracker::Kind::Eject, nullptr, 10000);
+    tracker.Sent(eject, 10500);
+    tracker.StatusReceived(nullptr, 12000);
+    TEST(describe(tracker, eject) == "{\"id\":2,\"command\":\"eject\",\"state\":\"reflected\",\"queueLatencyUs\":500,"
+                                     "\"statusLatencyUs\":1500,\"totalLatencyUs\":2000}");
+
+    uint32_t failed = tracker.Add(CommandTracker::Kind::Eject, nullptr, 13000);
+    tracker.Failed(failed);
+    TEST(describe(tracker, failed) == "{\"id\":3,\"command\":\"eject\",\"state\":\"failed\"}");
+    return status;
+}
+
+bool test_superseded_and_forgotten()
+{
+    bool status = true;
+    CommandTracker tracker(2, 100000);
+
+    COMMENT("test_superseded_and_forgotten()");
+    uint32_t first = tracker.Add(CommandTracker::Kind::LoadImage, "a.iso", 0);
+    uint32_t second = tracker.Add(CommandTracker::Kind::LoadImage, "b.iso", 0);
+    tracker.Sent(first, 10);
+    tracker.Sent(second, 20);
+    tracker.StatusReceived("b.iso", 30);
+    TEST(describe(tracker, first).find("\"state\":\"superseded\"") != std::string::npos);
+    TEST(describe(tracker, second).find("\"state\":\"reflected\"") != std::string::npos);
+
+    tracker.Add(CommandTracker::Kind::Eject, nullptr, 40);
+    TEST(describe(tracker, first) == "{\"id\":1,\"state\":\"unknown\"}");
+    TEST(describe(tracker, 0) == "{\"id\":0,\"state\":\"unknown\"}");
+    TEST(describe(tracker, 99) == "{\"id\":99,\"state\":\"unknown\"}");
+    return status;
+}
+
+bool test_timeout()
+{
+    bool status = true;
+    CommandTracker tracker(4, 1000);
+
+    COMMENT("test_timeout()");
+    uint32_t queued = tracker.Add(CommandTracker::Kind::LoadImage, "a.iso", 0);
+    uint32_t sent = tracker.Add(CommandTracker::Kind::LoadImage, "b.iso", 500);
+    tracker.Sent(sent, 600);
+    tracker.Expire(1000);
+    TEST(describe(tracker, queued).find("\"state\":\"queued\"") != std::string::npos);
+    TEST(describe(tracker, sent).find("\"state\":\"sent\"") != std::string::npos);
+
+    tracker.Expire(1500);
+    TEST(describe(tracker, queued) == "{\"id\":1,\"command\":\"image\",\"state\":\"timeout\"}");
+    TEST(describe(tracker, sent).find("\"state\":\"sent\"") != std::string::npos);
+
+    // Timed out commands stay that way when the status shows them later.
+    tracker.Expire(1700);
+    tracker.StatusReceived("b.iso", 1800);
+    TEST(describe(tracker, sent) == "{\"id\":2,\"command\":\"image\",\"state\":\"timeout\"}");
+    return status;
+}
+bool test_current_image()
+{
+    bool status = true;
+    CommandTracker tracker(4, 100000);
+
+    COMMENT("test_current_image()");
+    tracker.StatusReceived("a.iso", 100);
+
+    // Mounting the image that is already mounted changes nothing.
+    uint32_t remount = tracker.Add(CommandTracker::Kind::LoadImage, "a.iso", 200);
+    tracker.Sent(remount, 300);
+    tracker.StatusReceived("a.iso", 300);
+    TEST(describe(tracker, remount).find("\"state\":\"sent\"") != std::string::npos);
+    tracker.StatusReceived("a.iso", 400);
+    TEST(describe(tracker, remount) == "{\"id\":1,\"command\":\"image\",\"state\":\"noop\",\"queueLatencyUs\":100}");
+
+    // An eject followed by mounting the same image again is reflected by the change in between.
+    uint32_t eject = tracker.Add(CommandTracker::Kind::Eject, nullptr, 500);
+    uint32_t load = tracker.Add(CommandTracker::Kind::LoadImage, "a.iso", 500);
+    tracker.Sent(eject, 600);
+    tracker.Sent(load, 700);
+    tracker.StatusReceived("a.iso", 800);
+    TEST(describe(tracker, eject).find("\"state\":\"sent\"") != std::string::npos);
+    TEST(describe(tracker, load).find("\"state\":\"sent\"") != std::string::npos);
+    tracker.StatusReceived(nullptr, 900);
+    TEST(describe(tracker, eject).find("\"state\":\"reflected\"") != std::string::npos);
+    tracker.StatusReceived("a.iso", 1000);
+    TEST(describe(tracker, load).find("\"state\":\"reflected\"") != std::string::npos);
+    TEST(describe(tracker, eject).find("\"state\":\"reflected\"") != std::string::npos);
+    return status;
+}
+
+int main()
+{
+    if (test_stages() && test_superseded_and_forgotten() && test_timeout() && test_current_image())
+    {
+        return 0;
+    }
+    else
+    {
+        printf("Some tests failed\n");
+        return 1;
+    }
+}
@@ -0,0 +1,117 @@
+#include "filename_index.h"
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
+/* Unit test helpers */
+#define COMMENT(x) printf("\n----" x "----\n");
+#define TEST(x) \
+    if (!(x)) { \
+        fprintf(stderr, "\033[31;1mFAILED:\033[22;39m %s:%d %s\n", __FILE__, __LINE__, #x); \
+        status = false; \
+    } else { \
+        printf("\033[32;1mOK:\033[22;39m %s\n", #x); \
+    }
+
+/* Stores names the same way the filename cache does, inside a JSON document */
+struct Names {
+    std::string json;
+    std::vector<uint32_t> offsets;
+    std::vector<uint16_t> lengths;
+
+    Names(std::initializer_list<const char *> names)
+    {
+        json = "{\"filenames\":[";
+        for (auto name : names) {
+            json += "\"";
+            offsets.push_back(json.size());
+            lengths.push_back(strlen(name));
+            json += name;
+            json += "\",";
+        }
+        json += "]}";
+    }
+
+    std::string name(uint32_t i) { return json.substr(offsets[i], lengths[i]); }
+};
+
+bool test_prefix()
+{
+    bool status = true;
+    Names names = {"Quake.iso", "doom.iso", "Descent.cue", "Doom II.iso", "Myst.iso"};
+    FilenameIndex index;
+    std::vector<uint32_t> results;
+
+    COMMENT("test_prefix()");
+    index.Build(names.json.c_str(), names.offsets.data(), names.lengths.data(), names.offsets.size());
+    TEST(index.Search("DO", 10, results) == 2);
+    TEST(results.size() == 2);
+    TEST(names.name(results[0]) == "Doom II.iso");
+    TEST(names.name(results[1]) == "doom.iso");
+    return status;
+}
+
+bool test_substring_after_prefix()
+{
+    bool status = true;
+    Names names = {"Sonic CD.iso", "CD Player.iso", "Rebel Assault.cue", "Cdx.iso"};
+    FilenameIndex index;
+    std::vector<uint32_t> results;
+
+    COMMENT("test_substring_after_prefix()");
+    index.Build(names.json.c_str(), names.offsets.data(), names.lengths.data(), names.offsets.size());
+    TEST(index.Search("cd", 10, results) == 3);
+    TEST(results.size() == 3);
+    TEST(names.name(results[0]) == "CD Player.iso");
+    TEST(names.name(results[1]) == "Cdx.iso");
+    TEST(names.name(results[2]) == "Sonic CD.iso");
+    return status;
+}
+
+bool test_limit()
+{
+    bool status = true;
+    Names names = {"a1.iso", "a2.iso", "a3.iso", "ba.iso"};
+    FilenameIndex index;
+    std::vector<uint32_t> results;
+
+    COMMENT("test_limit()");
+    index.Build(names.json.c_str(), names.offsets.data(), names.lengths.data(), names.offsets.size());
+    TEST(index.Search("a", 2, results) == 4);
+    TEST(results.size() == 2);
+    TEST(names.name(results[0]) == "a1.iso");
+    TEST(names.name(results[1]) == "a2.iso");
+    TEST(index.Search("", 10, results) == 4);
+    return status;
+}
+
+bool test_no_match()
+{
+    bool status = true;
+    Names names = {"Game.iso", "Other.bin"};
+    FilenameIndex index;
+    std::vector<uint32_t> results;
+
+    COMMENT("test_no_match()");
+    index.Build(names.json.c_str(), names.offsets.data(), names.lengths.data(), names.offsets.size());
+    TEST(index.Search("zzz", 10, results) == 0);
+    TEST(results.empty());
+    TEST(index.Search("game.iso.bak", 10, results) == 0);
+    index.Clear();
+    TEST(index.Search("game", 10, results) == 0);
+    return status;
+}
+
+
+int main()
+{
+    if (test_prefix() && test_substring_after_prefix() && test_limit() && test_no_match())
+    {
+        return 0;
+    }
+    else
+    {
+        printf("Some tests failed\n");
+        return 1;
+    }
+}
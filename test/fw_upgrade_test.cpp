@@ -0,0 +1,482 @@
+#include "fw_upgrade.h"
+#include "pico_sim.h"
+#include "sha256.h"
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+/* Unit test helpers */
+#define COMMENT(x) printf("\n----" x "----\n");
+#define TEST(x) \
+    if (!(x)) { \
+        fprintf(stderr, "\033[31;1mFAILED:\033[22;39m %s:%d %s\n", __FILE__, __LINE__, #x); \
+        status = false; \
+    } else { \
+        printf("\033[32;1mOK:\033[22;39m %s\n", #x); \
+    }
+
+#define PAGE_SIZE 256
+
+// Size of the Pico W firmware
+#define IMAGE_SIZE (640 * 1024)
+
+static int g_connection;
+
+/* Pseudo random data, the same for the same seed. */
+static std::vector<uint8_t> make_image(size_t size, uint32_t seed)
+{
+    std::vector<uint8_t> image(size);
+    for (size_t i = 0; i < size; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        image[i] = (uint8_t)(seed >> 16);
+    }
+    return image;
+}
+
+/* Appends the blocks of an image for a family, as written by picotool. */
+static void append_uf2(std::vector<uint8_t> &file, const std::vector<uint8_t> &image, uint32_t family_id)
+{
+    uint32_t num_blocks = image.size() / PAGE_SIZE;
+    for (uint32_t i = 0; i < num_blocks; i++)
+    {
+        uf2_block block = {};
+        block.magic_start0 = UF2_MAGIC_START0;
+        block.magic_start1 = UF2_MAGIC_START1;
+        block.flags = UF2_FLAG_FAMILY_ID_PRESENT;
+        block.target_addr = 0x10000000 + i * PAGE_SIZE;
+        block.payload_size = PAGE_SIZE;
+        block.block_no = i;
+        block.num_blocks = num_blocks;
+        block.file_size = family_id;
+        memcpy(block.data, &image[i * PAGE_SIZE], PAGE_SIZE);
+        block.magic_end = UF2_MAGIC_END;
+
+        const uint8_t *bytes = (const uint8_t*)&block;
+        file.insert(file.end(), bytes, bytes + sizeof(block));
+    }
+}
+
+static std::string sha256_hex(const std::vector<uint8_t> &file)
+{
+    Sha256 hash;
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    hash.Update(file.data(), file.size());
+    hash.Finish(digest);
+
+    std::string hex;
+    for (uint8_t byte : digest)
+    {
+        char digits[3];
+        snprintf(digits, sizeof(digits), "%02x", byte);
+        hex += digits;
+    }
+    return hex;
+}
+
+/* Starts a patch made by tools/make_delta.py that turns base into an image of image_size bytes. */
+static void start_patch(std::vector<uint8_t> &patch, const std::vector<uint8_t> &base, uint32_t image_size)
+{
+    Sha256 hash;
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    hash.Update(base.data(), base.size());
+    hash.Finish(digest);
+
+    uint32_t header[2] = {RP2040_FAMILY_ID, (uint32_t)base.size()};
+    patch.insert(patch.end(), {'Z', 'D', 'P', '1'});
+    patch.insert(patch.end(), (const uint8_t*)header, (const uint8_t*)(header + 2));
+    patch.insert(patch.end(), digest, digest + sizeof(digest));
+    patch.insert(patch.end(), (const uint8_t*)&image_size, (const uint8_t*)(&image_size + 1));
+}
+
+static void patch_copy(std::vector<uint8_t> &patch, uint32_t offset, uint32_t length)
+{
+    uint32_t args[2] = {offset, length};
+    patch.push_back(1);
+    patch.insert(patch.end(), (const uint8_t*)args, (const uint8_t*)(args + 2));
+}
+
+static void patch_insert(std::vector<uint8_t> &patch, const uint8_t *data, uint32_t length)
+{
+    patch.push_back(2);
+    patch.insert(patch.end(), (const uint8_t*)&length, (const uint8_t*)(&length + 1));
+    patch.insert(patch.end(), data, data + length);
+}
+
+/* The document the client receives for the last upload. */
+static std::string result_json()
+{
+    char json[128];
+    fwupgrade_result_json(json, sizeof(json));
+    return json;
+}
+
+static bool flash_holds(const std::vector<uint8_t> &image)
+{
+    return memcmp(pico_sim_flash, image.data(), image.size()) == 0;
+}
+
+struct upload_result
+{
+    err_t begin;
+    bool received;
+    // The window was never full, and everything received was acknowledged in the end
+    bool window_open;
+    bool acked_all;
+    char response[64];
+    // Simulated state when the upload finished, and the time taken by the commit
+    pico_sim_state upload;
+    uint64_t commit_us;
+    bool rebooted;
+    double host_seconds;
+};
+
+/*
+ * Posts file from offset the way httpd hands it over, chunk bytes at a time in
+ * pbufs of at most segment bytes. A chunk of 0 sends chunks of random size.
+ * Only the data before end is sent, as if the connection dropped there.
+ */
+static upload_result upload(const std::vector<uint8_t> &file, const std::string &params, size_t chunk,
+                            size_t segment, size_t offset = 0, size_t end = SIZE_MAX)
+{
+    upload_result result = {};
+    pico_sim_clear_stats();
+
+    std::string uri = "/fw_upgrade.cgi";
+    if (!params.empty())
+    {
+        uri += "?" + params;
+    }
+    u8_t auto_wnd = 1;
+    result.begin = fwupgrade_post_begin(&g_connection, uri.c_str(), "", 0, (int)(file.size() - offset),
+                                        result.response, sizeof(result.response), &auto_wnd);
+    if (result.begin != ERR_OK)
+    {
+        return result;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    uint32_t seed = 1;
+    size_t stop = (end < file.size()) ? end : file.size();
+    result.received = true;
+    result.window_open = (auto_wnd == 0);
+    for (size_t pos = offset; pos < stop && result.received;)
+    {
+        size_t len = chunk;
+        if (len == 0)
+        {
+            seed = seed * 1103515245 + 12345;
+            len = 1 + (seed >> 16) % (4 * TCP_MSS);
+        }
+        len = (len < stop - pos) ? len : stop - pos;
+
+        struct pbuf *p = pico_sim_pbuf_chain(&file[pos], len, segment);
+        result.received = (fwupgrade_post_receive_data(&g_connection, p) == ERR_OK);
+        pos += len;
+
+        // The sender stops when the window is full
+        if (pos - offset - g_pico_sim.bytes_acked >= TCP_WND)
+        {
+            result.window_open = false;
+        }
+        result.acked_all = (g_pico_sim.bytes_acked == pos - offset);
+    }
+
+    fwupgrade_post_finished(&g_connection, result.response, sizeof(result.response));
+    result.host_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    result.upload = g_pico_sim;
+
+    result.rebooted = pico_sim_run_alarm();
+    result.commit_us = g_pico_sim.time_us - result.upload.time_us;
+    return result;
+}
+
+/* Prints the throughput and flash use of an upload. */
+static void report(const char *name, const upload_result &result)
+{
+    const fwupgrade_stats *stats = fwupgrade_get_stats();
+    double flash_seconds = stats->duration_us / 1e6;
+    printf("%-22s %5lu blocks, %8.0f blocks/s host, %6.0f blocks/s flash, "
+           "irq off max %5lu us total %7.1f ms, %4lu erases, %5lu programs, commit %7.1f ms\n",
+           name, (unsigned long)stats->blocks_programmed,
+           (result.host_seconds > 0) ? stats->blocks_programmed / result.host_seconds : 0,
+           (flash_seconds > 0) ? stats->blocks_programmed / flash_seconds : 0,
+           (unsigned long)result.upload.max_irq_off_us, result.upload.irq_off_us / 1000.0,
+           (unsigned long)result.upload.erase_operations, (unsigned long)result.upload.program_operations,
+           result.commit_us / 1000.0);
+}
+
+/* Checks that the simulated flash was used correctly. */
+static bool flash_use_valid(const upload_result &result)
+{
+    return result.upload.invalid_operations == 0 && result.upload.program_conflicts == 0 &&
+           result.upload.unprotected_operations == 0 && g_pico_sim.pbufs_allocated == 0;
+}
+
+bool test_uf2_chunks()
+{
+    bool status = true;
+    const struct { size_t chunk; size_t segment; const char *name; } sizes[] = {
+        {1, 1, "uf2, 1 byte pbufs"},
+        {13, 13, "uf2, 13 byte pbufs"},
+        {512, 512, "uf2, 512 byte pbufs"},
+        {TCP_MSS, TCP_MSS, "uf2, MSS pbufs"},
+        {2 * TCP_MSS, TCP_MSS, "uf2, 2 pbuf chains"},
+        {0, 536, "uf2, random chains"},
+    };
+
+    COMMENT("test_uf2_chunks()");
+    std::vector<uint8_t> image = make_image(IMAGE_SIZE, 1);
+    std::vector<uint8_t> file;
+    append_uf2(file, image, RP2040_FAMILY_ID);
+
+    for (const auto &size : sizes)
+    {
+        pico_sim_reset();
+        upload_result result = upload(file, "", size.chunk, size.segment);
+        report(size.name, result);
+        TEST(result.begin == ERR_OK && result.received);
+        TEST(result.window_open && result.acked_all);
+        TEST(result.upload.core1_resets == 1);
+        TEST(result.rebooted && flash_holds(image));
+        TEST(strcmp(result.response, "/fw_upgrade_result.json") == 0 && result_json() == "{\"status\":\"ok\"}");
+        TEST(flash_use_valid(result));
+    }
+    return status;
+}
+
+bool test_universal_binary()
+{
+    bool status = true;
+
+    COMMENT("test_universal_binary()");
+    std::vector<uint8_t> image = make_image(IMAGE_SIZE, 2);
+    std::vector<uint8_t> other = make_image(IMAGE_SIZE + 64 * 1024, 3);
+    std::vector<uint8_t> file;
+    append_uf2(file, other, RP2350_ARM_S_FAMILY_ID);
+    append_uf2(file, image, RP2040_FAMILY_ID);
+
+    pico_sim_reset();
+    upload_result result = upload(file, "", TCP_MSS, TCP_MSS);
+    report("universal, MSS pbufs", result);
+    TEST(result.begin == ERR_OK && result.received);
+    TEST(result.window_open && result.acked_all);
+    TEST(fwupgrade_get_stats()->blocks_programmed == IMAGE_SIZE / PAGE_SIZE);
+    TEST(result.rebooted && flash_holds(image));
+    TEST(flash_use_valid(result));
+    return status;
+}
+
+bool test_changed_sectors()
+{
+    bool status = true;
+
+    COMMENT("test_changed_sectors()");
+    std::vector<uint8_t> image = make_image(IMAGE_SIZE, 4);
+    std::vector<uint8_t> file;
+    append_uf2(file, image, RP2040_FAMILY_ID);
+    pico_sim_reset();
+    TEST(upload(file, "", TCP_MSS, TCP_MSS).rebooted && flash_holds(image));
+
+    // Two pages of one sector and one page of another change
+    std::vector<uint8_t> changed = image;
+    changed[3 * 4096 + 10] ^= 0xFF;
+    changed[3 * 4096 + 300] ^= 0xFF;
+    changed[100 * 4096 + 4095] ^= 0xFF;
+    file.clear();
+    append_uf2(file, changed, RP2040_FAMILY_ID);
+
+    upload_result result = upload(file, "", TCP_MSS, TCP_MSS);
+    report("uf2, 2 sectors changed", result);
+    TEST(result.rebooted && flash_holds(changed));
+    fwupgrade_init();
+    const fwupgrade_commit_result *commit = fwupgrade_get_commit_result();
+    TEST(commit->valid && !commit->full);
+    TEST(commit->sectors_rewritten == 2 && commit->sectors_total == IMAGE_SIZE / 4096);
+    TEST(result.commit_us == 2 * (PICO_SIM_SECTOR_ERASE_US + 16 * PICO_SIM_PAGE_PROGRAM_US));
+
+    result = upload(file, "commit=full", TCP_MSS, TCP_MSS);
+    TEST(result.rebooted && flash_holds(changed));
+    fwupgrade_init();
+    TEST(commit->full && commit->sectors_rewritten == IMAGE_SIZE / 4096);
+    TEST(flash_use_valid(result));
+    return status;
+}
+
+bool test_resume()
+{
+    bool status = true;
+
+    COMMENT("test_resume()");
+    std::vector<uint8_t> image = make_image(IMAGE_SIZE, 5);
+    std::vector<uint8_t> file;
+    append_uf2(file, image, RP2040_FAMILY_ID);
+    std::string params = "fwid=test-image&sha256=" + sha256_hex(file);
+
+    // The connection drops in the middle of a block
+    pico_sim_reset();
+    size_t cut = file.size() * 2 / 5 + 100;
+    upload_result result = upload(file, params, TCP_MSS, TCP_MSS, 0, cut);
+    report("uf2, dropped at 40%", result);
+    TEST(result.received && !result.rebooted);
+    TEST(result.upload.core1_starts == 1);
+
+    char json[256];
+    unsigned long offset = 0;
+    fwupgrade_status_json(json, sizeof(json));
+    const char *field = strstr(json, "\"resumeOffset\":");
+    TEST(field && sscanf(field, "\"resumeOffset\":%lu", &offset) == 1);
+    TEST(offset > 0 && offset <= cut && offset % sizeof(uf2_block) == 0);
+
+    result = upload(file, params + "&offset=" + std::to_string(offset), TCP_MSS, TCP_MSS, offset);
+    report("uf2, resumed", result);
+    TEST(result.begin == ERR_OK && result.received);
+    TEST(result.rebooted && flash_holds(image));
+    TEST(flash_use_valid(result));
+
+    // Nothing is saved after the commit
+    fwupgrade_status_json(json, sizeof(json));
+    TEST(strstr(json, "\"fwid\":\"\"") != NULL);
+    return status;
+}
+
+bool test_rejected_uploads()
+{
+    bool status = true;
+
+    COMMENT("test_rejected_uploads()");
+    std::vector<uint8_t> image = make_image(64 * 1024, 6);
+    std::vector<uint8_t> file;
+    append_uf2(file, image, RP2040_FAMILY_ID);
+    pico_sim_reset();
+
+    // An offset needs saved progress
+    upload_result result = upload(file, "fwid=other&offset=512", TCP_MSS, TCP_MSS, 512);
+    TEST(result.begin == ERR_VAL && strcmp(result.response, "/fw_upgrade_result.json") == 0);
+    TEST(result_json() == "{\"status\":\"error\",\"error\":\"no saved progress\"}");
+
+    // A wrong digest is not committed
+    result = upload(file, "sha256=" + std::string(64, '0'), TCP_MSS, TCP_MSS);
+    TEST(result.received && !result.rebooted);
+    TEST(strcmp(result.response, "/fw_upgrade_result.json") == 0);
+    TEST(result_json() == "{\"status\":\"error\",\"error\":\"digest mismatch\"}");
+
+    // A broken block stops the upload, but the window is opened for the rest of it
+    file[10 * sizeof(uf2_block) + offsetof(uf2_block, magic_end)] ^= 0xFF;
+    result = upload(file, "", TCP_MSS, TCP_MSS);
+    TEST(!result.received && result.acked_all && !result.rebooted);
+    TEST(strcmp(result.response, "/fw_upgrade_result.json") == 0);
+    TEST(result_json() == "{\"status\":\"error\",\"error\":\"invalid upload data\"}");
+    TEST(flash_use_valid(result));
+    return status;
+}
+
+bool test_patches()
+{
+    bool status = true;
+
+    COMMENT("test_patches()");
+    std::vector<uint8_t> base = make_image(IMAGE_SIZE, 7);
+    std::vector<uint8_t> image = base;
+    std::vector<uint8_t> tail = make_image(4096, 8);
+    for (size_t i = 100000; i < 100300; i++)
+    {
+        image[i] ^= 0x5A;
+    }
+    image.insert(image.end(), tail.begin(), tail.end());
+
+    std::vector<uint8_t> patch;
+    start_patch(patch, base, image.size());
+    patch_copy(patch, 0, 100000);
+    patch_insert(patch, &image[100000], 300);
+    patch_copy(patch, 100300, base.size() - 100300);
+    patch_insert(patch, tail.data(), tail.size());
+
+    pico_sim_reset();
+    memcpy(pico_sim_flash, base.data(), base.size());
+    upload_result result = upload(patch, "sha256=" + sha256_hex(patch), 0, 536);
+    report("patch, random chains", result);
+    TEST(result.begin == ERR_OK && result.received);
+    TEST(result.window_open && result.acked_all);
+    TEST(result.rebooted && flash_holds(image));
+    TEST(result_json() == "{\"status\":\"ok\"}");
+    TEST(flash_use_valid(result));
+
+    // The running firmware is not the base of the patch
+    pico_sim_reset();
+    memcpy(pico_sim_flash, base.data(), base.size());
+    pico_sim_flash[base.size() - 1] ^= 0xFF;
+    result = upload(patch, "", TCP_MSS, TCP_MSS);
+    TEST(!result.received && result.acked_all && !result.rebooted);
+    TEST(result_json() == "{\"status\":\"error\",\"error\":\"patch does not apply to the running firmware\"}");
+    TEST(flash_use_valid(result));
+
+    // A copy past the end of the base
+    pico_sim_reset();
+    memcpy(pico_sim_flash, base.data(), base.size());
+    patch.clear();
+    start_patch(patch, base, image.size());
+    patch_copy(patch, base.size() - 256, 512);
+    result = upload(patch, "", TCP_MSS, TCP_MSS);
+    TEST(!result.received && !result.rebooted);
+    TEST(result_json() == "{\"status\":\"error\",\"error\":\"invalid upload data\"}");
+
+    // An insert past the end of the image
+    patch.clear();
+    start_patch(patch, base, 4096);
+    patch_copy(patch, 0, 2048);
+    patch_insert(patch, tail.data(), tail.size());
+    result = upload(patch, "", TCP_MSS, TCP_MSS);
+    TEST(!result.received && !result.rebooted);
+    TEST(result_json() == "{\"status\":\"error\",\"error\":\"invalid upload data\"}");
+    TEST(flash_use_valid(result));
+    return status;
+}
+
+/* Replays firmware files given on the command line, e.g. zuluide_http_picow.uf2. */
+bool test_files(int argc, char **argv)
+{
+    bool status = true;
+
+    COMMENT("test_files()");
+    for (int i = 1; i < argc; i++)
+    {
+        FILE *f = fopen(argv[i], "rb");
+        std::vector<uint8_t> file;
+        uint8_t buf[4096];
+        size_t len;
+        while (f && (len = fread(buf, 1, sizeof(buf), f)) > 0)
+        {
+            file.insert(file.end(), buf, buf + len);
+        }
+        TEST(f != NULL && !file.empty());
+        if (f)
+        {
+            fclose(f);
+        }
+
+        pico_sim_reset();
+        upload_result result = upload(file, "", TCP_MSS, TCP_MSS);
+        report(argv[i], result);
+        TEST(result.begin == ERR_OK && result.received && result.rebooted);
+        TEST(flash_use_valid(result));
+    }
+    return status;
+}
+
+int main(int argc, char **argv)
+{
+    if (test_uf2_chunks() && test_universal_binary() && test_changed_sectors() && test_resume() &&
+        test_rejected_uploads() && test_patches() && test_files(argc, argv))
+    {
+        return 0;
+    }
+    else
+    {
+        printf("Some tests failed\n");
+        return 1;
+    }
+}
@@ -0,0 +1,191 @@
+#include "image_stream.h"
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
+/* Unit test helpers */
+#define COMMENT(x) printf("\n----" x "----\n");
+#define TEST(x) \
+    if (!(x)) { \
+        fprintf(stderr, "\033[31;1mFAILED:\033[22;39m %s:%d %s\n", __FILE__, __LINE__, #x); \
+        status = false; \
+    } else { \
+        printf("\033[32;1mOK:\033[22;39m %s\n", #x); \
+    }
+
+/* Simulated server that cycles through count images followed by an end of list marker */
+struct Server {
+    int count;
+    int next = 0;
+    int sent = 0;
+
+    explicit Server(int count) : count(count) {}
+
+    void serve(ImageStream &stream, uint32_t now = 0)
+    {
+        size_t needed = stream.RequestsNeeded();
+        for (size_t i = 0; i < needed; i++) {
+            stream.RequestSent(now);
+        }
+        while (stream.InFlight() > 0) {
+            sent++;
+            if (next == count) {
+                next = 0;
+                stream.Received(nullptr, now);
+            } else {
+                std::string image = "img" + std::to_string(next++);
+                char *copy = new char[image.size() + 1];
+                strcpy(copy, image.c_str());
+                stream.Received(copy, now);
+            }
+        }
+    }
+};
+
+/* Reads the next image of a session, serving requests until one is available */
+static std::string next(ImageStream &stream, Server &server, uint32_t token, uint32_t now = 0)
+{
+    for (int tries = 0; tries < 100; tries++) {
+        const char *image;
+        ImageStream::Result result = stream.Peek(token, now, &image);
+        if (result == ImageStream::Result::Image) {
+            std::string copy = image;
+            stream.Advance(token);
+            return copy;
+        } else if (result == ImageStream::Result::Done) {
+            stream.Close(token);
+            return "done";
+        } else if (result == ImageStream::Result::Expired) {
+            return "expired";
+        }
+        server.serve(stream, now);
+    }
+    return "stuck";
+}
+
+bool test_single_session()
+{
+    bool status = true;
+    ImageStream stream(4, 16, 4, 1000);
+    Server server(3);
+
+    COMMENT("test_single_session()");
+    uint32_t token = stream.OpenSession(0);
+    TEST(token != ImageStream::DefaultSession);
+    TEST(next(stream, server, token) == "img0");
+    TEST(stream.InFlight() == 0);
+    TEST(next(stream, server, token) == "img1");
+    TEST(next(stream, server, token) == "img2");
+    TEST(next(stream, server, token) == "done");
+    TEST(stream.Sessions() == 0);
+    TEST(next(stream, server, token) == "expired");
+    return status;
+}
+
+bool test_shared_sessions()
+{
+    bool status = true;
+    ImageStream stream(2, 16, 4, 1000);
+    Server server(5);
+
+    COMMENT("test_shared_sessions()");
+    uint32_t a = stream.OpenSession(0);
+    TEST(next(stream, server, a) == "img0");
+    TEST(next(stream, server, a) == "img1");
+    uint32_t b = stream.OpenSession(0);
+    TEST(next(stream, server, b) == "img0");
+    for (int i = 2; i < 5; i++) {
+        TEST(next(stream, server, a) == "img" + std::to_string(i));
+    }
+    for (int i = 1; i < 5; i++) {
+        TEST(next(stream, server, b) == "img" + std::to_string(i));
+    }
+    TEST(next(stream, server, a) == "done");
+    TEST(next(stream, server, b) == "done");
+    // Both sessions were served from a single pass over the images.
+    TEST(server.sent <= 8);
+    return status;
+}
+
+bool test_late_session_waits_for_next_pass()
+{
+    bool status = true;
+    ImageStream stream(1, 4, 4, 1000);
+    Server server(8);
+
+    COMMENT("test_late_session_waits_for_next_pass()");
+    uint32_t a = stream.OpenSession(0);
+    for (int i = 0; i < 6; i++) {
+        TEST(next(stream, server, a) == "img" + std::to_string(i));
+    }
+    TEST(stream.Retained() <= 4);
+    uint32_t b = stream.OpenSession(0);
+    TEST(next(stream, server, a) == "img6");
+    TEST(next(stream, server, a) == "img7");
+    TEST(next(stream, server, a) == "done");
+    TEST(next(stream, server, b) == "img0");
+    TEST(next(stream, server, b) == "img1");
+    return status;
+}
+
+bool test_default_session_and_expiry()
+{
+    bool status = true;
+    ImageStream stream(2, 8, 1, 1000);
+    Server server(2);
+
+    COMMENT("test_default_session_and_expiry()");
+    TEST(next(stream, server, ImageStream::DefaultSession) == "img0");
+    uint32_t a = stream.OpenSession(10);
+    TEST(next(stream, server, a, 20) == "img0");
+    TEST(next(stream, server, a, 2000) == "expired");
+    TEST(next(stream, server, ImageStream::DefaultSession, 2000) == "img0");
+    TEST(next(stream, server, ImageStream::DefaultSession, 2000) == "img1");
+    TEST(next(stream, server, ImageStream::DefaultSession, 2000) == "done");
+    stream.Reset();
+    TEST(stream.Retained() == 0);
+    TEST(stream.Sessions() == 0);
+    return status;
+}
+
+bool test_dropped_and_lost_requests()
+{
+    bool status = true;
+    ImageStream stream(2, 8, 2, 1000);
+    Server server(3);
+
+    COMMENT("test_dropped_and_lost_requests()");
+    uint32_t token = stream.OpenSession(0);
+    TEST(stream.RequestsNeeded() == 2);
+    stream.RequestSent(0);
+    stream.RequestSent(0);
+    stream.Dropped();
+    TEST(stream.InFlight() == 1);
+    TEST(next(stream, server, token, 10) == "img0");
+    TEST(stream.InFlight() == 0);
+
+    // Requests the server never answers
+    stream.RequestSent(100);
+    const char *image;
+    TEST(stream.Peek(token, 1000, &image) != ImageStream::Result::Expired);
+    TEST(!stream.ExpireRequests(1100));
+    TEST(stream.InFlight() == 1);
+    TEST(stream.Peek(token, 1200, &image) == ImageStream::Result::Expired);
+    TEST(stream.InFlight() == 0);
+    TEST(stream.Retained() == 0);
+    return status;
+}
+
+int main()
+{
+    if (test_single_session() && test_shared_sessions() && test_late_session_waits_for_next_pass() && test_default_session_and_expiry() &&
+        test_dropped_and_lost_requests())
+    {
+        return 0;
+    }
+    else
+    {
+        printf("Some tests failed\n");
+        return 1;
+    }
+}
@@ -0,0 +1,199 @@
+#include "log_aggregator.h"
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+/* Unit test helpers */
+#define COMMENT(x) printf("\n----" x "----\n");
+#define TEST(x) \
+    if (!(x)) { \
+        fprintf(stderr, "\033[31;1mFAILED:\033[22;39m %s:%d %s\n", __FILE__, __LINE__, #x); \
+        status = false; \
+    } else { \
+        printf("\033[32;1mOK:\033[22;39m %s\n", #x); \
+    }
+
+static std::vector<std::string> frames;
+static bool accepting = true;
+
+static bool sink(const char *frame, size_t length)
+{
+    if (!accepting)
+    {
+        return false;
+    }
+    frames.push_back(std::string(frame, length));
+    return strlen(frame) == length;
+}
+
+static const LogAggregator::Config configs[LOG_AGGREGATOR_TYPES] = {
+    {'n', 3, 60},
+    {'d', 1, 0},
+};
+
+bool test_packing()
+{
+    bool status = true;
+    COMMENT("test_packing");
+    frames.clear();
+    accepting = true;
+    LogAggregator aggregator(configs, 100, sink);
+
+    aggregator.Add(0, "first\n", 0);
+    aggregator.Add(0, "second", 10);
+    aggregator.Poll(50);
+    TEST(frames.empty());
+    aggregator.Poll(100);
+    TEST(frames.size() == 1 && frames[0] == "nfirst\nsecond");
+
+    // Types are sent in frames of their own.
+    aggregator.Add(0, "normal", 1000);
+    aggregator.Add(1, "debug", 1000);
+    aggregator.Add(0, "", 1000);
+    aggregator.Poll(1100);
+    TEST(frames.size() == 3 && frames[1] == "nnormal" && frames[2] == "ddebug");
+
+    // Frames are held back while the sink is busy.
+    accepting = false;
+    aggregator.Add(0, "held", 2000);
+    aggregator.Poll(2100);
+    TEST(frames.size() == 3);
+    accepting = true;
+    aggregator.Poll(2101);
+    TEST(frames.size() == 4 && frames[3] == "nheld");
+    return status;
+}
+
+bool test_full_frame()
+{
+    bool status = true;
+    COMMENT("test_full_frame");
+    frames.clear();
+    accepting = true;
+    static const LogAggregator::Config many[LOG_AGGREGATOR_TYPES] = {{'n', 1000, 60000}, {'d', 1, 0}};
+    LogAggregator aggregator(many, 100, sink);
+
+    std::string line(LOG_AGGREGATOR_LINE_SIZE - 11, 'x');
+    size_t added = 0;
+    while (frames.empty())
+    {
+        std::string numbered = std::to_string(added++) + line;
+        aggregator.Add(0, numbered.c_str(), 0);
+    }
+    TEST(frames[0].size() < LOG_AGGREGATOR_FRAME_SIZE);
+    TEST(frames[0].size() + line.size() + 2 >= LOG_AGGREGATOR_FRAME_SIZE - 1);
+    TEST(frames[0].compare(0, 2, "n0") == 0);
+
+    // The line that did not fit starts the next frame.
+    aggregator.Poll(100);
+    TEST(frames.size() == 2 && frames[1] == "n" + std::to_string(added - 1) + line);
+
+    // A full frame that cannot be sent drops the lines.
+    accepting = false;
+    uint32_t dropped = aggregator.Dropped();
+    for (int i = 0; i < 10; i++)
+    {
+        std::string numbered = std::to_string(i) + line;
+        aggregator.Add(0, numbered.c_str(), 200);
+    }
+    TEST(aggregator.Dropped() > dropped);
+    accepting = true;
+    aggregator.Add(0, "after", 200);
+    aggregator.Poll(400);
+    TEST(frames.back().find("messages suppressed\nafter") != std::string::npos);
+
+    // Long lines are truncated.
+    frames.clear();
+    std::string longLine(LOG_AGGREGATOR_LINE_SIZE * 2, 'y');
+    aggregator.Add(0, longLine.c_str(), 500);
+    aggregator.Poll(600);
+    TEST(frames.size() == 1 && frames[0] == "n" + std::string(LOG_AGGREGATOR_LINE_SIZE - 1, 'y'));
+    return status;
+}
+
+bool test_rate_limit()
+{
+    bool status = true;
+    COMMENT("test_rate_limit");
+    frames.clear();
+    accepting = true;
+    LogAggregator aggregator(configs, 100, sink);
+
+    // A burst of three, then one line per second.
+    for (int i = 0; i < 6; i++)
+    {
+        aggregator.Add(0, ("line " + std::to_string(i)).c_str(), 0);
+    }
+    aggregator.Poll(100);
+    TEST(frames.size() == 1 && frames[0] == "nline 0\nline 1\nline 2");
+    TEST(aggregator.Dropped() == 3);
+
+    aggregator.Add(0, "too soon", 500);
+    aggregator.Add(0, "later", 1000);
+    aggregator.Poll(1100);
+    TEST(frames.size() == 2 && frames[1] == "n4 messages suppressed\nlater");
+    TEST(aggregator.Dropped() == 4);
+
+    // The bucket refills up to the burst size.
+    for (int i = 0; i < 5; i++)
+    {
+        aggregator.Add(0, ("again " + std::to_string(i)).c_str(), 100000);
+    }
+    aggregator.Poll(100100);
+    TEST(frames.size() == 3 && frames[2] == "nagain 0\nagain 1\nagain 2");
+
+    // A type that does not refill only sends its burst.
+    aggregator.Add(1, "one", 200000);
+    aggregator.Add(1, "two", 300000);
+    aggregator.Poll(300100);
+    TEST(frames.size() == 4 && frames[3] == "done");
+    return status;
+}
+
+bool test_repeats()
+{
+    bool status = true;
+    COMMENT("test_repeats");
+    frames.clear();
+    accepting = true;
+    LogAggregator aggregator(configs, 100, sink);
+
+    for (int i = 0; i < 20; i++)
+    {
+        aggregator.Add(0, "WiFi connection down.\n", i);
+    }
+    aggregator.Add(0, "WiFi connected", 30);
+    aggregator.Poll(130);
+    TEST(frames.size() == 1 &&
+         frames[0] == "nWiFi connection down.\nlast message repeated 19 times\nWiFi connected");
+    TEST(aggregator.Dropped() == 0);
+
+    // Repeats are reported after holding off without a different line.
+    aggregator.Add(0, "WiFi connected", 200);
+    aggregator.Poll(250);
+    TEST(frames.size() == 1);
+    aggregator.Poll(300);
+    aggregator.Poll(400);
+    TEST(frames.size() == 2 && frames[1] == "nlast message repeated 1 times");
+
+    // Once counted the line is sent again.
+    aggregator.Add(0, "WiFi connected", 60000);
+    aggregator.Poll(60100);
+    TEST(frames.size() == 3 && frames[2] == "nWiFi connected");
+    return status;
+}
+
+
+int main()
+{
+    if (test_packing() && test_full_frame() && test_rate_limit() && test_repeats())
+    {
+        return 0;
+    }
+    else
+    {
+        printf("Some tests failed\n");
+        return 1;
+    }
+}
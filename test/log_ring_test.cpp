@@ -0,0 +1,111 @@
+#include "log_ring.h"
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
+/* Unit test helpers */
+#define COMMENT(x) printf("\n----" x "----\n");
+#define TEST(x) \
+    if (!(x)) { \
+        fprintf(stderr, "\033[31;1mFAILED:\033[22;39m %s:%d %s\n", __FILE__, __LINE__, #x); \
+        status = false; \
+    } else { \
+        printf("\033[32;1mOK:\033[22;39m %s\n", #x); \
+    }
+
+/* Formats an entry the way it is printed when drained. */
+static std::string format(const LogEntry *entry)
+{
+    char buffer[128];
+    snprintf(buffer, sizeof(buffer), entry->format, (unsigned long)entry->Arg(0), (unsigned long)entry->Arg(1),
+             (unsigned long)entry->Arg(2), (unsigned long)entry->Arg(3));
+    return buffer;
+}
+
+template <typename... Args>
+static bool write(LogRing &ring, const char *fmt, Args... args)
+{
+    LogEntry *entry = ring.Reserve();
+    if (!entry)
+    {
+        return false;
+    }
+    entry->format = fmt;
+    entry->Capture(0, args...);
+    ring.Commit(entry);
+    return true;
+}
+
+bool test_capture()
+{
+    bool status = true;
+    LogEntry entries[4] = {};
+    LogRing ring(entries, 4);
+
+    COMMENT("test_capture()");
+    char name[32] = "/status.json";
+    TEST(write(ring, "open %s\n", name));
+    // The name may change before the entry is drained.
+    strcpy(name, "/changed.json");
+    TEST(write(ring, "block %lu/%lu to %lx\n", 3UL, 10UL, 0x1000UL));
+    TEST(write(ring, "%s and %s\n", "0123456789012345678901234567890123456789", "lost"));
+
+    const LogEntry *entry = ring.Peek();
+    TEST(entry != nullptr && format(entry) == "open /status.json\n");
+    ring.Pop();
+    entry = ring.Peek();
+    TEST(entry != nullptr && format(entry) == "block 3/10 to 1000\n");
+    ring.Pop();
+    entry = ring.Peek();
+    TEST(entry != nullptr && format(entry) == "0123456789012345678901234567890 and \n");
+    ring.Pop();
+    TEST(ring.Peek() == nullptr);
+    return status;
+}
+
+bool test_full_and_order()
+{
+    bool status = true;
+    LogEntry entries[2] = {};
+    LogRing ring(entries, 2);
+
+    COMMENT("test_full_and_order()");
+    LogEntry *first = ring.Reserve();
+    first->format = "first\n";
+    TEST(write(ring, "second\n"));
+    TEST(!write(ring, "third\n"));
+    TEST(!write(ring, "fourth\n"));
+    TEST(ring.TakeDropped() == 2);
+    TEST(ring.TakeDropped() == 0);
+
+    // A reserved entry that is not committed yet holds back later ones.
+    TEST(ring.Peek() == nullptr);
+    ring.Commit(first);
+    TEST(ring.Peek() == first);
+    ring.Pop();
+    TEST(ring.Peek() != nullptr && strcmp(ring.Peek()->format, "second\n") == 0);
+    ring.Pop();
+
+    // Entries are reused after wrapping around.
+    for (int i = 0; i < 5; i++)
+    {
+        TEST(write(ring, "again %d\n", i));
+        TEST(ring.Peek() != nullptr && format(ring.Peek()) == "again " + std::to_string(i) + "\n");
+        ring.Pop();
+    }
+    return status;
+}
+
+
+int main()
+{
+    if (test_capture() && test_full_and_order())
+    {
+        return 0;
+    }
+    else
+    {
+        printf("Some tests failed\n");
+        return 1;
+    }
+}
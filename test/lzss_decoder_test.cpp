@@ -0,0 +1,189 @@
+#include "lzss_decoder.h"
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+/* Unit test helpers */
+#define COMMENT(x) printf("\n----" x "----\n");
+#define TEST(x) \
+    if (!(x)) { \
+        fprintf(stderr, "\033[31;1mFAILED:\033[22;39m %s:%d %s\n", __FILE__, __LINE__, #x); \
+        status = false; \
+    } else { \
+        printf("\033[32;1mOK:\033[22;39m %s\n", #x); \
+    }
+
+/* Writes symbols of the compressed format, most significant bit first */
+class BitWriter
+{
+public:
+    void Put(uint32_t value, int count)
+    {
+        for (int i = count - 1; i >= 0; i--)
+        {
+            if (used == 0)
+            {
+                data.push_back(0);
+            }
+            if (value & (1u << i))
+            {
+                data.back() |= 0x80 >> used;
+            }
+            used = (used + 1) % 8;
+        }
+    }
+
+    void Literal(uint8_t byte)
+    {
+        Put(1, 1);
+        Put(byte, 8);
+    }
+
+    void Reference(uint32_t distance, uint32_t count)
+    {
+        Put(0, 1);
+        Put(distance - 1, LZSS_WINDOW_BITS);
+        Put(count - 1, LZSS_LOOKAHEAD_BITS);
+    }
+
+    std::vector<uint8_t> data;
+    int used = 0;
+};
+
+/* Greedy encoder used as a reference */
+static std::vector<uint8_t> encode(const std::string &input)
+{
+    BitWriter writer;
+    const size_t window = 1 << LZSS_WINDOW_BITS;
+    const size_t maxCount = 1 << LZSS_LOOKAHEAD_BITS;
+    size_t i = 0;
+    while (i < input.size())
+    {
+        size_t bestCount = 0;
+        size_t bestDistance = 0;
+        for (size_t distance = 1; distance <= window && distance <= i; distance++)
+        {
+            size_t count = 0;
+            while (count < maxCount && i + count < input.size() && input[i + count] == input[i + count - distance])
+            {
+                count++;
+            }
+            if (count > bestCount)
+            {
+                bestCount = count;
+                bestDistance = distance;
+            }
+        }
+
+        if (bestCount >= 2)
+        {
+            writer.Reference(bestDistance, bestCount);
+            i += bestCount;
+        }
+        else
+        {
+            writer.Literal(input[i]);
+            i++;
+        }
+    }
+    return writer.data;
+}
+
+static bool append(void *context, const uint8_t *data, size_t length)
+{
+    ((std::string*)context)->append((const char*)data, length);
+    return true;
+}
+
+static std::string decode(const std::vector<uint8_t> &data, size_t piece)
+{
+    LzssDecoder decoder;
+    std::string output;
+    for (size_t i = 0; i < data.size(); i += piece)
+    {
+        decoder.Feed(data.data() + i, std::min(piece, data.size() - i), append, &output);
+    }
+    return output;
+}
+
+bool test_symbols()
+{
+    bool status = true;
+
+    COMMENT("test_symbols()");
+    BitWriter writer;
+    writer.Literal('a');
+    writer.Literal('b');
+    writer.Literal('c');
+    // A match may overlap the bytes it produces
+    writer.Reference(3, 7);
+    // The window starts out as zeros
+    writer.Reference(1024, 2);
+    TEST(decode(writer.data, 1) == std::string("abcabcabca") + std::string(2, '\0'));
+    TEST(decode(writer.data, 100) == std::string("abcabcabca") + std::string(2, '\0'));
+
+    // Padding bits that do not make a symbol are ignored
+    BitWriter padded;
+    padded.Literal('x');
+    padded.Put(0, 7);
+    TEST(decode(padded.data, 1) == "x");
+    return status;
+}
+
+bool test_round_trip()
+{
+    bool status = true;
+
+    COMMENT("test_round_trip()");
+    std::string data;
+    for (int i = 0; i < 5000; i++)
+    {
+        data += (i % 512 < 32) ? "UF2\n"[i % 4] : (char)((i * 31) % 7 + 'a');
+    }
+    std::vector<uint8_t> encoded = encode(data);
+    TEST(encoded.size() < data.size() / 2);
+    for (size_t piece : {1, 2, 7, 64, 1000, 100000})
+    {
+        TEST(decode(encoded, piece) == data);
+    }
+
+    LzssDecoder decoder;
+    std::string output;
+    decoder.Feed(encoded.data(), encoded.size(), append, &output);
+    TEST(decoder.Decoded() == data.size());
+    return status;
+}
+
+static bool stop_after_first(void *context, const uint8_t *, size_t)
+{
+    int *calls = (int*)context;
+    (*calls)++;
+    return false;
+}
+
+bool test_sink_stops()
+{
+    bool status = true;
+
+    COMMENT("test_sink_stops()");
+    std::vector<uint8_t> encoded = encode(std::string(1000, 'z'));
+    LzssDecoder decoder;
+    int calls = 0;
+    TEST(!decoder.Feed(encoded.data(), encoded.size(), stop_after_first, &calls));
+    TEST(calls == 1);
+    return status;
+}
+
+int main()
+{
+    if (test_symbols() && test_round_trip() && test_sink_stops())
+    {
+        return 0;
+    }
+    else
+    {
+        printf("Some tests failed\n");
+        return 1;
+    }
+}
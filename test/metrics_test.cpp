@@ -0,0 +1,123 @@
+#include "metrics.h"
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
+/* Unit test helpers */
+#define COMMENT(x) printf("\n----" x "----\n");
+#define TEST(x) \
+    if (!(x)) { \
+        fprintf(stderr, "\033[31;1mFAILED:\033[22;39m %s:%d %s\n", __FILE__, __LINE__, #x); \
+        status = false; \
+    } else { \
+        printf("\033[32;1mOK:\033[22;39m %s\n", #x); \
+    }
+
+bool test_histogram()
+{
+    bool status = true;
+    COMMENT("test_histogram");
+    LatencyHistogram histogram;
+    histogram.Observe(0);
+    histogram.Observe(1000);
+    histogram.Observe(1001);
+    histogram.Observe(30000);
+    histogram.Observe(5000000);
+
+    TEST(histogram.Count() == 5);
+    TEST(histogram.SumUs() == 5032001);
+    TEST(histogram.Cumulative(0) == 2);
+    TEST(histogram.Cumulative(1) == 3);
+    TEST(histogram.Cumulative(3) == 3);
+    TEST(histogram.Cumulative(4) == 4);
+    TEST(histogram.Cumulative(METRICS_LATENCY_BUCKETS - 1) == 4);
+    TEST(histogram.Cumulative(METRICS_LATENCY_BUCKETS) == 5);
+    return status;
+}
+
+bool test_text()
+{
+    bool status = true;
+    COMMENT("test_text");
+    std::string out;
+    MetricsText text(out);
+
+    text.Describe("queue_depth", "gauge", "Entries in a queue.");
+    text.Sample("queue_depth", "queue=\"output\"", (int64_t)3);
+    text.Sample("rssi", NULL, (int64_t)-61);
+    TEST(out == "# HELP queue_depth Entries in a queue.\n# TYPE queue_depth gauge\n"
+                "queue_depth{queue=\"output\"} 3\nrssi -61\n");
+
+    out.clear();
+    LatencyHistogram histogram;
+    histogram.Observe(2500);
+    histogram.Observe(1500000);
+    text.Histogram("latency_seconds", "route=\"/a\"", histogram);
+    TEST(out.find("latency_seconds_bucket{route=\"/a\",le=\"0.001000\"} 0\n") == 0);
+    TEST(out.find("latency_seconds_bucket{route=\"/a\",le=\"0.005000\"} 1\n") != std::string::npos);
+    TEST(out.find("latency_seconds_bucket{route=\"/a\",le=\"1.000000\"} 1\n") != std::string::npos);
+    TEST(out.find("latency_seconds_bucket{route=\"/a\",le=\"+Inf\"} 2\n") != std::string::npos);
+    TEST(out.find("latency_seconds_sum{route=\"/a\"} 1.502500\nlatency_seconds_count{route=\"/a\"} 2\n") != std::string::npos);
+
+    out.clear();
+    text.Histogram("plain", NULL, histogram);
+    TEST(out.find("plain_bucket{le=\"+Inf\"} 2\n") != std::string::npos);
+    TEST(out.find("plain_count 2\n") != std::string::npos);
+
+    std::string labels = "route=";
+    MetricsText::AppendLabelValue(labels, "a\"b\\c\nd");
+    TEST(labels == "route=\"a\\\"b\\\\c\\nd\"");
+    return status;
+}
+
+bool test_routes()
+{
+    bool status = true;
+    COMMENT("test_routes");
+    RouteMetrics routes(2);
+    size_t status_json = routes.Find("/status.json");
+    size_t index_html = routes.Find("/index.html");
+    TEST(status_json == 0 && index_html == 1);
+    TEST(routes.Find("/status.json") == status_json);
+    size_t other = routes.Find("/other.json");
+    TEST(other != status_json && other != index_html);
+
+    routes.Observe(status_json, 2000);
+    routes.Observe(status_json, 3000);
+    routes.Observe(index_html, 100);
+
+    std::string out;
+    MetricsText text(out);
+    routes.Write(text, "requests", "Requests.");
+    TEST(out.find("# TYPE requests histogram\n") != std::string::npos);
+    TEST(out.find("requests_count{route=\"/status.json\"} 2\n") != std::string::npos);
+    TEST(out.find("requests_count{route=\"/index.html\"} 1\n") != std::string::npos);
+    // Nothing was counted under other yet.
+    TEST(out.find("route=\"other\"") == std::string::npos);
+
+    routes.Observe(other, 10);
+    out.clear();
+    routes.Write(text, "requests", "Requests.");
+    TEST(out.find("requests_count{route=\"other\"} 1\n") != std::string::npos);
+
+    // Long routes are truncated.
+    RouteMetrics longRoutes(1);
+    std::string name(METRICS_ROUTE_NAME_SIZE * 2, 'x');
+    TEST(longRoutes.Find(name.c_str()) == 0);
+    TEST(longRoutes.Find(name.c_str()) == 0);
+    return status;
+}
+
+
+int main()
+{
+    if (test_histogram() && test_text() && test_routes())
+    {
+        return 0;
+    }
+    else
+    {
+        printf("Some tests failed\n");
+        return 1;
+    }
+}
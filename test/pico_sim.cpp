@@ -0,0 +1,234 @@
+#include "pico_sim.h"
+#include "hardware/sync.h"
+#include "hardware/timer.h"
+#include "hardware/watchdog.h"
+#include "hardware/structs/scb.h"
+#include "pico/multicore.h"
+#include "lwip/apps/httpd.h"
+#include "log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+uint8_t pico_sim_flash[PICO_SIM_FLASH_SIZE];
+pico_sim_state g_pico_sim;
+
+static watchdog_hw_t g_watchdog;
+watchdog_hw_t *const watchdog_hw = &g_watchdog;
+
+static armv6m_scb_hw_t g_scb;
+armv6m_scb_hw_t *const scb_hw = &g_scb;
+
+static bool g_irq_disabled;
+static uint64_t g_irq_disabled_at;
+
+static alarm_callback_t g_alarm;
+static void *g_alarm_data;
+
+void pico_sim_reset()
+{
+    memset(pico_sim_flash, 0xFF, sizeof(pico_sim_flash));
+    memset(&g_watchdog, 0, sizeof(g_watchdog));
+    memset(&g_pico_sim, 0, sizeof(g_pico_sim));
+    g_irq_disabled = false;
+    g_alarm = NULL;
+}
+
+void pico_sim_clear_stats()
+{
+    uint64_t time_us = g_pico_sim.time_us;
+    memset(&g_pico_sim, 0, sizeof(g_pico_sim));
+    g_pico_sim.time_us = time_us;
+}
+
+static bool check_operation(uint32_t offset, size_t count, uint32_t alignment)
+{
+    if (offset % alignment != 0 || count % alignment != 0 || offset + count > PICO_SIM_FLASH_SIZE)
+    {
+        fprintf(stderr, "Invalid flash operation at 0x%lx, %lu bytes\n", (unsigned long)offset, (unsigned long)count);
+        g_pico_sim.invalid_operations++;
+        return false;
+    }
+
+    if (!g_irq_disabled)
+    {
+        g_pico_sim.unprotected_operations++;
+    }
+    return true;
+}
+
+void flash_range_erase(uint32_t flash_offs, size_t count)
+{
+    if (!check_operation(flash_offs, count, FLASH_SECTOR_SIZE))
+    {
+        return;
+    }
+
+    memset(pico_sim_flash + flash_offs, 0xFF, count);
+    g_pico_sim.erase_operations++;
+    g_pico_sim.sectors_erased += count / FLASH_SECTOR_SIZE;
+    g_pico_sim.time_us += (uint64_t)PICO_SIM_SECTOR_ERASE_US * (count / FLASH_SECTOR_SIZE);
+}
+
+// Programming can only clear bits. Bytes of 0xFF leave the flash as it is.
+void flash_range_program(uint32_t flash_offs, const uint8_t *data, size_t count)
+{
+    if (!check_operation(flash_offs, count, FLASH_PAGE_SIZE))
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        uint8_t *byte = &pico_sim_flash[flash_offs + i];
+        if (data[i] != 0xFF && (data[i] & ~*byte))
+        {
+            g_pico_sim.program_conflicts++;
+        }
+        *byte &= data[i];
+    }
+    g_pico_sim.program_operations++;
+    g_pico_sim.pages_programmed += count / FLASH_PAGE_SIZE;
+    g_pico_sim.time_us += (uint64_t)PICO_SIM_PAGE_PROGRAM_US * (count / FLASH_PAGE_SIZE);
+}
+
+uint32_t save_and_disable_interrupts()
+{
+    uint32_t status = g_irq_disabled ? 0 : 1;
+    if (!g_irq_disabled)
+    {
+        g_irq_disabled = true;
+        g_irq_disabled_at = g_pico_sim.time_us;
+    }
+    return status;
+}
+
+void restore_interrupts(uint32_t status)
+{
+    if (status && g_irq_disabled)
+    {
+        uint64_t duration = g_pico_sim.time_us - g_irq_disabled_at;
+        g_pico_sim.irq_off_us += duration;
+        if (duration > g_pico_sim.max_irq_off_us)
+        {
+            g_pico_sim.max_irq_off_us = duration;
+        }
+        g_irq_disabled = false;
+    }
+}
+
+uint32_t time_us_32()
+{
+    return (uint32_t)g_pico_sim.time_us;
+}
+
+void pico_sim_aircr::operator=(uint32_t value)
+{
+    if (value == 0x05FA0004)
+    {
+        restore_interrupts(1);
+        g_pico_sim.reboots++;
+        throw PicoSimReboot();
+    }
+}
+
+alarm_id_t add_alarm_in_ms(uint32_t ms, alarm_callback_t callback, void *user_data, bool fire_if_past)
+{
+    (void)ms;
+    (void)fire_if_past;
+    g_alarm = callback;
+    g_alarm_data = user_data;
+    return 1;
+}
+
+bool pico_sim_run_alarm()
+{
+    alarm_callback_t alarm = g_alarm;
+    g_alarm = NULL;
+    if (alarm)
+    {
+        try
+        {
+            alarm(1, g_alarm_data);
+        }
+        catch (const PicoSimReboot &)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void multicore_reset_core1()
+{
+    g_pico_sim.core1_resets++;
+}
+
+// Defined by main.cpp in the firmware
+void start_multicore_i2c()
+{
+    g_pico_sim.core1_starts++;
+}
+
+struct pbuf *pico_sim_pbuf_chain(const uint8_t *data, size_t len, size_t segment)
+{
+    struct pbuf *first = NULL;
+    struct pbuf **next = &first;
+    size_t remain = len;
+    while (remain > 0)
+    {
+        struct pbuf *p = (struct pbuf*)malloc(sizeof(struct pbuf));
+        p->next = NULL;
+        p->payload = (void*)data;
+        p->len = (u16_t)((remain > segment) ? segment : remain);
+        p->tot_len = (u16_t)remain;
+        data += p->len;
+        remain -= p->len;
+        *next = p;
+        next = &p->next;
+        g_pico_sim.pbufs_allocated++;
+    }
+    return first;
+}
+
+u8_t pbuf_free(struct pbuf *p)
+{
+    u8_t count = 0;
+    while (p)
+    {
+        struct pbuf *next = p->next;
+        free(p);
+        g_pico_sim.pbufs_allocated--;
+        count++;
+        p = next;
+    }
+    return count;
+}
+
+void httpd_post_data_recved(void *connection, u16_t recved_len)
+{
+    (void)connection;
+    g_pico_sim.bytes_acked += recved_len;
+}
+
+// Warnings and errors of the firmware are printed right away
+static LogEntry g_log_entry;
+
+LogEntry *LogReserve(uint8_t level, const char *format)
+{
+    if (level < LOG_LEVEL_WARN)
+    {
+        return nullptr;
+    }
+    memset(&g_log_entry, 0, sizeof(g_log_entry));
+    g_log_entry.level = level;
+    g_log_entry.format = format;
+    return &g_log_entry;
+}
+
+void LogCommit(LogEntry *entry)
+{
+    printf("fw_upgrade: ");
+    printf(entry->format, (unsigned long)entry->Arg(0), (unsigned long)entry->Arg(1),
+           (unsigned long)entry->Arg(2), (unsigned long)entry->Arg(3));
+}
@@ -0,0 +1,58 @@
+// Host simulation of the Pico SDK and lwIP functions used by fw_upgrade.cpp.
+// The headers in pico_sim/ declare them in place of the real ones.
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "boot/uf2.h"
+#include "hardware/flash.h"
+#include "lwip/pbuf.h"
+
+// Flash of the Pico W
+#define PICO_SIM_FLASH_SIZE (2 * 1024 * 1024)
+
+// Typical flash timings of the W25Q16JV on the Pico W. The simulated clock only
+// advances while the flash is erased or programmed.
+#define PICO_SIM_SECTOR_ERASE_US 45000
+#define PICO_SIM_PAGE_PROGRAM_US 400
+
+typedef struct {
+    uint64_t time_us;
+
+    uint32_t erase_operations;
+    uint32_t sectors_erased;
+    uint32_t program_operations;
+    uint32_t pages_programmed;
+    // Operations that are not aligned or not within the flash
+    uint32_t invalid_operations;
+    // Bytes other than 0xFF programmed with bits set that are not erased
+    uint32_t program_conflicts;
+    // Flash operations done with interrupts enabled
+    uint32_t unprotected_operations;
+
+    uint64_t irq_off_us;
+    uint32_t max_irq_off_us;
+
+    uint32_t core1_resets;
+    uint32_t core1_starts;
+    uint32_t reboots;
+
+    // Bytes acknowledged with httpd_post_data_recved and pbufs not freed
+    uint64_t bytes_acked;
+    int32_t pbufs_allocated;
+} pico_sim_state;
+
+extern pico_sim_state g_pico_sim;
+
+// Erase the flash and clear the watchdog registers, the alarm and all counters
+void pico_sim_reset();
+
+// Clear the counters, keeping the flash and the clock
+void pico_sim_clear_stats();
+
+// Make a pbuf chain of len bytes of data split into pbufs of at most segment bytes.
+// The data is not copied.
+struct pbuf *pico_sim_pbuf_chain(const uint8_t *data, size_t len, size_t segment);
+
+// Run the alarm added with add_alarm_in_ms, if any. Returns true if it rebooted.
+bool pico_sim_run_alarm();
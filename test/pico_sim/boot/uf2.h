@@ -0,0 +1,31 @@
+// UF2 block format of the Pico SDK, for host tests
+#pragma once
+
+#include <stdint.h>
+
+#define UF2_MAGIC_START0 0x0A324655u
+#define UF2_MAGIC_START1 0x9E5D5157u
+#define UF2_MAGIC_END    0x0AB16F30u
+
+#define UF2_FLAG_NOT_MAIN_FLASH    0x00000001u
+#define UF2_FLAG_FILE_CONTAINER    0x00001000u
+#define UF2_FLAG_FAMILY_ID_PRESENT 0x00002000u
+#define UF2_FLAG_MD5_PRESENT       0x00004000u
+
+#define RP2040_FAMILY_ID       0xe48bff56u
+#define RP2350_ARM_S_FAMILY_ID 0xe48bff59u
+
+struct uf2_block {
+    uint32_t magic_start0;
+    uint32_t magic_start1;
+    uint32_t flags;
+    uint32_t target_addr;
+    uint32_t payload_size;
+    uint32_t block_no;
+    uint32_t num_blocks;
+    uint32_t file_size; // or family ID
+    uint8_t data[476];
+    uint32_t magic_end;
+};
+
+static_assert(sizeof(uf2_block) == 512, "UF2 blocks are 512 bytes");
@@ -0,0 +1,16 @@
+// Flash of the Pico SDK, simulated by pico_sim.cpp
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Flash is read from the simulated flash array
+extern uint8_t pico_sim_flash[];
+#define XIP_BASE ((uintptr_t)pico_sim_flash)
+#define XIP_NOCACHE_NOALLOC_BASE ((uintptr_t)pico_sim_flash)
+
+#define FLASH_PAGE_SIZE (1u << 8)
+#define FLASH_SECTOR_SIZE (1u << 12)
+
+void flash_range_erase(uint32_t flash_offs, size_t count);
+void flash_range_program(uint32_t flash_offs, const uint8_t *data, size_t count);
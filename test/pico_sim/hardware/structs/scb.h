@@ -0,0 +1,17 @@
+// System control block of the Pico SDK, simulated by pico_sim.cpp
+#pragma once
+
+#include <stdint.h>
+
+// Writing a reset request to AIRCR throws PicoSimReboot
+struct PicoSimReboot {};
+
+struct pico_sim_aircr {
+    void operator=(uint32_t value);
+};
+
+typedef struct {
+    pico_sim_aircr aircr;
+} armv6m_scb_hw_t;
+
+extern armv6m_scb_hw_t *const scb_hw;
@@ -0,0 +1,7 @@
+// Interrupt control of the Pico SDK, simulated by pico_sim.cpp
+#pragma once
+
+#include <stdint.h>
+
+uint32_t save_and_disable_interrupts();
+void restore_interrupts(uint32_t status);
@@ -0,0 +1,6 @@
+// Timer of the Pico SDK, simulated by pico_sim.cpp
+#pragma once
+
+#include <stdint.h>
+
+uint32_t time_us_32();
@@ -0,0 +1,10 @@
+// Watchdog registers of the Pico SDK, simulated by pico_sim.cpp
+#pragma once
+
+#include <stdint.h>
+
+typedef struct {
+    uint32_t scratch[8];
+} watchdog_hw_t;
+
+extern watchdog_hw_t *const watchdog_hw;
@@ -0,0 +1,4 @@
+// lwIP httpd file system, unused by host tests
+#pragma once
+
+#include "lwip/err.h"
@@ -0,0 +1,8 @@
+// lwIP httpd POST interface, simulated by pico_sim.cpp
+#pragma once
+
+#include "lwip/opt.h"
+#include "lwip/err.h"
+#include "lwip/pbuf.h"
+
+void httpd_post_data_recved(void *connection, u16_t recved_len);
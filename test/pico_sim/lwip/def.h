@@ -0,0 +1,6 @@
+// lwIP definitions, for host tests
+#pragma once
+
+#include "lwip/arch.h"
+
+#define LWIP_UNUSED_ARG(x) (void)x
@@ -0,0 +1,4 @@
+// lwIP heap, unused by host tests
+#pragma once
+
+#include "lwip/arch.h"
@@ -0,0 +1,4 @@
+// lwIP options, taken from the firmware configuration
+#pragma once
+
+#include "lwipopts.h"
@@ -0,0 +1,13 @@
+// lwIP packet buffers, simulated by pico_sim.cpp
+#pragma once
+
+#include "lwip/arch.h"
+
+struct pbuf {
+    struct pbuf *next;
+    void *payload;
+    u16_t tot_len;
+    u16_t len;
+};
+
+u8_t pbuf_free(struct pbuf *p);
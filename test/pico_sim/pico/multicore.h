@@ -0,0 +1,6 @@
+// Multicore control of the Pico SDK, simulated by pico_sim.cpp
+#pragma once
+
+#include "pico/time.h"
+
+void multicore_reset_core1();
@@ -0,0 +1,9 @@
+// Alarms of the Pico SDK, simulated by pico_sim.cpp
+#pragma once
+
+#include <stdint.h>
+
+typedef int32_t alarm_id_t;
+typedef int64_t (*alarm_callback_t)(alarm_id_t id, void *user_data);
+
+alarm_id_t add_alarm_in_ms(uint32_t ms, alarm_callback_t callback, void *user_data, bool fire_if_past);
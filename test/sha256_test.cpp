@@ -0,0 +1,122 @@
+#include "sha256.h"
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
+/* Unit test helpers */
+#define COMMENT(x) printf("\n----" x "----\n");
+#define TEST(x) \
+    if (!(x)) { \
+        fprintf(stderr, "\033[31;1mFAILED:\033[22;39m %s:%d %s\n", __FILE__, __LINE__, #x); \
+        status = false; \
+    } else { \
+        printf("\033[32;1mOK:\033[22;39m %s\n", #x); \
+    }
+
+static std::string hex(const uint8_t *digest)
+{
+    std::string result;
+    char buffer[3];
+    for (int i = 0; i < SHA256_DIGEST_SIZE; i++)
+    {
+        snprintf(buffer, sizeof(buffer), "%02x", digest[i]);
+        result += buffer;
+    }
+    return result;
+}
+
+static std::string sha256(const std::string &data)
+{
+    Sha256 hash;
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    hash.Update((const uint8_t*)data.data(), data.size());
+    hash.Finish(digest);
+    return hex(digest);
+}
+
+bool test_vectors()
+{
+    bool status = true;
+
+    COMMENT("test_vectors()");
+    // FIPS 180-2 examples
+    TEST(sha256("") == "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+    TEST(sha256("abc") == "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+    TEST(sha256("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq") ==
+         "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+    TEST(sha256(std::string(1000000, 'a')) == "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+
+    // Padding that spills into another block
+    TEST(sha256(std::string(55, 'a')) == "9f4390f8d30c2dd92ec9f095b65e2b9ae9b0a925a5258e241c9f1e910f734318");
+    TEST(sha256(std::string(56, 'a')) == "b35439a4ac6f0948b6d6f9e3c6af0f5f590ce20f1bde7090ef7970686ec6738a");
+    TEST(sha256(std::string(64, 'a')) == "ffe054fe7ae0cb6dc65c3af9b61d5209f439851db43d0ba5997337df154668eb");
+    return status;
+}
+
+bool test_pieces_and_resume()
+{
+    bool status = true;
+
+    COMMENT("test_pieces_and_resume()");
+    std::string data;
+    for (int i = 0; i < 3000; i++)
+    {
+        data += (char)(i * 7);
+    }
+    std::string expected = sha256(data);
+
+    // Any split gives the same digest
+    for (size_t piece : {1, 3, 63, 64, 65, 512, 1000})
+    {
+        Sha256 hash;
+        for (size_t i = 0; i < data.size(); i += piece)
+        {
+            hash.Update((const uint8_t*)data.data() + i, std::min(piece, data.size() - i));
+        }
+        uint8_t digest[SHA256_DIGEST_SIZE];
+        hash.Finish(digest);
+        TEST(hex(digest) == expected);
+    }
+
+    // The state saved at a block boundary continues in another hash
+    Sha256 first;
+    first.Update((const uint8_t*)data.data(), 1024);
+    TEST(first.Length() == 1024);
+    uint32_t state[SHA256_STATE_WORDS];
+    memcpy(state, first.State(), sizeof(state));
+
+    Sha256 second;
+    second.Resume(state, 1024);
+    second.Update((const uint8_t*)data.data() + 1024, data.size() - 1024);
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    second.Finish(digest);
+    TEST(hex(digest) == expected);
+    return status;
+}
+
+bool test_parse()
+{
+    bool status = true;
+    uint8_t digest[SHA256_DIGEST_SIZE];
+
+    COMMENT("test_parse()");
+    TEST(ParseSha256("BA7816BF8F01CFEA414140DE5DAE2223b00361a396177a9cb410ff61f20015ad", digest));
+    TEST(hex(digest) == sha256("abc"));
+    TEST(!ParseSha256("ba7816bf", digest));
+    TEST(!ParseSha256("ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad0", digest));
+    TEST(!ParseSha256("xa7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad", digest));
+    return status;
+}
+
+int main()
+{
+    if (test_vectors() && test_pieces_and_resume() && test_parse())
+    {
+        return 0;
+    }
+    else
+    {
+        printf("Some tests failed\n");
+        return 1;
+    }
+}
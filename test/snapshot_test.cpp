@@ -0,0 +1,78 @@
+#include "snapshot.h"
+#include <stdio.h>
+#include <string.h>
+
+/* Unit test helpers */
+#define COMMENT(x) printf("\n----" x "----\n");
+#define TEST(x) \
+    if (!(x)) { \
+        fprintf(stderr, "\033[31;1mFAILED:\033[22;39m %s:%d %s\n", __FILE__, __LINE__, #x); \
+        status = false; \
+    } else { \
+        printf("\033[32;1mOK:\033[22;39m %s\n", #x); \
+    }
+
+static int g_deleted = 0;
+
+class CountedSnapshot : public Snapshot {
+  public:
+    ~CountedSnapshot() { g_deleted++; }
+};
+
+bool test_publish_releases_previous()
+{
+    bool status = true;
+    SnapshotSlot slot;
+    g_deleted = 0;
+
+    COMMENT("test_publish_releases_previous()");
+    TEST(slot.Acquire() == nullptr);
+    slot.Publish(new CountedSnapshot());
+    TEST(slot.Version() == 1);
+    TEST(slot.Current()->Version() == 1);
+    slot.Publish(new CountedSnapshot());
+    TEST(g_deleted == 1);
+    TEST(slot.Current()->Version() == 2);
+    return status;
+}
+
+bool test_reader_keeps_snapshot()
+{
+    bool status = true;
+    SnapshotSlot slot;
+
+    COMMENT("test_reader_keeps_snapshot()");
+    slot.Publish(new TextSnapshot("{\"image\":1}"));
+    TextSnapshot *reading = (TextSnapshot *)slot.Acquire();
+    slot.Publish(new TextSnapshot("{\"image\":2}"));
+    TEST(reading->text == "{\"image\":1}");
+    TEST(((TextSnapshot *)slot.Current())->text == "{\"image\":2}");
+    reading->Release();
+
+    g_deleted = 0;
+    {
+        SnapshotSlot other;
+        other.Publish(new CountedSnapshot());
+        Snapshot *held = other.Acquire();
+        other.Publish(new CountedSnapshot());
+        TEST(g_deleted == 0);
+        held->Release();
+        TEST(g_deleted == 1);
+    }
+    TEST(g_deleted == 2);
+    return status;
+}
+
+
+int main()
+{
+    if (test_publish_releases_previous() && test_reader_keeps_snapshot())
+    {
+        return 0;
+    }
+    else
+    {
+        printf("Some tests failed\n");
+        return 1;
+    }
+}
@@ -0,0 +1,97 @@
+#include "status_model.h"
+#include <stdio.h>
+#include <string.h>
+
+/* Unit test helpers */
+#define COMMENT(x) printf("\n----" x "----\n");
+#define TEST(x) \
+    if (!(x)) { \
+        fprintf(stderr, "\033[31;1mFAILED:\033[22;39m %s:%d %s\n", __FILE__, __LINE__, #x); \
+        status = false; \
+    } else { \
+        printf("\033[32;1mOK:\033[22;39m %s\n", #x); \
+    }
+
+static bool update(StatusModel &model, const char *json)
+{
+    return model.Update(json, strlen(json));
+}
+
+static std::string project(const StatusModel &model, const char *names)
+{
+    std::string out;
+    model.Project(names, out);
+    return out;
+}
+
+static std::string delta(const StatusModel &model, uint32_t since)
+{
+    std::string out;
+    model.Delta(since, out);
+    return out;
+}
+
+bool test_parse_and_project()
+{
+    bool status = true;
+    StatusModel model;
+
+    COMMENT("test_parse_and_project()");
+    TEST(model.Generation() == 0);
+    TEST(delta(model, 0) == "{\"generation\":0,\"changed\":{}}");
+    TEST(update(model, "{\"isPrimary\": true, \"image\":{\"filename\":\"a,\\\"b}.iso\",\"size\":[1,2]},\"n\":-1.5e3 }"));
+    TEST(model.Generation() == 1);
+    TEST(project(model, "image,isPrimary") == "{\"image\":{\"filename\":\"a,\\\"b}.iso\",\"size\":[1,2]},\"isPrimary\":true}");
+    TEST(project(model, "n,missing") == "{\"n\":-1.5e3}");
+    TEST(project(model, "") == "{}");
+
+    TEST(!update(model, "[1,2]"));
+    TEST(!update(model, "{\"image\":{\"filename\":\"x\""));
+    TEST(!update(model, "{\"image\" 1}"));
+    TEST(model.Generation() == 1);
+    TEST(project(model, "n") == "{\"n\":-1.5e3}");
+    return status;
+}
+
+bool test_delta()
+{
+    bool status = true;
+    StatusModel model;
+
+    COMMENT("test_delta()");
+    TEST(update(model, "{\"isPrimary\":true,\"image\":{\"filename\":\"a.iso\"},\"mode\":1}"));
+    TEST(delta(model, 0) == "{\"generation\":1,\"changed\":{\"isPrimary\":true,\"image\":{\"filename\":\"a.iso\"},\"mode\":1}}");
+    TEST(delta(model, 1) == "{\"generation\":1,\"changed\":{}}");
+
+    // Unchanged status does not advance the generation.
+    TEST(update(model, "{\"isPrimary\":true,\"image\":{\"filename\":\"a.iso\"},\"mode\":1}"));
+    TEST(model.Generation() == 1);
+
+    TEST(update(model, "{\"isPrimary\":true,\"image\":{\"filename\":\"b.iso\"}}"));
+    TEST(model.Generation() == 2);
+    TEST(delta(model, 1) == "{\"generation\":2,\"changed\":{\"image\":{\"filename\":\"b.iso\"},\"mode\":null}}");
+    TEST(delta(model, 0) == "{\"generation\":2,\"changed\":{\"isPrimary\":true,\"image\":{\"filename\":\"b.iso\"}}}");
+    TEST(project(model, "mode") == "{}");
+
+    TEST(update(model, "{\"isPrimary\":false,\"image\":{\"filename\":\"b.iso\"},\"mode\":2}"));
+    TEST(delta(model, 2) == "{\"generation\":3,\"changed\":{\"isPrimary\":false,\"mode\":2}}");
+    TEST(delta(model, 1) == "{\"generation\":3,\"changed\":{\"isPrimary\":false,\"image\":{\"filename\":\"b.iso\"},\"mode\":2}}");
+
+    // A generation from before a restart gets every field.
+    TEST(delta(model, 9) == delta(model, 0));
+    return status;
+}
+
+
+int main()
+{
+    if (test_parse_and_project() && test_delta())
+    {
+        return 0;
+    }
+    else
+    {
+        printf("Some tests failed\n");
+        return 1;
+    }
+}
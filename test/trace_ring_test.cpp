@@ -0,0 +1,96 @@
+#include "trace_ring.h"
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
+/* Unit test helpers */
+#define COMMENT(x) printf("\n----" x "----\n");
+#define TEST(x) \
+    if (!(x)) { \
+        fprintf(stderr, "\033[31;1mFAILED:\033[22;39m %s:%d %s\n", __FILE__, __LINE__, #x); \
+        status = false; \
+    } else { \
+        printf("\033[32;1mOK:\033[22;39m %s\n", #x); \
+    }
+
+static void record(TraceRing &ring, uint32_t time, char phase = 'i')
+{
+    ring.Record(TraceEvent{time, "event", time * 2, phase, 1});
+}
+
+bool test_copy()
+{
+    bool status = true;
+    COMMENT("test_copy");
+    TraceEvent entries[4];
+    TraceRing ring(entries, 4);
+    TraceEvent out[4];
+
+    TEST(ring.Copy(out, 4) == 0);
+    record(ring, 10);
+    record(ring, 20);
+    TEST(ring.Copy(out, 4) == 2);
+    TEST(out[0].timeUs == 10 && out[1].timeUs == 20 && out[1].arg == 40);
+
+    // Only the latest max events are copied.
+    TEST(ring.Copy(out, 1) == 1);
+    TEST(out[0].timeUs == 20);
+    return status;
+}
+
+bool test_wrap()
+{
+    bool status = true;
+    COMMENT("test_wrap");
+    TraceEvent entries[4];
+    TraceRing ring(entries, 4);
+    TraceEvent out[4];
+
+    for (uint32_t i = 1; i <= 10; i++)
+    {
+        record(ring, i);
+    }
+    TEST(ring.Written() == 10);
+
+    // The oldest slot left could be the one being overwritten, so it is left out.
+    size_t count = ring.Copy(out, 4);
+    TEST(count == 3);
+    TEST(out[0].timeUs == 8 && out[1].timeUs == 9 && out[2].timeUs == 10);
+
+    TEST(ring.Copy(out, 2) == 2);
+    TEST(out[0].timeUs == 9 && out[1].timeUs == 10);
+    return status;
+}
+
+bool test_format()
+{
+    bool status = true;
+    COMMENT("test_format");
+    char buffer[160];
+    TraceEvent begin{1500, "cgi /image", 0, 'B', 0};
+    int length = FormatTraceEvent(begin, true, buffer, sizeof(buffer));
+    TEST(std::string(buffer) == "{\"name\":\"cgi /image\",\"ph\":\"B\",\"ts\":1500,\"pid\":1,\"tid\":0,\"args\":{\"arg\":0}}");
+    TEST(length == (int)strlen(buffer));
+
+    TraceEvent instant{42, "enqueue", 11, 'i', 1};
+    length = FormatTraceEvent(instant, false, buffer, sizeof(buffer));
+    TEST(std::string(buffer) == ",{\"name\":\"enqueue\",\"ph\":\"i\",\"s\":\"t\",\"ts\":42,\"pid\":1,\"tid\":1,\"args\":{\"arg\":11}}");
+
+    // The length is reported even if the buffer is too small.
+    TEST(FormatTraceEvent(instant, false, buffer, 8) == length);
+    return status;
+}
+
+
+int main()
+{
+    if (test_copy() && test_wrap() && test_format())
+    {
+        return 0;
+    }
+    else
+    {
+        printf("Some tests failed\n");
+        return 1;
+    }
+}
@@ -0,0 +1,106 @@
+# Compress a UF2 file for upload to /fw_upgrade.cgi.
+#
+# The output starts with "ZFW1", followed by a section for each family ID in
+# the UF2 file: the family ID and the length of the section data as 32-bit
+# little endian values, and the UF2 blocks of that family compressed with LZSS
+# in the heatshrink format (window 2^10, lookahead 2^4). The PicoW only
+# decompresses the section for its own family.
+#
+# Usage: python compress_uf2.py input.uf2 output.zfw
+
+import hashlib
+import struct
+import sys
+
+UF2_MAGIC_START0 = 0x0A324655
+UF2_FLAG_NOT_MAIN_FLASH = 0x00000001
+UF2_FLAG_FAMILY_ID_PRESENT = 0x00002000
+
+WINDOW_BITS = 10
+LOOKAHEAD_BITS = 4
+MIN_MATCH = 2
+MAX_CANDIDATES = 32
+
+class BitWriter:
+    def __init__(self):
+        self.data = bytearray()
+        self.value = 0
+        self.count = 0
+
+    def put(self, value, bits):
+        self.value = (self.value << bits) | value
+        self.count += bits
+        while self.count >= 8:
+            self.count -= 8
+            self.data.append((self.value >> self.count) & 0xFF)
+        self.value &= (1 << self.count) - 1
+
+    def finish(self):
+        if self.count > 0:
+            self.data.append((self.value << (8 - self.count)) & 0xFF)
+        return bytes(self.data)
+
+def compress(data):
+    window = 1 << WINDOW_BITS
+    max_match = 1 << LOOKAHEAD_BITS
+    writer = BitWriter()
+    positions = {}
+    i = 0
+    while i < len(data):
+        best_count = 0
+        best_distance = 0
+        key = data[i:i + MIN_MATCH]
+        candidates = positions.get(key, [])
+        for pos in reversed(candidates):
+            distance = i - pos
+            if distance > window:
+                break
+            count = MIN_MATCH
+            while count < max_match and i + count < len(data) and data[pos + count] == data[i + count]:
+                count += 1
+            if count > best_count:
+                best_count = count
+                best_distance = distance
+                if count == max_match:
+                    break
+
+        step = best_count if best_count >= MIN_MATCH else 1
+        if best_count >= MIN_MATCH:
+            writer.put(0, 1)
+            writer.put(best_distance - 1, WINDOW_BITS)
+            writer.put(best_count - 1, LOOKAHEAD_BITS)
+        else:
+            writer.put(1, 1)
+            writer.put(data[i], 8)
+
+        for j in range(i, min(i + step, len(data) - MIN_MATCH + 1)):
+            chain = positions.setdefault(data[j:j + MIN_MATCH], [])
+            chain.append(j)
+            if len(chain) > MAX_CANDIDATES:
+                del chain[0]
+        i += step
+
+    return writer.finish()
+
+def main():
+    data = open(sys.argv[1], 'rb').read()
+    families = {}
+    for offset in range(0, len(data) - 511, 512):
+        block = data[offset:offset + 512]
+        magic, _, flags = struct.unpack('<III', block[:12])
+        family = struct.unpack('<I', block[28:32])[0]
+        if magic != UF2_MAGIC_START0 or flags & UF2_FLAG_NOT_MAIN_FLASH or not flags & UF2_FLAG_FAMILY_ID_PRESENT:
+            continue
+        families.setdefault(family, bytearray()).extend(block)
+
+    output = bytearray(b'ZFW1')
+    for family, blocks in families.items():
+        compressed = compress(bytes(blocks))
+        output += struct.pack('<II', family, len(compressed)) + compressed
+        print("Family 0x%08x: %d bytes compressed to %d" % (family, len(blocks), len(compressed)))
+
+    open(sys.argv[2], 'wb').write(output)
+    print("SHA-256 of %s: %s" % (sys.argv[2], hashlib.sha256(output).hexdigest()))
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,130 @@
+# Make a patch that upgrades the firmware built as base.uf2 to new.uf2 through
+# /fw_upgrade.cgi, transferring only what changed.
+#
+# The patch starts with "ZDP1", the family ID, the size and SHA-256 of the base
+# flash image, and the size of the new image, followed by operations that
+# produce the new image from its start: 1 copies a range of the base image
+# (offset and length follow), and 2 inserts data (length and the data follow).
+# All values are 32-bit little endian. The PicoW rejects a patch whose base
+# does not match its running firmware.
+#
+# Usage: python make_delta.py base.uf2 new.uf2 output.zdp [family_id]
+
+import hashlib
+import struct
+import sys
+
+UF2_MAGIC_START0 = 0x0A324655
+UF2_FLAG_NOT_MAIN_FLASH = 0x00000001
+UF2_FLAG_FAMILY_ID_PRESENT = 0x00002000
+FLASH_BASE = 0x10000000
+PAGE_SIZE = 256
+
+OP_COPY = 1
+OP_INSERT = 2
+
+# Matches are looked up by their first bytes, and shorter ones are inserted
+MIN_MATCH = 16
+
+def read_images(path):
+    """Flash images of each family in a UF2 file, with gaps left erased"""
+    data = open(path, 'rb').read()
+    pages = {}
+    for offset in range(0, len(data) - 511, 512):
+        block = data[offset:offset + 512]
+        magic, _, flags, addr, size = struct.unpack('<IIIII', block[:20])
+        family = struct.unpack('<I', block[28:32])[0]
+        if magic != UF2_MAGIC_START0 or flags & UF2_FLAG_NOT_MAIN_FLASH or not flags & UF2_FLAG_FAMILY_ID_PRESENT:
+            continue
+        pages.setdefault(family, {})[addr - FLASH_BASE] = block[32:32 + size]
+
+    images = {}
+    for family, family_pages in pages.items():
+        image = bytearray(b'\xff' * (max(family_pages) + PAGE_SIZE))
+        for offset, payload in family_pages.items():
+            image[offset:offset + len(payload)] = payload
+        images[family] = bytes(image)
+    return images
+
+def match_length(base, base_pos, image, image_pos):
+    length = 0
+    limit = min(len(base) - base_pos, len(image) - image_pos)
+    # Compare in chunks first, most matches are long
+    while length + 64 <= limit and base[base_pos + length:base_pos + length + 64] == image[image_pos + length:image_pos + length + 64]:
+        length += 64
+    while length < limit and base[base_pos + length] == image[image_pos + length]:
+        length += 1
+    return length
+
+def make_patch(base, image):
+    index = {}
+    for pos in range(0, len(base) - MIN_MATCH + 1, 2):
+        index.setdefault(base[pos:pos + MIN_MATCH], pos)
+
+    ops = bytearray()
+    pending = bytearray()
+    def flush_insert():
+        if pending:
+            ops.extend(struct.pack('<BI', OP_INSERT, len(pending)) + pending)
+            pending.clear()
+
+    pos = 0
+    while pos < len(image):
+        # Code that did not move is the most common match
+        best_pos, best_length = pos, match_length(base, pos, image, pos) if pos < len(base) else 0
+        candidate = index.get(image[pos:pos + MIN_MATCH])
+        if candidate is not None and candidate != pos:
+            length = match_length(base, candidate, image, pos)
+            if length > best_length:
+                best_pos, best_length = candidate, length
+
+        if best_length >= MIN_MATCH:
+            flush_insert()
+            ops.extend(struct.pack('<BII', OP_COPY, best_pos, best_length))
+            pos += best_length
+        else:
+            pending.append(image[pos])
+            pos += 1
+    flush_insert()
+    return bytes(ops)
+
+def apply_patch(base, ops):
+    image = bytearray()
+    pos = 0
+    while pos < len(ops):
+        if ops[pos] == OP_COPY:
+            offset, length = struct.unpack('<II', ops[pos + 1:pos + 9])
+            image += base[offset:offset + length]
+            pos += 9
+        else:
+            length = struct.unpack('<I', ops[pos + 1:pos + 5])[0]
+            image += ops[pos + 5:pos + 5 + length]
+            pos += 5 + length
+    return bytes(image)
+
+def main():
+    base_images = read_images(sys.argv[1])
+    images = read_images(sys.argv[2])
+    families = set(base_images) & set(images)
+    if len(sys.argv) > 4:
+        family = int(sys.argv[4], 0)
+    elif len(families) == 1:
+        family = families.pop()
+    else:
+        sys.exit("Give the family ID, the files have " + ", ".join("0x%08x" % f for f in sorted(families)))
+    if family not in base_images or family not in images:
+        sys.exit("Family 0x%08x is not in both files" % family)
+
+    base = base_images[family]
+    image = images[family]
+    ops = make_patch(base, image)
+    assert apply_patch(base, ops) == image
+
+    patch = (b'ZDP1' + struct.pack('<II', family, len(base)) + hashlib.sha256(base).digest() +
+             struct.pack('<I', len(image)) + ops)
+    open(sys.argv[3], 'wb').write(patch)
+    print("Patch for family 0x%08x: %d bytes for an image of %d bytes" % (family, len(patch), len(image)))
+    print("SHA-256 of %s: %s" % (sys.argv[3], hashlib.sha256(patch).hexdigest()))
+
+if __name__ == '__main__':
+    main()